@@ -0,0 +1,163 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_boundedqueue_h__
+#define ifmap_boundedqueue_h__
+
+#include <pthread.h>
+#include <time.h>
+#include <deque>
+
+/*
+ * Queue between threads holding at most capacity items. push()
+ * blocks while the queue is full, so a producer can never get further
+ * ahead of the consumer than that.
+ *
+ * Deadlines are in microseconds of monotonicMicros() (histogram.h).
+ */
+template <class T>
+class BoundedQueue
+{
+public:
+    enum Result { ITEM, TIMEOUT, CLOSED };
+
+    BoundedQueue(size_t capacity)
+        : m_capacity(capacity), m_closed(false), m_highWater(0)
+    {
+        pthread_mutex_init(&m_lock, 0);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&m_notEmpty, &attr);
+        pthread_cond_init(&m_notFull, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    ~BoundedQueue()
+    {
+        pthread_cond_destroy(&m_notFull);
+        pthread_cond_destroy(&m_notEmpty);
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    /*
+     * Adds item, waiting for room if the queue is full. Returns false
+     * if the queue has been closed.
+     */
+    bool push(const T& item)
+    {
+        pthread_mutex_lock(&m_lock);
+        while (m_items.size() >= m_capacity && !m_closed) {
+            pthread_cond_wait(&m_notFull, &m_lock);
+        }
+        bool pushed = !m_closed;
+        if (pushed) {
+            m_items.push_back(item);
+            if (m_items.size() > m_highWater) {
+                m_highWater = m_items.size();
+            }
+            pthread_cond_signal(&m_notEmpty);
+        }
+        pthread_mutex_unlock(&m_lock);
+        return pushed;
+    }
+
+    /*
+     * Ends the queue. Items already queued can still be popped.
+     */
+    void close()
+    {
+        pthread_mutex_lock(&m_lock);
+        m_closed = true;
+        pthread_cond_broadcast(&m_notEmpty);
+        pthread_cond_broadcast(&m_notFull);
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    /*
+     * Removes the oldest item into item, waiting until deadline for
+     * one if the queue is empty. A deadline of 0 waits indefinitely.
+     * Returns CLOSED once the queue is closed and empty.
+     */
+    Result pop(T& item, long long deadline)
+    {
+        timespec until;
+        until.tv_sec = deadline / 1000000;
+        until.tv_nsec = (deadline % 1000000) * 1000;
+        pthread_mutex_lock(&m_lock);
+        Result result = ITEM;
+        while (m_items.empty()) {
+            if (m_closed) {
+                result = CLOSED;
+                break;
+            }
+            if (!deadline) {
+                pthread_cond_wait(&m_notEmpty, &m_lock);
+            } else if (pthread_cond_timedwait(&m_notEmpty, &m_lock, &until) != 0
+                       && m_items.empty()) {
+                result = TIMEOUT;
+                break;
+            }
+        }
+        if (result == ITEM) {
+            item = m_items.front();
+            m_items.pop_front();
+            pthread_cond_signal(&m_notFull);
+        }
+        pthread_mutex_unlock(&m_lock);
+        return result;
+    }
+
+    /*
+     * Returns the most items the queue has held at once.
+     */
+    size_t highWater()
+    {
+        pthread_mutex_lock(&m_lock);
+        size_t highWater = m_highWater;
+        pthread_mutex_unlock(&m_lock);
+        return highWater;
+    }
+
+private:
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_notEmpty;
+    pthread_cond_t m_notFull;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed;
+    size_t m_highWater;
+};
+
+#endif /*ifmap_boundedqueue_h__*/
@@ -0,0 +1,683 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <sstream>
+#include "call.h"
+#include "pollstream.h"
+#include "ifmapServiceProxy.h"
+
+//
+// These follow the code soapcpp2 generates for soap_call___wsdl__*,
+// split at the point where the request has been sent.
+//
+
+template <class Request>
+static int putEnvelope(struct soap* soap, Request& request,
+                       int (*put)(struct soap*, const Request*, const char*, const char*),
+                       const char* tag)
+{
+    if (soap_envelope_begin_out(soap)
+        || soap_putheader(soap)
+        || soap_body_begin_out(soap)
+        || put(soap, &request, tag, "")
+        || soap_body_end_out(soap)
+        || soap_envelope_end_out(soap)) {
+        return soap->error;
+    }
+    return SOAP_OK;
+}
+
+//
+// Ends a request started with soap_connect(). With buffer set, gSOAP
+// has been writing the request there for a RequestSender rather than
+// to the connection. soap_end_send() shuts down the sending side of a
+// connection that is not kept alive, which must then wait until the
+// request has actually gone out, so the socket is hidden from it.
+//
+static int endSend(struct soap* soap, std::ostream* buffer)
+{
+    if (!buffer) {
+        return soap_end_send(soap);
+    }
+    SOAP_SOCKET socket = soap->socket;
+    soap->socket = SOAP_INVALID_SOCKET;
+    int code = soap_end_send(soap);
+    soap->socket = socket;
+    return code;
+}
+
+//
+// Sends request, or with buffer set, connects and writes the request
+// into buffer instead.
+//
+template <class Request>
+static int sendRequest(Service& service, Request& request,
+                       void (*serialize)(struct soap*, const Request*),
+                       int (*put)(struct soap*, const Request*, const char*, const char*),
+                       const char* tag, std::ostream* buffer = 0)
+{
+    struct soap* soap = service.soap;
+    soap->encodingStyle = NULL;
+    soap_begin(soap);
+    soap_serializeheader(soap);
+    serialize(soap, &request);
+    if (soap_begin_count(soap)) {
+        return soap->error;
+    }
+    if (soap->mode & SOAP_IO_LENGTH) {
+        if (putEnvelope(soap, request, put, tag)) {
+            return soap->error;
+        }
+    }
+    if (soap_end_count(soap)) {
+        return soap->error;
+    }
+    std::ostream* os = soap->os;
+    if (buffer) {
+        soap->os = buffer;
+    }
+    int code = SOAP_OK;
+    if (soap_connect(soap, service.endpoint, "")
+        || putEnvelope(soap, request, put, tag)
+        || endSend(soap, buffer)) {
+        code = soap->error;
+    }
+    soap->os = os;
+    return code == SOAP_OK ? SOAP_OK : soap_closesock(soap);
+}
+
+//
+// Serializes request as sendRequest would, but into xml. The socket is
+// hidden meanwhile so that gSOAP writes only to the string stream.
+//
+template <class Request>
+static int captureRequest(Service& service, Request& request,
+                          void (*serialize)(struct soap*, const Request*),
+                          int (*put)(struct soap*, const Request*, const char*, const char*),
+                          const char* tag, std::string& xml)
+{
+    struct soap* soap = service.soap;
+    std::ostringstream out;
+    std::ostream* os = soap->os;
+    SOAP_SOCKET socket = soap->socket;
+    soap->os = &out;
+    soap->socket = SOAP_INVALID_SOCKET;
+
+    soap->encodingStyle = NULL;
+    soap_begin(soap);
+    soap_serializeheader(soap);
+    serialize(soap, &request);
+    int code = SOAP_OK;
+    if (soap_begin_send(soap)
+        || putEnvelope(soap, request, put, tag)
+        || soap_end_send(soap)) {
+        code = soap->error;
+    }
+
+    soap->os = os;
+    soap->socket = socket;
+    xml = out.str();
+    return code;
+}
+
+template <class Response>
+static int recvResponse(Service& service, Response& response,
+                        void (*setDefault)(struct soap*, Response*),
+                        Response* (*get)(struct soap*, Response*, const char*, const char*),
+                        const char* tag)
+{
+    struct soap* soap = service.soap;
+    setDefault(soap, &response);
+    if (soap_begin_recv(soap)
+        || soap_envelope_begin_in(soap)
+        || soap_recv_header(soap)
+        || soap_body_begin_in(soap)) {
+        return soap_closesock(soap);
+    }
+    get(soap, &response, tag, "");
+    if (soap->error) {
+        if (soap->error == SOAP_TAG_MISMATCH && soap->level == 2) {
+            return soap_recv_fault(soap);
+        }
+        return soap_closesock(soap);
+    }
+    if (soap_body_end_in(soap)
+        || soap_envelope_end_in(soap)
+        || soap_end_recv(soap)) {
+        return soap_closesock(soap);
+    }
+    return soap_closesock(soap);
+}
+
+int ifmapSendPublish(Service& service, ifmap__PublishRequestType* request)
+{
+    struct __wsdl__Publish publish;
+    publish.ifmap__publish = request;
+    return sendRequest(service, publish, soap_serialize___wsdl__Publish,
+                       soap_put___wsdl__Publish, "-wsdl:Publish");
+}
+
+int ifmapCapturePublish(Service& service, ifmap__PublishRequestType* request, std::string& xml)
+{
+    struct __wsdl__Publish publish;
+    publish.ifmap__publish = request;
+    return captureRequest(service, publish, soap_serialize___wsdl__Publish,
+                          soap_put___wsdl__Publish, "-wsdl:Publish", xml);
+}
+
+//
+// Like sendRequest, for a complete SOAP envelope.
+//
+static int sendRaw(Service& service, const char* xml, size_t length, std::ostream* buffer = 0)
+{
+    struct soap* soap = service.soap;
+    soap->encodingStyle = NULL;
+    soap_begin(soap);
+    if (soap_begin_count(soap)) {
+        return soap->error;
+    }
+    if (soap->mode & SOAP_IO_LENGTH) {
+        soap->count = length;
+    }
+    if (soap_end_count(soap)) {
+        return soap->error;
+    }
+    std::ostream* os = soap->os;
+    if (buffer) {
+        soap->os = buffer;
+    }
+    int code = SOAP_OK;
+    if (soap_connect(soap, service.endpoint, "")
+        || soap_send_raw(soap, xml, length)
+        || endSend(soap, buffer)) {
+        code = soap->error;
+    }
+    soap->os = os;
+    return code == SOAP_OK ? SOAP_OK : soap_closesock(soap);
+}
+
+int ifmapSendRaw(Service& service, const char* xml, size_t length)
+{
+    return sendRaw(service, xml, length);
+}
+
+int ifmapRecvPublish(Service& service, struct __wsdl__PublishResponse& response)
+{
+    return recvResponse(service, response, soap_default___wsdl__PublishResponse,
+                        soap_get___wsdl__PublishResponse, "-wsdl:PublishResponse");
+}
+
+int ifmapSendSubscribe(Service& service, ifmap__SubscribeRequestType* request)
+{
+    struct __wsdl__Subscribe subscribe;
+    subscribe.ifmap__subscribe = request;
+    return sendRequest(service, subscribe, soap_serialize___wsdl__Subscribe,
+                       soap_put___wsdl__Subscribe, "-wsdl:Subscribe");
+}
+
+int ifmapRecvSubscribe(Service& service, struct __wsdl__SubscribeResponse& response)
+{
+    return recvResponse(service, response, soap_default___wsdl__SubscribeResponse,
+                        soap_get___wsdl__SubscribeResponse, "-wsdl:SubscribeResponse");
+}
+
+int ifmapCaptureSubscribe(Service& service, ifmap__SubscribeRequestType* request,
+                          std::string& xml)
+{
+    struct __wsdl__Subscribe subscribe;
+    subscribe.ifmap__subscribe = request;
+    return captureRequest(service, subscribe, soap_serialize___wsdl__Subscribe,
+                          soap_put___wsdl__Subscribe, "-wsdl:Subscribe", xml);
+}
+
+int ifmapSendPoll(Service& service, ifmap__PollRequestType* request)
+{
+    struct __wsdl__Poll poll;
+    poll.ifmap__poll = request;
+    return sendRequest(service, poll, soap_serialize___wsdl__Poll,
+                       soap_put___wsdl__Poll, "-wsdl:Poll");
+}
+
+int ifmapRecvPoll(Service& service, struct __wsdl__PollResponse& response)
+{
+    return recvResponse(service, response, soap_default___wsdl__PollResponse,
+                        soap_get___wsdl__PollResponse, "-wsdl:PollResponse");
+}
+
+//
+// Deserializes http, a complete HTTP response, as recvResponse would
+// read it from the connection. The socket is hidden so that gSOAP
+// reads only from the string stream, and so is the TLS session, which
+// closing the socket would free.
+//
+template <class Response>
+static int parseResponse(Service& service, const std::string& http, Response& response,
+                         void (*setDefault)(struct soap*, Response*),
+                         Response* (*get)(struct soap*, Response*, const char*, const char*),
+                         const char* tag)
+{
+    struct soap* soap = service.soap;
+    std::istringstream in(http);
+    std::istream* is = soap->is;
+    SOAP_SOCKET socket = soap->socket;
+    SSL* ssl = soap->ssl;
+    soap->is = &in;
+    soap->socket = SOAP_INVALID_SOCKET;
+    soap->ssl = 0;
+
+    int code = recvResponse(service, response, setDefault, get, tag);
+
+    soap->is = is;
+    soap->socket = socket;
+    soap->ssl = ssl;
+    return code;
+}
+
+int ifmapParsePoll(Service& service, const std::string& http,
+                   struct __wsdl__PollResponse& response)
+{
+    return parseResponse(service, http, response, soap_default___wsdl__PollResponse,
+                         soap_get___wsdl__PollResponse, "-wsdl:PollResponse");
+}
+
+int ifmapRecvPollStream(Service& service, PollStreamParser& parser)
+{
+    struct soap* soap = service.soap;
+    parser.reset();
+    if (soap_begin_recv(soap)) {
+        return soap_closesock(soap);
+    }
+    // soap_begin_recv may have peeked at the first character.
+    if (soap->ahead) {
+        char c = soap->ahead;
+        soap->ahead = 0;
+        parser.feed(&c, 1);
+    }
+    while (!parser.done()) {
+        if (soap->bufidx >= soap->buflen && soap_recv(soap)) {
+            soap->error = SOAP_EOF;
+            return soap_closesock(soap);
+        }
+        soap->bufidx += parser.feed(soap->buf + soap->bufidx, soap->buflen - soap->bufidx);
+    }
+    if (parser.error()) {
+        // Where the next response starts is unknown after an error.
+        soap->keep_alive = 0;
+        soap_closesock(soap);
+        return soap_receiver_fault(soap, parser.error(), 0);
+    }
+    if (soap_end_recv(soap)) {
+        return soap_closesock(soap);
+    }
+    return soap_closesock(soap);
+}
+
+//
+// Writes to a non-blocking connection. Returns the number of bytes
+// written, 0 if the connection cannot take any yet, or -1 on an error.
+// A retried SSL_write() must be given the same data, which callers do
+// by sending from where the last write left off.
+//
+static int sendSome(struct soap* soap, const char* buf, size_t size)
+{
+    if (soap->ssl) {
+        int count = SSL_write(soap->ssl, buf, (int)size);
+        if (count > 0) {
+            return count;
+        }
+        int error = SSL_get_error(soap->ssl, count);
+        return error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE ? 0 : -1;
+    }
+    // A connection closed by the server is an error here, not SIGPIPE.
+    ssize_t count = send(soap->socket, buf, size, MSG_NOSIGNAL);
+    if (count >= 0) {
+        return count;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+}
+
+//
+// Reads from a non-blocking connection. Returns the number of bytes
+// read, 0 if none have arrived yet, or -1 at end of file or on an
+// error.
+//
+static int receiveSome(struct soap* soap, char* buf, int size)
+{
+    if (soap->ssl) {
+        int count = SSL_read(soap->ssl, buf, size);
+        if (count > 0) {
+            return count;
+        }
+        int error = SSL_get_error(soap->ssl, count);
+        return error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE ? 0 : -1;
+    }
+    ssize_t count = recv(soap->socket, buf, size, 0);
+    if (count > 0) {
+        return count;
+    }
+    return count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+}
+
+static void setBlocking(int fd, bool blocking)
+{
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+//
+// Closes the connection, as where the next response would start is
+// unknown, and reports error.
+//
+static int failResponse(struct soap* soap, const char* error, const char* detail = 0)
+{
+    soap->keep_alive = 0;
+    soap_closesock(soap);
+    return soap_receiver_fault(soap, error, detail ? soap_strdup(soap, detail) : 0);
+}
+
+int RequestSender::beginPublish(Service& service, ifmap__PublishRequestType* request)
+{
+    struct __wsdl__Publish publish;
+    publish.ifmap__publish = request;
+    std::ostringstream out;
+    int code = sendRequest(service, publish, soap_serialize___wsdl__Publish,
+                           soap_put___wsdl__Publish, "-wsdl:Publish", &out);
+    return begin(service, code, out.str());
+}
+
+int RequestSender::beginSubscribe(Service& service, ifmap__SubscribeRequestType* request)
+{
+    struct __wsdl__Subscribe subscribe;
+    subscribe.ifmap__subscribe = request;
+    std::ostringstream out;
+    int code = sendRequest(service, subscribe, soap_serialize___wsdl__Subscribe,
+                           soap_put___wsdl__Subscribe, "-wsdl:Subscribe", &out);
+    return begin(service, code, out.str());
+}
+
+int RequestSender::beginRaw(Service& service, const char* xml, size_t length)
+{
+    std::ostringstream out;
+    int code = sendRaw(service, xml, length, &out);
+    return begin(service, code, out.str());
+}
+
+int RequestSender::begin(Service& service, int code, const std::string& request)
+{
+    m_sent = 0;
+    m_request.clear();
+    if (code != SOAP_OK) {
+        return code;
+    }
+    m_request = request;
+    setBlocking(service.soap->socket, false);
+    return SOAP_OK;
+}
+
+int RequestSender::write(Service& service)
+{
+    struct soap* soap = service.soap;
+    while (m_sent < m_request.size()) {
+        int count = sendSome(soap, m_request.data() + m_sent, m_request.size() - m_sent);
+        if (count == 0) {
+            return SOAP_OK;
+        }
+        if (count == -1) {
+            m_sent = m_request.size();
+            soap->keep_alive = 0;
+            soap->error = SOAP_EOF;
+            return soap_closesock(soap);
+        }
+        m_sent += count;
+    }
+    return SOAP_OK;
+}
+
+ResponseReceiver::ResponseReceiver(PollStreamParser* parser)
+    : m_parser(parser), m_state(DONE), m_remaining(0), m_close(false)
+{
+}
+
+void ResponseReceiver::begin(Service& service)
+{
+    m_state = HEADERS;
+    m_input.clear();
+    m_response.clear();
+    m_remaining = 0;
+    m_close = false;
+    if (m_parser) {
+        m_parser->reset();
+    }
+    setBlocking(service.soap->socket, false);
+}
+
+int ResponseReceiver::read(Service& service)
+{
+    struct soap* soap = service.soap;
+    char buf[16384];
+    while (m_state != DONE) {
+        int count = receiveSome(soap, buf, sizeof buf);
+        if (count == 0) {
+            return SOAP_OK;
+        }
+        if (count == -1) {
+            if (m_state != UNTIL_CLOSE) {
+                m_state = DONE;
+                soap->keep_alive = 0;
+                soap->error = SOAP_EOF;
+                return soap_closesock(soap);
+            }
+            return finish(soap);
+        }
+        if (!m_parser) {
+            m_response.append(buf, count);
+        }
+        m_input.append(buf, count);
+        int code = consume(soap);
+        if (code != SOAP_OK) {
+            m_state = DONE;
+            return code;
+        }
+        if (m_state == DONE) {
+            return finish(soap);
+        }
+    }
+    return SOAP_OK;
+}
+
+//
+// Follows the HTTP framing through m_input, passing body bytes on.
+// Only what cannot be used yet, such as part of a header or of a chunk
+// size line, is left there.
+//
+int ResponseReceiver::consume(struct soap* soap)
+{
+    size_t pos = 0;
+    while (m_state != DONE && pos < m_input.size()) {
+        if (m_state == HEADERS) {
+            size_t end = m_input.find("\r\n\r\n", pos);
+            if (end == std::string::npos) {
+                break;
+            }
+            int code = parseHeaders(soap, m_input.substr(pos, end - pos));
+            if (code != SOAP_OK) {
+                return code;
+            }
+            pos = end + 4;
+        } else if (m_state == CHUNK_SIZE || m_state == CHUNK_END || m_state == TRAILER) {
+            size_t end = m_input.find("\r\n", pos);
+            if (end == std::string::npos) {
+                break;
+            }
+            std::string line = m_input.substr(pos, end - pos);
+            pos = end + 2;
+            if (m_state == CHUNK_SIZE) {
+                if (line.empty() || !isxdigit((unsigned char)line[0])) {
+                    return failResponse(soap, "Malformed chunked response");
+                }
+                m_remaining = strtoll(line.c_str(), 0, 16);
+                m_state = m_remaining ? CHUNK_DATA : TRAILER;
+            } else if (m_state == CHUNK_END) {
+                m_state = CHUNK_SIZE;
+            } else if (line.empty()) {
+                m_state = DONE;
+            }
+        } else {
+            size_t length = m_input.size() - pos;
+            if (m_state != UNTIL_CLOSE && (long long)length > m_remaining) {
+                length = m_remaining;
+            }
+            body(m_input.data() + pos, length);
+            pos += length;
+            if (m_state != UNTIL_CLOSE) {
+                m_remaining -= length;
+                if (!m_remaining) {
+                    m_state = m_state == BODY ? DONE : CHUNK_END;
+                }
+            }
+        }
+    }
+    m_input.erase(0, pos);
+    return SOAP_OK;
+}
+
+int ResponseReceiver::parseHeaders(struct soap* soap, const std::string& headers)
+{
+    size_t lineEnd = headers.find("\r\n");
+    std::string statusLine = headers.substr(0, lineEnd);
+    size_t space = statusLine.find(' ');
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || space == std::string::npos) {
+        return failResponse(soap, "Malformed response", statusLine.c_str());
+    }
+    int status = atoi(statusLine.c_str() + space + 1);
+    if (status >= 100 && status < 200) {
+        // An interim response; the real one follows.
+        return SOAP_OK;
+    }
+    // A SOAP fault comes with status 500 and is reported by the parser.
+    if (status != 200 && status != 500) {
+        return failResponse(soap, "HTTP error", statusLine.c_str());
+    }
+
+    m_close = statusLine.compare(0, 8, "HTTP/1.0") == 0;
+    bool chunked = false;
+    bool haveLength = false;
+    while (lineEnd != std::string::npos) {
+        size_t begin = lineEnd + 2;
+        lineEnd = headers.find("\r\n", begin);
+        std::string line = headers.substr(begin, lineEnd == std::string::npos
+                                                 ? std::string::npos : lineEnd - begin);
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        const char* value = line.c_str() + colon + 1;
+        value += strspn(value, " \t");
+        if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+            haveLength = true;
+            m_remaining = strtoll(value, 0, 10);
+        } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+            chunked = strncasecmp(value, "chunked", 7) == 0;
+        } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+            if (strcasecmp(value, "close") == 0) {
+                m_close = true;
+            } else if (strcasecmp(value, "keep-alive") == 0) {
+                m_close = false;
+            }
+        }
+    }
+    if (chunked) {
+        m_state = CHUNK_SIZE;
+    } else if (haveLength) {
+        m_state = m_remaining > 0 ? BODY : DONE;
+    } else {
+        m_state = UNTIL_CLOSE;
+        m_close = true;
+    }
+    return SOAP_OK;
+}
+
+void ResponseReceiver::body(const char* data, size_t length)
+{
+    // Anything after the envelope, such as a trailing newline, is
+    // ignored.
+    if (m_parser && !m_parser->done()) {
+        m_parser->feed(data, length);
+    }
+}
+
+int ResponseReceiver::finish(struct soap* soap)
+{
+    m_state = DONE;
+    if (m_close) {
+        soap->keep_alive = 0;
+        soap_closesock(soap);
+    } else {
+        setBlocking(soap->socket, true);
+    }
+    if (!m_parser) {
+        return SOAP_OK;
+    }
+    if (!m_parser->done()) {
+        return soap_receiver_fault(soap, "Response ended early", 0);
+    }
+    if (m_parser->error()) {
+        return soap_receiver_fault(soap, m_parser->error(), 0);
+    }
+    return SOAP_OK;
+}
+
+int ResponseReceiver::parsePublish(Service& service, struct __wsdl__PublishResponse& response)
+{
+    return parseResponse(service, m_response, response, soap_default___wsdl__PublishResponse,
+                         soap_get___wsdl__PublishResponse, "-wsdl:PublishResponse");
+}
+
+int ResponseReceiver::parseSubscribe(Service& service,
+                                     struct __wsdl__SubscribeResponse& response)
+{
+    return parseResponse(service, m_response, response,
+                         soap_default___wsdl__SubscribeResponse,
+                         soap_get___wsdl__SubscribeResponse, "-wsdl:SubscribeResponse");
+}
+
+int ResponseReceiver::parsePoll(Service& service, struct __wsdl__PollResponse& response)
+{
+    return ifmapParsePoll(service, m_response, response);
+}
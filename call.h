@@ -0,0 +1,195 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_call_h__
+#define ifmap_call_h__
+
+#include <stddef.h>
+#include <string>
+
+class Service;
+class ifmap__PublishRequestType;
+class ifmap__SubscribeRequestType;
+class ifmap__PollRequestType;
+struct __wsdl__PublishResponse;
+struct __wsdl__SubscribeResponse;
+struct __wsdl__PollResponse;
+class PollStreamParser;
+
+/*
+ * Split versions of the Service::__wsdl__* calls.
+ *
+ * ifmapSend* connects to service.endpoint if needed (reusing a
+ * keep-alive connection when possible) and writes the request without
+ * waiting for the response. Once service.soap->socket becomes readable,
+ * the matching ifmapRecv* reads and deserializes the response.
+ *
+ * Only one request may be outstanding on a Service at a time, so
+ * callers wanting several requests in flight must use several
+ * Service objects.
+ *
+ * All functions return SOAP_OK if successful, gSOAP error code
+ * otherwise.
+ */
+extern int ifmapSendPublish(Service& service, ifmap__PublishRequestType* request);
+extern int ifmapRecvPublish(Service& service, struct __wsdl__PublishResponse& response);
+
+/*
+ * ifmapCapturePublish serializes request into xml exactly as
+ * ifmapSendPublish would send it, without touching the connection.
+ * It must not be called while a request is outstanding.
+ *
+ * ifmapSendRaw sends xml, a complete SOAP envelope such as one
+ * produced by ifmapCapturePublish or rendered from an XmlTemplate, in
+ * place of a serialized request. Read the response with the ifmapRecv*
+ * function matching the request.
+ */
+extern int ifmapCapturePublish(Service& service, ifmap__PublishRequestType* request,
+                               std::string& xml);
+extern int ifmapSendRaw(Service& service, const char* xml, size_t length);
+
+extern int ifmapSendSubscribe(Service& service, ifmap__SubscribeRequestType* request);
+extern int ifmapRecvSubscribe(Service& service, struct __wsdl__SubscribeResponse& response);
+
+/*
+ * Like ifmapCapturePublish, for a subscribe request.
+ */
+extern int ifmapCaptureSubscribe(Service& service, ifmap__SubscribeRequestType* request,
+                                 std::string& xml);
+
+extern int ifmapSendPoll(Service& service, ifmap__PollRequestType* request);
+extern int ifmapRecvPoll(Service& service, struct __wsdl__PollResponse& response);
+
+/*
+ * Deserializes http, a complete HTTP response to a poll request, as
+ * ifmapRecvPoll would read it from the connection. It must not be
+ * called while a request is outstanding.
+ */
+extern int ifmapParsePoll(Service& service, const std::string& http,
+                          struct __wsdl__PollResponse& response);
+
+/*
+ * Reads a poll response like ifmapRecvPoll, but hands it to parser as
+ * it arrives instead of deserializing all of it. A SOAP fault or
+ * malformed response is reported as a gSOAP fault.
+ */
+extern int ifmapRecvPollStream(Service& service, PollStreamParser& parser);
+
+/*
+ * Writes a publish or subscribe request like ifmapSend*, for event
+ * loops that must not wait on the connection. begin*() connects to
+ * service.endpoint if needed, which still blocks, and serializes the
+ * request into a buffer, leaving the connection non-blocking. Then
+ * call write() each time service.soap->socket is writable until done()
+ * is true, and read the response with a ResponseReceiver.
+ */
+class RequestSender
+{
+public:
+    RequestSender() : m_sent(0) {}
+
+    int beginPublish(Service& service, ifmap__PublishRequestType* request);
+    int beginSubscribe(Service& service, ifmap__SubscribeRequestType* request);
+
+    /*
+     * Like ifmapSendRaw, for a complete SOAP envelope.
+     */
+    int beginRaw(Service& service, const char* xml, size_t length);
+
+    /*
+     * Writes as much of the request as the connection takes without
+     * waiting. If the connection fails, it is closed and SOAP_EOF
+     * returned, as gSOAP does.
+     */
+    int write(Service& service);
+
+    bool done() const { return m_sent == m_request.size(); }
+
+private:
+    int begin(Service& service, int code, const std::string& request);
+
+    std::string m_request;
+    size_t m_sent;
+};
+
+/*
+ * Reads the response to a request sent with ifmapSend* or a
+ * RequestSender in whatever pieces it arrives, for event loops that
+ * must not wait on the connection. With a parser, the HTTP body of a
+ * poll response is handed to it as it arrives; without one, the
+ * response is kept until it is complete and then deserialized with
+ * the parse*() function matching the request.
+ *
+ * Call begin() once the request has been sent, which makes the
+ * connection non-blocking until the response has been read, then
+ * read() each time service.soap->socket is readable until done() is
+ * true.
+ */
+class ResponseReceiver
+{
+public:
+    ResponseReceiver(PollStreamParser* parser = 0);
+
+    void begin(Service& service);
+
+    /*
+     * Reads whatever has arrived without waiting. A SOAP fault or
+     * malformed response is reported as a gSOAP fault, after which
+     * the connection is closed.
+     */
+    int read(Service& service);
+
+    bool done() const { return m_state == DONE; }
+
+    /*
+     * Deserialize a complete response read without a parser.
+     */
+    int parsePublish(Service& service, struct __wsdl__PublishResponse& response);
+    int parseSubscribe(Service& service, struct __wsdl__SubscribeResponse& response);
+    int parsePoll(Service& service, struct __wsdl__PollResponse& response);
+
+private:
+    enum State { HEADERS, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER, UNTIL_CLOSE, DONE };
+
+    int consume(struct soap* soap);
+    int parseHeaders(struct soap* soap, const std::string& headers);
+    void body(const char* data, size_t length);
+    int finish(struct soap* soap);
+
+    PollStreamParser* m_parser;
+    State m_state;
+    std::string m_input;
+    std::string m_response;
+    long long m_remaining;
+    bool m_close;
+};
+
+#endif /*ifmap_call_h__*/
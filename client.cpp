@@ -0,0 +1,325 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "client.h"
+#include <string.h>
+#include <unistd.h>
+#include "connect.h"
+#include "call.h"
+
+IfmapClient::IfmapClient(const char* url, const char* user, const char* password)
+    : m_url(url), m_user(user ? user : ""), m_password(password ? password : ""),
+      m_savedSession(false), m_state(0), m_errorCode(-1)
+{
+    m_service.endpoint = m_url.c_str();
+    if (user && password) {
+        m_service.soap->userid = m_user.c_str();
+        m_service.soap->passwd = m_password.c_str();
+    }
+    bzero(&m_header, sizeof m_header);
+}
+
+IfmapClient* IfmapClient::clone() const
+{
+    IfmapClient* client = new IfmapClient(m_url.c_str());
+    client->m_user = m_user;
+    client->m_password = m_password;
+    if (m_service.soap->userid) {
+        client->m_service.soap->userid = client->m_user.c_str();
+        client->m_service.soap->passwd = client->m_password.c_str();
+    }
+    client->m_service.soap->imode = m_service.soap->imode;
+    client->m_service.soap->omode = m_service.soap->omode;
+    return client;
+}
+
+int IfmapClient::newSession()
+{
+    int code = saveSession(ifmapConnect(m_service), 0);
+    if (code == SOAP_OK && m_state) {
+        m_state->reset(true);
+    }
+    return code;
+}
+
+int IfmapClient::attach(const char* sessionId)
+{
+    int code = saveSession(ifmapAttach(m_service, sessionId), sessionId);
+    if (code == SOAP_OK && m_state) {
+        // Whatever was published on the session before is unknown.
+        m_state->reset(false);
+    }
+    return code;
+}
+
+int IfmapClient::openSession(const char* sessionFile)
+{
+    m_sessionFile = sessionFile;
+    m_savedSession = false;
+    FILE* file = fopen(sessionFile, "r");
+    if (file) {
+        char line[1024];
+        if (fgets(line, sizeof line, file)) {
+            char* sessionId = strtok(line, " \n");
+            char* publisherId = strtok(0, " \n");
+            if (sessionId && publisherId && attach(sessionId) == SOAP_OK) {
+                // AttachSession responses need not carry a publisher ID.
+                if (m_publisherId.empty()) {
+                    m_publisherId = publisherId;
+                }
+                m_savedSession = true;
+            }
+        }
+        fclose(file);
+        if (m_savedSession) {
+            return SOAP_OK;
+        }
+    }
+    return replaceSession();
+}
+
+int IfmapClient::replaceSession()
+{
+    m_savedSession = false;
+    int code = newSession();
+    if (code == SOAP_OK) {
+        writeSessionFile(m_sessionFile.c_str());
+    }
+    return code;
+}
+
+//
+// Writes a temporary file and renames it over sessionFile, so that
+// processes reading the file concurrently never see a partial one.
+// Failing to save is reported but not fatal: the next process just
+// starts its own session.
+//
+bool IfmapClient::writeSessionFile(const char* sessionFile)
+{
+    std::string tempPath = std::string(sessionFile) + ".XXXXXX";
+    int fd = mkstemp(&tempPath[0]);
+    FILE* file = fd == -1 ? 0 : fdopen(fd, "w");
+    bool ok = file
+        && fprintf(file, "%s %s\n", m_sessionId.c_str(), m_publisherId.c_str()) > 0;
+    if (file && fclose(file) != 0) {
+        ok = false;
+    } else if (!file && fd != -1) {
+        close(fd);
+    }
+    if (ok && rename(tempPath.c_str(), sessionFile) == 0) {
+        return true;
+    }
+    perror(sessionFile);
+    if (fd != -1) {
+        unlink(tempPath.c_str());
+    }
+    return false;
+}
+
+//
+// Remembers the session and publisher IDs from the response header
+// after connecting.
+//
+int IfmapClient::saveSession(int code, const char* sessionId)
+{
+    if (code != SOAP_OK) {
+        return code;
+    }
+    SOAP_ENV__Header* header = m_service.soap->header;
+    if (header && header->ifmap__session_id) {
+        m_sessionId = header->ifmap__session_id;
+    } else if (sessionId) {
+        m_sessionId = sessionId;
+    }
+    if (header && header->ifmap__publisher_id) {
+        m_publisherId = header->ifmap__publisher_id;
+    }
+    reset();
+    return SOAP_OK;
+}
+
+const char* IfmapClient::faultString()
+{
+    soap_set_fault(m_service.soap);
+    const char** faultString = soap_faultstring(m_service.soap);
+    return faultString && *faultString ? *faultString : "unknown error";
+}
+
+void IfmapClient::reset()
+{
+    soap_destroy(m_service.soap);
+    soap_end(m_service.soap);
+    service();
+}
+
+Service& IfmapClient::service()
+{
+    // Each response header replaces soap->header, and is freed by
+    // reset(), so requests always go out with the client's own.
+    bzero(&m_header, sizeof m_header);
+    m_errorCode = -1;
+    m_header.ifmap__session_id = const_cast<char*>(m_sessionId.c_str());
+    m_service.soap->header = &m_header;
+    return m_service;
+}
+
+int IfmapClient::checkResponse(ifmap__ResponseType* response, int expected)
+{
+    if (!response || response->__union_ResponseType == expected) {
+        return SOAP_OK;
+    }
+    if (response->__union_ResponseType == SOAP_UNION__ifmap__union_ResponseType_errorResult
+        && response->union_ResponseType.errorResult) {
+        const char* errorString = response->union_ResponseType.errorResult->errorString;
+        m_errorCode = response->union_ResponseType.errorResult->errorCode;
+        return soap_receiver_fault(m_service.soap, errorString ? errorString : "errorResult", 0);
+    }
+    return soap_receiver_fault(m_service.soap, "Unexpected response type", 0);
+}
+
+//
+// IF-MAP 1.0 has no errorResult for an unknown session, so servers
+// reject one with a plain SOAP fault blaming the client. Faults made up
+// here, such as for an errorResult or an unexpected response, blame the
+// server.
+//
+bool IfmapClient::sessionRejected(int code)
+{
+    if (code != SOAP_FAULT) {
+        return false;
+    }
+    const char** faultCode = soap_faultcode(m_service.soap);
+    if (!faultCode || !*faultCode) {
+        return false;
+    }
+    const char* name = strrchr(*faultCode, ':');
+    name = name ? name + 1 : *faultCode;
+    return strcmp(name, "Client") == 0 || strcmp(name, "Sender") == 0;
+}
+
+int IfmapClient::publish(ifmap__PublishRequestType* request)
+{
+    struct __wsdl__PublishResponse response;
+    bzero(&response, sizeof response);
+    int code = service().__wsdl__Publish(request, response);
+    if (code == SOAP_OK) {
+        code = checkResponse(response.ifmap__response,
+                             SOAP_UNION__ifmap__union_ResponseType_publishReceived);
+    }
+    if (m_savedSession && sessionRejected(code)) {
+        // The saved session may have expired since it was saved.
+        code = replaceSession();
+        if (code == SOAP_OK) {
+            return publish(request);
+        }
+    }
+    return code;
+}
+
+int IfmapClient::subscribe(ifmap__SubscribeRequestType* request)
+{
+    struct __wsdl__SubscribeResponse response;
+    bzero(&response, sizeof response);
+    int code = service().__wsdl__Subscribe(request, response);
+    if (code != SOAP_OK) {
+        return code;
+    }
+    return checkResponse(response.ifmap__response,
+                         SOAP_UNION__ifmap__union_ResponseType_subscribeReceived);
+}
+
+int IfmapClient::sendSubscribe(ifmap__SubscribeRequestType* request)
+{
+    return ifmapSendSubscribe(service(), request);
+}
+
+int IfmapClient::recvSubscribe()
+{
+    struct __wsdl__SubscribeResponse response;
+    bzero(&response, sizeof response);
+    int code = ifmapRecvSubscribe(m_service, response);
+    if (code != SOAP_OK) {
+        return code;
+    }
+    return checkResponse(response.ifmap__response,
+                         SOAP_UNION__ifmap__union_ResponseType_subscribeReceived);
+}
+
+int IfmapClient::poll(ifmap__PollResultType*& result)
+{
+    result = 0;
+    ifmap__PollRequestType request;
+    struct __wsdl__PollResponse response;
+    bzero(&response, sizeof response);
+    int code = service().__wsdl__Poll(&request, response);
+    if (code == SOAP_OK) {
+        code = checkResponse(response.ifmap__response,
+                             SOAP_UNION__ifmap__union_ResponseType_pollResult);
+    }
+    if (code == SOAP_OK && response.ifmap__response) {
+        result = response.ifmap__response->union_ResponseType.pollResult;
+    }
+    return code;
+}
+
+int IfmapClient::search(ifmap__SearchRequestType* request, ifmap__SearchResultType*& result)
+{
+    result = 0;
+    struct __wsdl__SearchResponse response;
+    bzero(&response, sizeof response);
+    int code = service().__wsdl__Search(request, response);
+    if (code == SOAP_OK) {
+        code = checkResponse(response.ifmap__response,
+                             SOAP_UNION__ifmap__union_ResponseType_searchResult);
+    }
+    if (code == SOAP_OK && response.ifmap__response) {
+        result = response.ifmap__response->union_ResponseType.searchResult;
+    }
+    return code;
+}
+
+int IfmapClient::purgePublisher(const char* publisherId)
+{
+    ifmap__PurgePublisherRequestType request;
+    request.soap = m_service.soap;
+    request.publisher_id = const_cast<char*>(publisherId ? publisherId : m_publisherId.c_str());
+    struct __wsdl__PurgePublisherResponse response;
+    bzero(&response, sizeof response);
+    int code = service().__wsdl__PurgePublisher(&request, response);
+    if (code == SOAP_OK) {
+        code = checkResponse(response.ifmap__response,
+                             SOAP_UNION__ifmap__union_ResponseType_purgePublisherReceived);
+    }
+    if (code == SOAP_OK && m_state && m_publisherId == request.publisher_id) {
+        m_state->reset(true);
+    }
+    return code;
+}
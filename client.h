@@ -0,0 +1,165 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_client_h__
+#define ifmap_client_h__
+
+#include <stdio.h>
+#include <string>
+#include "ifmapServiceProxy.h"
+#include "statecache.h"
+
+/*
+ * One connection to an IF-MAP server, and the session it belongs to.
+ *
+ * A client is not thread safe, but clients are independent of each
+ * other apart from sharing the process-wide SSL context (see
+ * connect.h), so threads may each use their own. clone() makes a
+ * client for another thread; attach() it to share a session.
+ *
+ * Results returned by the request functions live in the client's soap
+ * context until reset() is called. Call reset() after each request
+ * once its results are no longer needed, or memory grows with every
+ * request.
+ *
+ * All functions returning int return SOAP_OK if successful, gSOAP
+ * error code otherwise. An errorResult from the server is reported
+ * as a SOAP fault holding its errorString; printFault() shows it.
+ */
+class IfmapClient
+{
+public:
+    IfmapClient(const char* url, const char* user = 0, const char* password = 0);
+
+    /*
+     * Returns a new client for the same server and credentials. It
+     * has its own connection and no session yet.
+     */
+    IfmapClient* clone() const;
+
+    int newSession();
+    int attach(const char* sessionId);
+
+    /*
+     * Attaches to the session saved in sessionFile by an earlier
+     * process, saving a new session there instead if the file does
+     * not exist or the server rejects its session. savedSession()
+     * tells which happened.
+     *
+     * If the server rejects a session from the file in a publish, as
+     * it may have expired since, publish() replaces the session once
+     * and retries. Other errors are returned as they are.
+     */
+    int openSession(const char* sessionFile);
+
+    bool savedSession() const { return m_savedSession; }
+
+    int publish(ifmap__PublishRequestType* request);
+    int subscribe(ifmap__SubscribeRequestType* request);
+
+    /*
+     * subscribe() in two halves for event loops: sendSubscribe()
+     * writes the request, and recvSubscribe() reads the response once
+     * soap()->socket is readable.
+     */
+    int sendSubscribe(ifmap__SubscribeRequestType* request);
+    int recvSubscribe();
+    int poll(ifmap__PollResultType*& result);
+    int search(ifmap__SearchRequestType* request, ifmap__SearchResultType*& result);
+
+    /*
+     * Purges the metadata published by publisherId, by default this
+     * client's.
+     */
+    int purgePublisher(const char* publisherId = 0);
+
+    /*
+     * Keeps state reset as the session changes or is purged, see
+     * statecache.h. Callers consult and update it around publishes.
+     */
+    void setStateCache(StateCache* state) { m_state = state; }
+    StateCache* stateCache() { return m_state; }
+
+    /*
+     * Frees all request and response data, keeping the connection and
+     * session.
+     */
+    void reset();
+
+    void printFault(FILE* out) { soap_print_fault(m_service.soap, out); }
+
+    /*
+     * Returns the one line description of the last error.
+     */
+    const char* faultString();
+
+    /*
+     * If the last request failed with an errorResult, returns its
+     * errorCode, such as
+     * _ifmap__ErrorResultType_errorCode__InvalidMetadata, until the
+     * next request or reset(); otherwise -1.
+     */
+    int errorCode() const { return m_errorCode; }
+
+    const char* sessionId() const { return m_sessionId.c_str(); }
+    const char* publisherId() const { return m_publisherId.c_str(); }
+
+    /*
+     * The underlying proxy, for the split calls in call.h. Its header
+     * is set up for this client's session.
+     */
+    Service& service();
+    struct soap* soap() { return m_service.soap; }
+
+private:
+    IfmapClient(const IfmapClient&);
+    IfmapClient& operator=(const IfmapClient&);
+
+    int replaceSession();
+    bool sessionRejected(int code);
+    int saveSession(int code, const char* sessionId);
+    bool writeSessionFile(const char* sessionFile);
+    int checkResponse(ifmap__ResponseType* response, int expected);
+
+    Service m_service;
+    SOAP_ENV__Header m_header;
+    std::string m_url;
+    std::string m_user;
+    std::string m_password;
+    std::string m_sessionId;
+    std::string m_publisherId;
+    std::string m_sessionFile;
+    bool m_savedSession;
+    StateCache* m_state;
+    int m_errorCode;
+};
+
+#endif /*ifmap_client_h__*/
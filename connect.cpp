@@ -31,16 +31,88 @@
 
 #include "connect.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <openssl/crypto.h>
+#include <openssl/ssl.h>
 #include "ifmapServiceProxy.h"
 
+static pthread_once_t g_sslOnce = PTHREAD_ONCE_INIT;
+static pthread_once_t g_sslLockOnce = PTHREAD_ONCE_INIT;
+static SSL_CTX* g_sslContext = 0;
+static pthread_mutex_t* g_sslLocks = 0;
+
+//
+// OpenSSL needs locking callbacks before it can be used from several
+// threads at once.
+//
+static void sslLockingCallback(int mode, int n, const char*, int)
+{
+    if (mode & CRYPTO_LOCK) {
+        pthread_mutex_lock(&g_sslLocks[n]);
+    } else {
+        pthread_mutex_unlock(&g_sslLocks[n]);
+    }
+}
+
+static unsigned long sslIdCallback()
+{
+    return (unsigned long)pthread_self();
+}
+
+static void createSslLocks()
+{
+    g_sslLocks = (pthread_mutex_t*)malloc(CRYPTO_num_locks() * sizeof(pthread_mutex_t));
+    for (int ii = 0; ii < CRYPTO_num_locks(); ii++) {
+        pthread_mutex_init(&g_sslLocks[ii], 0);
+    }
+    CRYPTO_set_id_callback(sslIdCallback);
+    CRYPTO_set_locking_callback(sslLockingCallback);
+}
+
+void ifmapInitSslLocking()
+{
+    pthread_once(&g_sslLockOnce, createSslLocks);
+}
+
+static void createSslContext()
+{
+    ifmapInitSslLocking();
+
+    // Let gSOAP set the context up as it always has, then keep it.
+    struct soap soap;
+    if (soap_ssl_client_context(&soap, SOAP_SSL_NO_AUTHENTICATION, 0, 0, 0, 0, 0) == SOAP_OK) {
+        g_sslContext = soap.ctx;
+        soap.ctx = 0;
+    }
+}
+
+static int useSharedSslContext(struct soap* soap)
+{
+    pthread_once(&g_sslOnce, createSslContext);
+    if (!g_sslContext) {
+        return soap_ssl_client_context(soap, SOAP_SSL_NO_AUTHENTICATION, 0, 0, 0, 0, 0);
+    }
+    if (soap->ctx == g_sslContext) {
+        return SOAP_OK;
+    }
+    // soap_done() frees the context, so each soap holds a reference.
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    SSL_CTX_up_ref(g_sslContext);
+#else
+    CRYPTO_add(&g_sslContext->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+    soap->ctx = g_sslContext;
+    soap->ssl_flags = SOAP_SSL_NO_AUTHENTICATION;
+    return SOAP_OK;
+}
+
 int ifmapConnect(Service& service)
 {
     service.soap->imode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE;
     service.soap->omode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE;
 
-    int code = soap_ssl_client_context(service.soap,
-                                       SOAP_SSL_NO_AUTHENTICATION,
-                                       0, 0, 0, 0, 0);
+    int code = useSharedSslContext(service.soap);
     if (code != SOAP_OK) {
         return code;
     }
@@ -54,3 +126,23 @@ int ifmapConnect(Service& service)
     bzero(&response, sizeof response);
     return service.__wsdl__NewSession("", response);
 }
+
+int ifmapAttach(Service& service, const char* sessionId)
+{
+    service.soap->imode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE;
+    service.soap->omode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE;
+
+    int code = useSharedSslContext(service.soap);
+    if (code != SOAP_OK) {
+        return code;
+    }
+
+    service.soap->header = soap_new_SOAP_ENV__Header(service.soap, -1);
+    service.soap->header->ifmap__new_session = 0;
+    service.soap->header->ifmap__attach_session = soap_strdup(service.soap, sessionId);
+    service.soap->header->ifmap__session_id = 0;
+    service.soap->header->ifmap__publisher_id = 0;
+    struct __wsdl__AttachSessionResponse response;
+    bzero(&response, sizeof response);
+    return service.__wsdl__AttachSession("", response);
+}
@@ -51,4 +51,26 @@ class Service;
  */
 extern int ifmapConnect(Service& service);
 
+/*
+ * Connect to IF-MAP server at service.soap.endpoint and attach to an
+ * existing session, typically one created by ifmapConnect() on
+ * another connection.
+ *
+ * Returns SOAP_OK if successful, gSOAP error code otherwise.
+ */
+extern int ifmapAttach(Service& service, const char* sessionId);
+
+/*
+ * Both functions above set up TLS with one SSL context shared by all
+ * connections in the process, created on first use along with the
+ * locking OpenSSL needs to be used from several threads.
+ */
+
+/*
+ * Sets up that locking for programs using TLS from several threads
+ * without the functions above, such as servers. May be called more
+ * than once.
+ */
+extern void ifmapInitSslLocking();
+
 #endif /*ifmap_connect_h__*/
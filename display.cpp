@@ -0,0 +1,179 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "display.h"
+#include "pollstream.h"
+#include "ifmapH.h"
+
+static void appendLine(std::vector<std::string>& lines, const char* format, ...)
+{
+    char buf[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof buf, format, args);
+    va_end(args);
+    lines.push_back(buf);
+}
+
+bool formatMetadata(struct soap_dom_element& elem, std::vector<std::string>& lines)
+{
+    switch (elem.type) {
+    case SOAP_TYPE__meta__capability:
+        {
+            _meta__capability* cap = (_meta__capability*)elem.node;
+            appendLine(lines, "Capability: %s", cap->name);
+            return true;
+        }
+    case SOAP_TYPE__meta__event:
+        {
+            _meta__event* event = (_meta__event*)elem.node;
+            appendLine(lines, "Event: %s", event->name);
+            return true;
+        }
+    }
+    return false;
+}
+
+void displayMetadata(struct soap_dom_element& elem)
+{
+    std::vector<std::string> lines;
+    if (formatMetadata(elem, lines)) {
+        printf("%s\n", lines[0].c_str());
+    }
+}
+
+void formatSearchResult(ifmap__SearchResultType& result, std::vector<std::string>& lines)
+{
+    int ii;
+    for (ii = 0; ii < result.__sizeidentifierResult; ii++) {
+        // Look for IP address and identity identifiers
+        // Look for access-request identifier, and get capabilities
+        ifmap__IdentifierType* ident = result.identifierResult[ii]->identifier;
+        switch (ident->__union_IdentifierType) {
+        case SOAP_UNION__ifmap__union_IdentifierType_access_request:
+            break;
+        case SOAP_UNION__ifmap__union_IdentifierType_identity:
+            appendLine(lines, "userName: %s", ident->union_IdentifierType.identity->name);
+            break;
+        case SOAP_UNION__ifmap__union_IdentifierType_ip_address:
+            appendLine(lines, "IP Address: %s", ident->union_IdentifierType.ip_address->value);
+            break;
+        case SOAP_UNION__ifmap__union_IdentifierType_mac_address:
+            appendLine(lines, "MAC Address: %s", ident->union_IdentifierType.mac_address->value);
+            break;
+        case SOAP_UNION__ifmap__union_IdentifierType_device:
+            if (ident->union_IdentifierType.device->__union_DeviceType == SOAP_UNION__ifmap__union_DeviceType_aik_name) {
+                appendLine(lines, "AIK Device: %s", ident->union_IdentifierType.device->union_DeviceType.aik_name);
+            } else if (ident->union_IdentifierType.device->__union_DeviceType == SOAP_UNION__ifmap__union_DeviceType_name) {
+                appendLine(lines, "Device: %s", ident->union_IdentifierType.device->union_DeviceType.aik_name);
+            }
+            break;
+        }
+        ifmap__MetadataListType* md = result.identifierResult[ii]->metadata;
+        if (!md) {
+            continue;
+        }
+        for (int jj = 0; jj < md->__size; jj++) {
+            formatMetadata(*(md->__any + jj), lines);
+        }
+    }
+    for (ii = 0; ii < result.__sizelinkResult; ii++) {
+        ifmap__MetadataListType* md = result.linkResult[ii]->metadata;
+        if (!md) {
+            continue;
+        }
+        for (int jj = 0; jj < md->__size; jj++) {
+            formatMetadata(*(md->__any + jj), lines);
+        }
+    }
+}
+
+void displaySearchResult(ifmap__SearchResultType& result)
+{
+    printf("\n\nSearch result for %s\n", result.name);
+    std::vector<std::string> lines;
+    formatSearchResult(result, lines);
+    for (size_t ii = 0; ii < lines.size(); ii++) {
+        printf("%s\n", lines[ii].c_str());
+    }
+}
+
+static const char* attributeOrEmpty(const XmlNode* node, const char* name)
+{
+    const char* value = node->attribute(name);
+    return value ? value : "";
+}
+
+static void displayStreamMetadata(const XmlNode* metadata)
+{
+    if (!metadata) {
+        return;
+    }
+    size_t ii;
+    for (ii = 0; ii < metadata->children.size(); ii++) {
+        const XmlNode* elem = metadata->children[ii];
+        const XmlNode* name = elem->child("name");
+        if (elem->name == "capability") {
+            printf("Capability: %s\n", name ? name->text.c_str() : "");
+        } else if (elem->name == "event") {
+            printf("Event: %s\n", name ? name->text.c_str() : "");
+        }
+    }
+}
+
+void displayIdentifierResult(const XmlNode& result)
+{
+    const XmlNode* identifier = result.child("identifier");
+    if (identifier && !identifier->children.empty()) {
+        const XmlNode* ident = identifier->children[0];
+        if (ident->name == "identity") {
+            printf("userName: %s\n", attributeOrEmpty(ident, "name"));
+        } else if (ident->name == "ip-address") {
+            printf("IP Address: %s\n", attributeOrEmpty(ident, "value"));
+        } else if (ident->name == "mac-address") {
+            printf("MAC Address: %s\n", attributeOrEmpty(ident, "value"));
+        } else if (ident->name == "device") {
+            if (ident->child("aik-name")) {
+                printf("AIK Device: %s\n", ident->child("aik-name")->text.c_str());
+            } else if (ident->child("name")) {
+                printf("Device: %s\n", ident->child("name")->text.c_str());
+            }
+        }
+    }
+    displayStreamMetadata(result.child("metadata"));
+}
+
+void displayLinkResult(const XmlNode& result)
+{
+    displayStreamMetadata(result.child("metadata"));
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_display_h__
+#define ifmap_display_h__
+
+#include <string>
+#include <vector>
+
+struct soap_dom_element;
+class ifmap__SearchResultType;
+class XmlNode;
+
+/*
+ * Print the identifiers and metadata of search and poll results to
+ * stdout, one item per line. Only the metadata types the sample
+ * clients publish are shown.
+ *
+ * displaySearchResult() takes a result deserialized with
+ * SOAP_DOM_NODE; the others take results from PollStreamParser.
+ */
+extern void displayMetadata(struct soap_dom_element& elem);
+extern void displaySearchResult(ifmap__SearchResultType& result);
+extern void displayIdentifierResult(const XmlNode& result);
+extern void displayLinkResult(const XmlNode& result);
+
+/*
+ * Appends the lines displaySearchResult() prints after its heading to
+ * lines, without their newlines. Returns false, having appended
+ * nothing, for metadata displayMetadata() does not show.
+ */
+extern bool formatMetadata(struct soap_dom_element& elem, std::vector<std::string>& lines);
+extern void formatSearchResult(ifmap__SearchResultType& result, std::vector<std::string>& lines);
+
+#endif /*ifmap_display_h__*/
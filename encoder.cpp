@@ -0,0 +1,159 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "encoder.h"
+
+static const char FIELD_PREFIX[] = "@@ifmap-field-";
+static const char FIELD_SUFFIX[] = "@@";
+
+XmlTemplate::XmlTemplate()
+    : m_numFields(0), m_utf8(false)
+{
+}
+
+std::string XmlTemplate::field(int ii)
+{
+    char buf[50];
+    snprintf(buf, sizeof buf, "%s%d%s", FIELD_PREFIX, ii, FIELD_SUFFIX);
+    return buf;
+}
+
+bool XmlTemplate::compile(const std::string& xml, int numFields, bool utf8)
+{
+    m_segments.clear();
+    m_numFields = numFields;
+    m_utf8 = utf8;
+
+    std::vector<bool> seen(numFields);
+    size_t pos = 0;
+    while (true) {
+        Segment segment;
+        size_t start = xml.find(FIELD_PREFIX, pos);
+        if (start == std::string::npos) {
+            segment.text = xml.substr(pos);
+            segment.field = -1;
+            segment.attribute = false;
+            m_segments.push_back(segment);
+            break;
+        }
+        size_t digits = start + sizeof FIELD_PREFIX - 1;
+        size_t end = xml.find(FIELD_SUFFIX, digits);
+        if (end == std::string::npos) {
+            break;
+        }
+        int ii = atoi(xml.c_str() + digits);
+        if (ii < 0 || ii >= numFields) {
+            break;
+        }
+        seen[ii] = true;
+
+        // Inside a tag if the last '<' comes after the last '>'.
+        size_t lt = xml.rfind('<', start);
+        size_t gt = xml.rfind('>', start);
+        segment.text = xml.substr(pos, start - pos);
+        segment.field = ii;
+        segment.attribute = lt != std::string::npos && (gt == std::string::npos || lt > gt);
+        m_segments.push_back(segment);
+        pos = end + sizeof FIELD_SUFFIX - 1;
+    }
+
+    bool ok = !m_segments.empty() && m_segments.back().field == -1;
+    int ii;
+    for (ii = 0; ii < numFields; ii++) {
+        ok = ok && seen[ii];
+    }
+    if (!ok) {
+        m_segments.clear();
+    }
+    return ok;
+}
+
+void XmlTemplate::render(const char* const* values, std::string& out) const
+{
+    out.clear();
+    int ii;
+    for (ii = 0; ii < m_segments.size(); ii++) {
+        const Segment& segment = m_segments[ii];
+        out += segment.text;
+        if (segment.field >= 0) {
+            escape(values[segment.field], segment.attribute, out);
+        }
+    }
+}
+
+//
+// Mirrors soap_string_out() outside canonical XML mode.
+//
+void XmlTemplate::escape(const char* value, bool attribute, std::string& out) const
+{
+    if (!value) {
+        return;
+    }
+    const char* p;
+    for (p = value; *p; p++) {
+        unsigned char c = *p;
+        switch (c) {
+        case 0x09:
+            out += attribute ? "&#x9;" : "\t";
+            break;
+        case 0x0A:
+            out += "&#xA;";
+            break;
+        case 0x0D:
+            out += "&#xD;";
+            break;
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += attribute ? ">" : "&gt;";
+            break;
+        case '"':
+            out += attribute ? "&quot;" : "\"";
+            break;
+        default:
+            if ((c & 0x80) && !m_utf8) {
+                char buf[20];
+                snprintf(buf, sizeof buf, "&#%u;", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+            break;
+        }
+    }
+}
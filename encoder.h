@@ -0,0 +1,92 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_encoder_h__
+#define ifmap_encoder_h__
+
+#include <string>
+#include <vector>
+
+/*
+ * XML text with holes for string fields, compiled from the output of
+ * gSOAP for a prototype request whose string fields were set to
+ * field(0), field(1), ... Rendering the template with real values
+ * gives the same bytes gSOAP would produce for a request of the same
+ * shape holding those values, without building or serializing any
+ * objects.
+ *
+ * Values are escaped the way soap_string_out() escapes them, as
+ * attribute values or element content depending on where the field
+ * appeared in the prototype. A field may appear any number of times.
+ */
+class XmlTemplate
+{
+public:
+    XmlTemplate();
+
+    /*
+     * Returns the placeholder for field ii.
+     */
+    static std::string field(int ii);
+
+    /*
+     * Compiles xml, which must contain the placeholders of fields 0
+     * to numFields - 1 and no others. utf8 tells whether the
+     * prototype was serialized with SOAP_C_UTFSTRING. Returns false
+     * if a field is missing.
+     */
+    bool compile(const std::string& xml, int numFields, bool utf8);
+
+    bool empty() const { return m_segments.empty(); }
+    int numFields() const { return m_numFields; }
+
+    /*
+     * Replaces out with the template filled in with values, which must
+     * hold numFields() strings.
+     */
+    void render(const char* const* values, std::string& out) const;
+
+private:
+    struct Segment
+    {
+        std::string text;
+        int field;              // field that follows text, -1 if none
+        bool attribute;
+    };
+
+    void escape(const char* value, bool attribute, std::string& out) const;
+
+    std::vector<Segment> m_segments;
+    int m_numFields;
+    bool m_utf8;
+};
+
+#endif /*ifmap_encoder_h__*/
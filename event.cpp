@@ -33,42 +33,384 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 #include "ifmap.nsmap"
-#include "ifmapServiceProxy.h"
-#include "connect.h"
+#include "client.h"
+#include "tlscache.h"
+#include "metacache.h"
+#include "histogram.h"
+#include "boundedqueue.h"
+#include "eventspec.h"
+#include "publishbatch.h"
+#include "publisherd.h"
 
 static void usage()
 {
-    fprintf(stderr, "usage: event update if-map-server-url ip name [ -d time ] [ -m magnitude ]\n"
-                    "             [ -c confidence ] [ -s significance ] [ -t type ]\n"
+    fprintf(stderr, "usage: event [ --tls-cache file ] [ --session-file file ]\n"
+                    "             update if-map-server-url ip name\n"
+                    "             [ -d time ] [ -m magnitude ] [ -c confidence ]\n"
+                    "             [ -s significance ] [ -t type ]\n"
                     "             [ -o other ] [ -i information ] [ -v vulnerability-uri ]\n"
                     "             [ -u user ] [ -p password ]\n\n");
     fprintf(stderr, "             If time, magnitude, confidence, or significance\n"
                     "             is not specified a reasonable default is used.\n\n");
-    fprintf(stderr, "       event delete if-map-server-url ip name [ -u user ] [ -p password ]\n");
+    fprintf(stderr, "       event [ --tls-cache file ] [ --session-file file ]\n"
+                    "             delete if-map-server-url ip name\n"
+                    "             [ -u user ] [ -p password ]\n\n");
+    fprintf(stderr, "       event [ --tls-cache file ] [ --session-file file ] [ --delta ]\n"
+                    "             --stream if-map-server-url [ -f file ] [ -b batch-size ]\n"
+                    "             [ -t flush-ms ] [ -q queue-size ] [ -u user ] [ -p password ]\n\n");
+    fprintf(stderr, "             --stream reads one event per line from file, or\n"
+                    "             standard input, as tab separated fields:\n"
+                    "               update|delete ip name time magnitude confidence\n"
+                    "               significance type other information vulnerability-uri\n"
+                    "             or as a JSON object with those keys (\"op\" for the first).\n"
+                    "             Empty or missing fields take the defaults above. Events\n"
+                    "             are published batch-size (default 1000) at a time, or\n"
+                    "             after flush-ms (default 200) when input is slower. At\n"
+                    "             most queue-size (default 10000) events are read ahead.\n"
+                    "             --delta drops updates already published, and\n"
+                    "             deletes of events not published, in the session.\n");
     exit(1);
 }
 
+//
+// Reports the events the server rejects by line number.
+//
+class EventRejections : public RejectionHandler
+{
+public:
+    EventRejections(const EventSpec* events, std::vector<bool>& rejected)
+        : m_events(events), m_rejected(rejected) {}
+
+    virtual void rejected(long index, IfmapClient& client)
+    {
+        fprintf(stderr, "line %ld: ", m_events[index].lineNum);
+        client.printFault(stderr);
+        m_rejected[index] = true;
+    }
+
+private:
+    const EventSpec* m_events;
+    std::vector<bool>& m_rejected;
+};
+
+//
+// Publishes events in one request, finding the lines the server
+// rejects if it does and marking them in rejected. Returns the number
+// of events rejected.
+//
+static long publishEvents(IfmapClient& client, const EventSpec* events, long count,
+                          std::vector<bool>& rejected)
+{
+    // Streamed events rarely repeat, so the metadata cache only lives
+    // as long as the request.
+    MetadataCache metadata;
+    std::vector<EventRequest> requests(count);
+    std::vector<__ifmap__union_PublishRequestType> publishes(count);
+    long ii;
+    for (ii = 0; ii < count; ii++) {
+        buildEventPublish(metadata, events[ii], requests[ii], publishes[ii]);
+    }
+    EventRejections rejections(events, rejected);
+    long numRejected = publishBatch(client, &publishes[0], count, rejections);
+    if (numRejected == -1) {
+        fprintf(stderr, "Could not publish lines %ld-%ld:\n",
+                events[0].lineNum, events[count - 1].lineNum);
+        client.printFault(stderr);
+        exit(1);
+    }
+    return numRejected;
+}
+
+//
+// State shared with the thread reading --stream input.
+//
+struct EventReader
+{
+    EventReader(size_t queueSize) : fd(-1), queue(queueSize), lines(0), rejected(0) {}
+
+    int fd;
+    BoundedQueue<EventSpec> queue;
+    long lines;
+    long rejected;
+};
+
+//
+// Reads and checks events from reader->fd and queues them. Once the
+// queue is full this stops reading, so the writer of the input blocks
+// until the server catches up.
+//
+static void* readEvents(void* arg)
+{
+    EventReader* reader = (EventReader*)arg;
+    std::string input;
+    bool eof = false;
+    while (!eof) {
+        char buf[65536];
+        ssize_t count = read(reader->fd, buf, sizeof buf);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            exit(1);
+        }
+        input.append(buf, count);
+        if (count == 0) {
+            eof = true;
+            if (!input.empty() && input[input.size() - 1] != '\n') {
+                input += '\n';
+            }
+        }
+        size_t begin = 0;
+        size_t nl;
+        while ((nl = input.find('\n', begin)) != std::string::npos) {
+            input[nl] = '\0';
+            char* line = &input[begin];
+            begin = nl + 1;
+            reader->lines++;
+            if (!*line || *line == '#') {
+                continue;
+            }
+            EventSpec spec;
+            spec.lineNum = reader->lines;
+            const char* error = 0;
+            if (!parseEvent(line, spec)) {
+                error = "malformed event";
+            } else {
+                error = checkEvent(spec);
+            }
+            if (error) {
+                fprintf(stderr, "line %ld: %s\n", reader->lines, error);
+                reader->rejected++;
+                continue;
+            }
+            reader->queue.push(spec);
+        }
+        input.erase(0, begin);
+    }
+    reader->queue.close();
+    return 0;
+}
+
+//
+// Publishes a batch, leaving out events that would not change what the
+// server holds when the client has a state cache.
+//
+static void flushEvents(IfmapClient& client, std::vector<EventSpec>& batch,
+                        long& batches, long& published, long& suppressed, long& failed)
+{
+    long long start = monotonicMicros();
+    long firstLine = batch.front().lineNum;
+    long lastLine = batch.back().lineNum;
+    long lines = batch.size();
+    StateCache* state = client.stateCache();
+    std::string key;
+    std::string value;
+    size_t ii;
+    if (state) {
+        // Each event is recorded as it is kept, so that a later line in
+        // the batch is checked against what the earlier ones will do.
+        size_t kept = 0;
+        state->beginBatch();
+        for (ii = 0; ii < batch.size(); ii++) {
+            eventState(batch[ii], key, value);
+            if (state->needed(key, value, batch[ii].update)) {
+                state->published(key, value, batch[ii].update);
+                batch[kept++] = batch[ii];
+            }
+        }
+        batch.resize(kept);
+    }
+
+    long count = batch.size();
+    std::vector<bool> rejected(count);
+    long numRejected = count ? publishEvents(client, &batch[0], count, rejected) : 0;
+    if (state) {
+        for (ii = 0; ii < batch.size(); ii++) {
+            if (rejected[ii]) {
+                eventState(batch[ii], key, value);
+                state->forget(key);
+            }
+        }
+        state->endBatch();
+    }
+    double secs = (monotonicMicros() - start) / 1000000.0;
+
+    batches++;
+    published += count - numRejected;
+    suppressed += lines - count;
+    failed += numRejected;
+    printf("Batch %ld: lines %ld-%ld, %ld published, %ld suppressed, %ld failed,"
+           " %.1f ms, %.0f/s\n",
+           batches, firstLine, lastLine, count - numRejected, lines - count, numRejected,
+           secs * 1000.0, secs > 0 ? lines / secs : 0.0);
+    fflush(stdout);
+    batch.clear();
+}
+
+//
+// Options for --stream mode follow the url, as they do for update and
+// delete.
+//
+static int runStream(int argc, char* argv[], TlsSessionCache* tlsCache, const char* sessionFile,
+                     bool delta)
+{
+    if (argc < 3) {
+        usage();
+    }
+    char* url = argv[2];
+    const char* file = 0;
+    long batchSize = 1000;
+    int flushMillis = 200;
+    long queueSize = 10000;
+    char* user = 0;
+    char* password = 0;
+    argv += 2;
+    argc -= 2;
+    while (--argc) {
+        char* option = *++argv;
+        if (!--argc) {
+            usage();
+        }
+        char* argument = *++argv;
+        if (strcmp(option, "-f") == 0) {
+            file = argument;
+        } else if (strcmp(option, "-b") == 0) {
+            batchSize = atol(argument);
+        } else if (strcmp(option, "-t") == 0) {
+            flushMillis = atoi(argument);
+        } else if (strcmp(option, "-q") == 0) {
+            queueSize = atol(argument);
+        } else if (strcmp(option, "-u") == 0) {
+            user = argument;
+        } else if (strcmp(option, "-p") == 0) {
+            password = argument;
+        } else {
+            usage();
+        }
+    }
+    if (batchSize < 1 || flushMillis < 0 || queueSize < 1) {
+        usage();
+    }
+
+    EventReader reader(queueSize);
+    reader.fd = STDIN_FILENO;
+    if (file) {
+        reader.fd = open(file, O_RDONLY);
+        if (reader.fd == -1) {
+            perror(file);
+            return 1;
+        }
+    }
+
+    IfmapClient client(url, user, password);
+    StateCache state;
+    if (delta) {
+        client.setStateCache(&state);
+    }
+    if (tlsCache) {
+        tlsCache->use(client.soap());
+    }
+    int code = sessionFile ? client.openSession(sessionFile) : client.newSession();
+    if (tlsCache) {
+        tlsCache->report(stderr);
+    }
+    if (code != SOAP_OK) {
+        client.printFault(stderr);
+        return 1;
+    }
+
+    pthread_t readerThread;
+    if (pthread_create(&readerThread, 0, readEvents, &reader) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    long long start = monotonicMicros();
+    std::vector<EventSpec> batch;
+    batch.reserve(batchSize);
+    long long firstQueuedAt = 0;
+    long batches = 0;
+    long published = 0;
+    long suppressed = 0;
+    long failed = 0;
+    while (true) {
+        long long deadline = batch.empty() ? 0 : firstQueuedAt + flushMillis * 1000LL;
+        EventSpec spec;
+        BoundedQueue<EventSpec>::Result result = reader.queue.pop(spec, deadline);
+        if (result == BoundedQueue<EventSpec>::ITEM) {
+            if (batch.empty()) {
+                firstQueuedAt = monotonicMicros();
+            }
+            batch.push_back(spec);
+            if ((long)batch.size() < batchSize) {
+                continue;
+            }
+        }
+        if (!batch.empty()) {
+            flushEvents(client, batch, batches, published, suppressed, failed);
+        }
+        if (result == BoundedQueue<EventSpec>::CLOSED) {
+            break;
+        }
+    }
+    pthread_join(readerThread, 0);
+
+    double secs = (monotonicMicros() - start) / 1000000.0;
+    failed += reader.rejected;
+    printf("Published %ld of %ld lines in %ld batches, %.1f s, %.0f/s, %ld suppressed,"
+           " %ld failed, queue high water %lu\n",
+           published, reader.lines, batches, secs, secs > 0 ? published / secs : 0.0,
+           suppressed, failed, (unsigned long)reader.queue.highWater());
+    if (tlsCache) {
+        tlsCache->save(client.soap());
+    }
+    return failed == 0 ? 0 : 1;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc < 4) {
+    TlsSessionCache* tlsCache = 0;
+    const char* sessionFile = 0;
+    bool delta = false;
+    while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--stream") == 0) {
+            return runStream(argc, argv, tlsCache, sessionFile, delta);
+        } else if (strcmp(argv[1], "--delta") == 0) {
+            delta = true;
+            argc--;
+            argv++;
+            continue;
+        } else if (strcmp(argv[1], "--tls-cache") == 0) {
+            tlsCache = new TlsSessionCache(argv[2]);
+        } else if (strcmp(argv[1], "--session-file") == 0) {
+            sessionFile = argv[2];
+        } else {
+            usage();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    // --delta only applies to --stream.
+    if (delta || argc < 5) {
         usage();
     }
     char* op = argv[1];
     char* url = argv[2];
-    char* ip = argv[3];
-    char* name = argv[4];
-    time_t date = 0;
-    int magnitude = 50;
-    int confidence = 50;
-    char* significance = "important";
-    char* type = 0;
-    char* other = 0;
-    char* information = 0;
-    char* vulnerabilityUri = 0;
+    EventSpec spec;
+    spec.ip = argv[3];
+    spec.name = argv[4];
     char* user = 0;
     char* password = 0;
     if (strcmp(op, "delete") == 0) {
+        spec.update = false;
         argv += 4;
         argc -= 4;
         while (--argc) {
@@ -97,29 +439,21 @@ int main(int argc, char* argv[])
             --argc;
             char* argument = *++argv;
             if (strcmp(option, "-d") == 0) {
-                date = atoi(argument);
+                spec.date = atoi(argument);
             } else if (strcmp(option, "-m") == 0) {
-                magnitude = atoi(argument);
-                if (magnitude < 0 || magnitude > 100) {
-                    fprintf(stderr, "magnitude must be between 0 and 100\n");
-                    return 1;
-                }
+                spec.magnitude = atoi(argument);
             } else if (strcmp(option, "-c") == 0) {
-                confidence = atoi(argument);
-                if (confidence < 0 || confidence > 100) {
-                    fprintf(stderr, "confidence must be between 0 and 100\n");
-                    return 1;
-                }
+                spec.confidence = atoi(argument);
             } else if (strcmp(option, "-s") == 0) {
-                significance = argument;
+                spec.significance = argument;
             } else if (strcmp(option, "-t") == 0) {
-                type = argument;
+                spec.type = argument;
             } else if (strcmp(option, "-o") == 0) {
-                other = argument;
+                spec.other = argument;
             } else if (strcmp(option, "-i") == 0) {
-                information = argument;
+                spec.information = argument;
             } else if (strcmp(option, "-v") == 0) {
-                vulnerabilityUri = argument;
+                spec.vulnerabilityUri = argument;
             } else if (strcmp(option, "-u") == 0) {
                 user = argument;
             } else if (strcmp(option, "-p") == 0) {
@@ -128,129 +462,53 @@ int main(int argc, char* argv[])
                 usage();
             }
         }
-        if (!date) {
-            date = time(0);
-        }
     } else {
         usage();
     }
-
-    Service service;
-    if (user && password) {
-        service.soap->userid = user;
-        service.soap->passwd = password;
-    }
-    service.endpoint = url;
-    int code = ifmapConnect(service);
-    if (code != SOAP_OK) {
-        soap_print_fault(service.soap, stderr);
+    const char* error = checkEvent(spec);
+    if (error) {
+        fprintf(stderr, "%s\n", error);
         return 1;
     }
-    
-    service.soap->header->ifmap__publisher_id = 0;
-
-    ifmap__IPAddressType ipAddr;
-    ipAddr.type = _ifmap__IPAddressType_type__IPv4;
-    ipAddr.value = ip;
-    ifmap__IdentifierType ipIdent;
-    ipIdent.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
-    ipIdent.union_IdentifierType.ip_address = &ipAddr;
-    
-    _meta__event event;
-    struct soap metaSoap(SOAP_XML_DOM);
-    ifmap__MetadataListType metadata;
-    ifmap__PublishType update;
-    ifmap__DeleteType delete_;
-    char filterBuf[100];
-    __ifmap__union_PublishRequestType publish;
 
-    if (strcmp(op, "update") == 0) {
-        event.name = name;
-        event.event_recorded_time = date;
-        char magnitudeBuf[20];
-        snprintf(magnitudeBuf, sizeof magnitudeBuf, "%d", magnitude);
-        event.magnitude = magnitudeBuf;
-        char confidenceBuf[100];
-        snprintf(confidenceBuf, sizeof confidenceBuf, "%d", confidence);
-        event.confidence = confidenceBuf;
-        if (strcmp(significance, "critical") == 0) {
-            event.significance = _meta__event_significance__critical;
-        } else if (strcmp(significance, "important") == 0) {
-            event.significance = _meta__event_significance__important;
-        } else if (strcmp(significance, "informational") == 0) {
-            event.significance = _meta__event_significance__informational;
-        } else {
-            fprintf(stderr, "significance must be one of critical, important, or informational\n");
+    const char* publisherdSocket = getenv(IFMAP_PUBLISHERD_SOCKET);
+    if (publisherdSocket) {
+        std::string command;
+        formatEvent(spec, command);
+        std::string reply;
+        if (!sendToPublisherd(publisherdSocket, "event " + command, reply)) {
+            fprintf(stderr, "%s\n", reply.c_str());
             return 1;
         }
-        event.type = 0;
-        if (type) {
-            _meta__event_type eventType;
-            if (strcmp(type, "p2p") == 0) {
-                eventType = _meta__event_type__p2p;
-            } else if (strcmp(type, "cve") == 0) {
-                eventType = _meta__event_type__cve;
-            } else if (strcmp(type, "botnet infection") == 0) {
-                eventType = _meta__event_type__botnet_x0020infection;
-            } else if (strcmp(type, "worm infection") == 0) {
-                eventType = _meta__event_type__worm_x0020infection;
-            } else if (strcmp(type, "excessive flows") == 0) {
-                eventType = _meta__event_type__excessive_x0020flows;
-            } else if (strcmp(type, "behavioral change") == 0) {
-                eventType = _meta__event_type__behavioral_x0020change;
-            } else if (strcmp(type, "policy violation") == 0) {
-                eventType = _meta__event_type__policy_x0020violation;
-            } else if (strcmp(type, "other") == 0) {
-                eventType = _meta__event_type__other;
-            } else {
-                fprintf(stderr, "type must be one of p2p, cve, botnet infection, worm infection,"
-                        " excessive flows, behavioral change, policy violation, or other\n");
-                return 1;
-            }
-            event.type = &eventType;
-            if (eventType == _meta__event_type__other && !other) {
-                fprintf(stderr, "must specify \"other\" parameter for type other\n");
-                return 1;
-            }
-        }
-        if ((!event.type || *event.type != _meta__event_type__other) && other) {
-            fprintf(stderr, "Do not specify \"other\" parameter unless type is other\n");
-            return 1;
-        }
-        event.other_type_definition = other;
-        event.information = information;
-        event.vulnerability_uri = vulnerabilityUri;
-
-        event.soap_out(&metaSoap, "meta:event", 0, 0);
-        metadata.__size = 1;
-        metadata.__any = metaSoap.dom;
+        return 0;
+    }
 
-        update.__union_PublishType = SOAP_UNION__ifmap__union_PublishType_identifier;
-        update.union_PublishType.identifier = &ipIdent;
-        update.metadata = &metadata;
-        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-        publish.union_PublishRequestType.update = &update;
-    } else {
-        delete_.__union_DeleteType = SOAP_UNION__ifmap__union_PublishType_identifier;
-        delete_.union_DeleteType.identifier = &ipIdent;
-        snprintf(filterBuf, sizeof filterBuf, "meta:event[name=\"%s\"]", name);
-        delete_.filter = filterBuf;
-        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_delete_;
-        publish.union_PublishRequestType.delete_ = &delete_;
+    IfmapClient client(url, user, password);
+    if (tlsCache) {
+        tlsCache->use(client.soap());
+    }
+    int code = sessionFile ? client.openSession(sessionFile) : client.newSession();
+    if (tlsCache) {
+        tlsCache->report(stderr);
+    }
+    if (code != SOAP_OK) {
+        client.printFault(stderr);
+        return 1;
     }
 
+    MetadataCache metadata;
+    EventRequest request;
+    __ifmap__union_PublishRequestType publish;
+    buildEventPublish(metadata, spec, request, publish);
+
     ifmap__PublishRequestType publishRequest;
     publishRequest.__size_PublishRequestType = 1;
     publishRequest.__union_PublishRequestType = &publish;
-    
-    struct __wsdl__PublishResponse response;
-    bzero(&response, sizeof response);
-
-    code = service.__wsdl__Publish(&publishRequest, response);
+    code = client.publish(&publishRequest);
     if (code != SOAP_OK) {
-        soap_print_fault(service.soap, stderr);
+        client.printFault(stderr);
+    } else if (tlsCache) {
+        tlsCache->save(client.soap());
     }
     return code == SOAP_OK ? 0 : 1;
 }
-
-#include <dom.cpp>
@@ -0,0 +1,444 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eventspec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <map>
+
+static pthread_once_t g_tablesOnce = PTHREAD_ONCE_INIT;
+static std::map<std::string, _meta__event_significance> g_significances;
+static std::map<std::string, _meta__event_type> g_types;
+
+static void buildTables()
+{
+    g_significances["critical"] = _meta__event_significance__critical;
+    g_significances["important"] = _meta__event_significance__important;
+    g_significances["informational"] = _meta__event_significance__informational;
+
+    g_types["p2p"] = _meta__event_type__p2p;
+    g_types["cve"] = _meta__event_type__cve;
+    g_types["botnet infection"] = _meta__event_type__botnet_x0020infection;
+    g_types["worm infection"] = _meta__event_type__worm_x0020infection;
+    g_types["excessive flows"] = _meta__event_type__excessive_x0020flows;
+    g_types["behavioral change"] = _meta__event_type__behavioral_x0020change;
+    g_types["policy violation"] = _meta__event_type__policy_x0020violation;
+    g_types["other"] = _meta__event_type__other;
+}
+
+const char* checkEvent(EventSpec& spec)
+{
+    pthread_once(&g_tablesOnce, buildTables);
+    if (spec.ip.empty() || spec.name.empty()) {
+        return "ip and name must be given";
+    }
+    if (!spec.update) {
+        return 0;
+    }
+    if (spec.magnitude < 0 || spec.magnitude > 100) {
+        return "magnitude must be between 0 and 100";
+    }
+    if (spec.confidence < 0 || spec.confidence > 100) {
+        return "confidence must be between 0 and 100";
+    }
+    std::map<std::string, _meta__event_significance>::const_iterator significance
+        = g_significances.find(spec.significance);
+    if (significance == g_significances.end()) {
+        return "significance must be one of critical, important, or informational";
+    }
+    spec.significanceValue = significance->second;
+    spec.hasType = !spec.type.empty();
+    if (spec.hasType) {
+        std::map<std::string, _meta__event_type>::const_iterator type = g_types.find(spec.type);
+        if (type == g_types.end()) {
+            return "type must be one of p2p, cve, botnet infection, worm infection,"
+                " excessive flows, behavioral change, policy violation, or other";
+        }
+        spec.typeValue = type->second;
+        if (spec.typeValue == _meta__event_type__other && spec.other.empty()) {
+            return "must specify \"other\" parameter for type other";
+        }
+    }
+    if ((!spec.hasType || spec.typeValue != _meta__event_type__other) && !spec.other.empty()) {
+        return "Do not specify \"other\" parameter unless type is other";
+    }
+    if (!spec.date) {
+        spec.date = time(0);
+    }
+    return 0;
+}
+
+static char* optional(const std::string& value)
+{
+    return value.empty() ? 0 : const_cast<char*>(value.c_str());
+}
+
+void eventState(const EventSpec& spec, std::string& key, std::string& value)
+{
+    key = "meta:event";
+    key += '\0';
+    key += spec.ip;
+    key += '\0';
+    key += spec.name;
+    if (spec.update) {
+        formatEvent(spec, value);
+    } else {
+        value.clear();
+    }
+}
+
+void buildEventPublish(MetadataCache& metadata, const EventSpec& spec,
+                       EventRequest& request, __ifmap__union_PublishRequestType& publish)
+{
+    request.ipAddr.type = _ifmap__IPAddressType_type__IPv4;
+    request.ipAddr.value = const_cast<char*>(spec.ip.c_str());
+    request.ipIdent.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
+    request.ipIdent.union_IdentifierType.ip_address = &request.ipAddr;
+
+    if (!spec.update) {
+        request.filter = "meta:event[name=\"" + spec.name + "\"]";
+        request.delete_.__union_DeleteType = SOAP_UNION__ifmap__union_PublishType_identifier;
+        request.delete_.union_DeleteType.identifier = &request.ipIdent;
+        request.delete_.filter = const_cast<char*>(request.filter.c_str());
+        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_delete_;
+        publish.union_PublishRequestType.delete_ = &request.delete_;
+        return;
+    }
+
+    _meta__event event;
+    event.name = const_cast<char*>(spec.name.c_str());
+    event.event_recorded_time = spec.date;
+    char magnitudeBuf[20];
+    snprintf(magnitudeBuf, sizeof magnitudeBuf, "%d", spec.magnitude);
+    event.magnitude = magnitudeBuf;
+    char confidenceBuf[20];
+    snprintf(confidenceBuf, sizeof confidenceBuf, "%d", spec.confidence);
+    event.confidence = confidenceBuf;
+    event.significance = spec.significanceValue;
+    _meta__event_type eventType = spec.typeValue;
+    event.type = spec.hasType ? &eventType : 0;
+    event.other_type_definition = optional(spec.other);
+    event.information = optional(spec.information);
+    event.vulnerability_uri = optional(spec.vulnerabilityUri);
+
+    // The key must tell apart every value that ends up in the
+    // element.
+    char dateBuf[30];
+    snprintf(dateBuf, sizeof dateBuf, "%ld", (long)spec.date);
+    std::string key = "meta:event";
+    const char* fields[] = {
+        event.name, dateBuf, magnitudeBuf, confidenceBuf, spec.significance.c_str(),
+        event.type ? spec.type.c_str() : 0, event.other_type_definition,
+        event.information, event.vulnerability_uri
+    };
+    int ii;
+    for (ii = 0; ii < sizeof fields / sizeof fields[0]; ii++) {
+        key += '\0';
+        if (fields[ii]) {
+            key += fields[ii];
+        }
+    }
+
+    request.update.__union_PublishType = SOAP_UNION__ifmap__union_PublishType_identifier;
+    request.update.union_PublishType.identifier = &request.ipIdent;
+    request.update.metadata = metadata.get(key, event, "meta:event");
+    publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
+    publish.union_PublishRequestType.update = &request.update;
+}
+
+//
+// Splits a line of tab separated fields into spec.
+//
+static bool parseTsv(char* line, EventSpec& spec)
+{
+    std::string* strings[] = {
+        0, &spec.ip, &spec.name, 0, 0, 0, &spec.significance, &spec.type, &spec.other,
+        &spec.information, &spec.vulnerabilityUri
+    };
+    const int numFields = sizeof strings / sizeof strings[0];
+    int field = 0;
+    char* next = line;
+    while (next) {
+        if (field == numFields) {
+            return false;
+        }
+        char* value = next;
+        next = strchr(next, '\t');
+        if (next) {
+            *next++ = '\0';
+        }
+        if (!*value) {
+            if (field == 0) {
+                return false;
+            }
+            field++;
+            continue;
+        }
+        switch (field) {
+        case 0:
+            if (strcmp(value, "update") != 0 && strcmp(value, "delete") != 0) {
+                return false;
+            }
+            spec.update = strcmp(value, "update") == 0;
+            break;
+        case 3:
+            spec.date = atol(value);
+            break;
+        case 4:
+            spec.magnitude = atoi(value);
+            break;
+        case 5:
+            spec.confidence = atoi(value);
+            break;
+        default:
+            *strings[field] = value;
+            break;
+        }
+        field++;
+    }
+    return field >= 3;
+}
+
+//
+// Appends the code point to out as UTF-8.
+//
+static void appendUtf8(std::string& out, unsigned long code)
+{
+    if (code < 0x80) {
+        out += (char)code;
+    } else if (code < 0x800) {
+        out += (char)(0xc0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3f));
+    } else {
+        out += (char)(0xe0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    }
+}
+
+//
+// Parses a JSON string starting at the opening quote. Leaves p after
+// the closing quote.
+//
+static bool parseJsonString(const char*& p, std::string& out)
+{
+    if (*p++ != '"') {
+        return false;
+    }
+    out.clear();
+    while (*p && *p != '"') {
+        if (*p != '\\') {
+            out += *p++;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+            {
+                char hex[5] = { 0 };
+                strncpy(hex, p + 1, 4);
+                char* end;
+                unsigned long code = strtoul(hex, &end, 16);
+                if (end != hex + 4) {
+                    return false;
+                }
+                appendUtf8(out, code);
+                p += 4;
+            }
+            break;
+        case '\0':
+            return false;
+        default:
+            out += *p;
+            break;
+        }
+        p++;
+    }
+    if (*p != '"') {
+        return false;
+    }
+    p++;
+    return true;
+}
+
+static void skipSpace(const char*& p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+}
+
+//
+// Parses a flat JSON object whose values are strings, numbers or null
+// into spec. Unknown keys are ignored.
+//
+static bool parseJson(const char* p, EventSpec& spec)
+{
+    skipSpace(p);
+    if (*p++ != '{') {
+        return false;
+    }
+    skipSpace(p);
+    if (*p == '}') {
+        return false;
+    }
+    std::string key;
+    std::string value;
+    bool hasOp = false;
+    while (true) {
+        skipSpace(p);
+        if (!parseJsonString(p, key)) {
+            return false;
+        }
+        skipSpace(p);
+        if (*p++ != ':') {
+            return false;
+        }
+        skipSpace(p);
+        if (*p == '"') {
+            if (!parseJsonString(p, value)) {
+                return false;
+            }
+        } else if (strncmp(p, "null", 4) == 0) {
+            value.clear();
+            p += 4;
+        } else {
+            const char* start = p;
+            while (*p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'
+                   || (*p >= '0' && *p <= '9')) {
+                p++;
+            }
+            if (p == start) {
+                return false;
+            }
+            value.assign(start, p - start);
+        }
+
+        if (key == "op") {
+            if (value != "update" && value != "delete") {
+                return false;
+            }
+            spec.update = value == "update";
+            hasOp = true;
+        } else if (key == "ip") {
+            spec.ip = value;
+        } else if (key == "name") {
+            spec.name = value;
+        } else if (key == "time") {
+            spec.date = atol(value.c_str());
+        } else if (key == "magnitude" && !value.empty()) {
+            spec.magnitude = atoi(value.c_str());
+        } else if (key == "confidence" && !value.empty()) {
+            spec.confidence = atoi(value.c_str());
+        } else if (key == "significance" && !value.empty()) {
+            spec.significance = value;
+        } else if (key == "type") {
+            spec.type = value;
+        } else if (key == "other") {
+            spec.other = value;
+        } else if (key == "information") {
+            spec.information = value;
+        } else if (key == "vulnerability-uri") {
+            spec.vulnerabilityUri = value;
+        }
+
+        skipSpace(p);
+        if (*p == '}') {
+            return hasOp;
+        }
+        if (*p++ != ',') {
+            return false;
+        }
+    }
+}
+
+bool parseEvent(char* line, EventSpec& spec)
+{
+    return *line == '{' ? parseJson(line, spec) : parseTsv(line, spec);
+}
+
+//
+// Appends value to out as a JSON string.
+//
+static void appendJsonString(std::string& out, const std::string& value)
+{
+    out += '"';
+    for (size_t ii = 0; ii < value.size(); ii++) {
+        unsigned char c = value[ii];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof escape, "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void formatEvent(const EventSpec& spec, std::string& out)
+{
+    char numbers[100];
+    snprintf(numbers, sizeof numbers, ",\"time\":%ld,\"magnitude\":%d,\"confidence\":%d",
+             (long)spec.date, spec.magnitude, spec.confidence);
+    const char* keys[] = {
+        "significance", "type", "other", "information", "vulnerability-uri"
+    };
+    const std::string* values[] = {
+        &spec.significance, &spec.type, &spec.other, &spec.information, &spec.vulnerabilityUri
+    };
+
+    out = spec.update ? "{\"op\":\"update\"" : "{\"op\":\"delete\"";
+    out += ",\"ip\":";
+    appendJsonString(out, spec.ip);
+    out += ",\"name\":";
+    appendJsonString(out, spec.name);
+    out += numbers;
+    for (int ii = 0; ii < sizeof keys / sizeof keys[0]; ii++) {
+        if (!values[ii]->empty()) {
+            out += ",\"";
+            out += keys[ii];
+            out += "\":";
+            appendJsonString(out, *values[ii]);
+        }
+    }
+    out += '}';
+}
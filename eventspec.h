@@ -0,0 +1,124 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_eventspec_h__
+#define ifmap_eventspec_h__
+
+#include <time.h>
+#include <string>
+#include "ifmapH.h"
+#include "metacache.h"
+
+/*
+ * One meta:event to publish, or to delete by name. Empty strings are
+ * fields that were not given.
+ */
+struct EventSpec
+{
+    EventSpec()
+        : lineNum(0), update(true), date(0), magnitude(50), confidence(50),
+          significance("important"), significanceValue(_meta__event_significance__important),
+          hasType(false), typeValue(_meta__event_type__other)
+    {
+    }
+
+    long lineNum;
+    bool update;
+    std::string ip;
+    std::string name;
+    time_t date;
+    int magnitude;
+    int confidence;
+    std::string significance;
+    std::string type;
+    std::string other;
+    std::string information;
+    std::string vulnerabilityUri;
+
+    // Set by checkEvent()
+    _meta__event_significance significanceValue;
+    bool hasType;
+    _meta__event_type typeValue;
+};
+
+/*
+ * Checks the fields of spec, looks up its significance and type and
+ * defaults its time to now. Returns 0 if spec is valid, otherwise a
+ * description of what is wrong.
+ */
+extern const char* checkEvent(EventSpec& spec);
+
+/*
+ * Parses an event from line, which is modified. The line holds either
+ * tab separated fields:
+ *
+ *   update|delete ip name time magnitude confidence significance
+ *   type other information vulnerability-uri
+ *
+ * or, if it starts with "{", a flat JSON object with those keys, "op"
+ * being the first. Empty or missing fields keep their defaults.
+ *
+ * Returns false if the line is malformed. Call checkEvent() after.
+ */
+extern bool parseEvent(char* line, EventSpec& spec);
+
+/*
+ * Formats spec as the JSON object parseEvent() reads.
+ */
+extern void formatEvent(const EventSpec& spec, std::string& out);
+
+/*
+ * Sets the state cache key and value of a checked spec, see
+ * statecache.h. Deletes remove every event of the name, so the key
+ * is the IP address and name and the value is all other fields.
+ */
+extern void eventState(const EventSpec& spec, std::string& key, std::string& value);
+
+/*
+ * The request objects for one event.
+ */
+struct EventRequest
+{
+    ifmap__IPAddressType ipAddr;
+    ifmap__IdentifierType ipIdent;
+    ifmap__PublishType update;
+    ifmap__DeleteType delete_;
+    std::string filter;
+};
+
+/*
+ * Fills in request and publish for a checked spec. They refer to the
+ * strings in spec, which must outlive them.
+ */
+extern void buildEventPublish(MetadataCache& metadata, const EventSpec& spec,
+                              EventRequest& request, __ifmap__union_PublishRequestType& publish);
+
+#endif /*ifmap_eventspec_h__*/
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "graph.h"
+
+const unsigned int MapGraph::NONE;
+
+static const char* const s_typeNames[] = {
+    "access-request", "device", "identity", "ip-address", "mac-address"
+};
+
+const char* MapGraph::typeName(Type type)
+{
+    return s_typeNames[type];
+}
+
+bool MapGraph::parseType(const char* name, Type& type)
+{
+    for (size_t ii = 0; ii < sizeof s_typeNames / sizeof s_typeNames[0]; ii++) {
+        if (strcmp(name, s_typeNames[ii]) == 0) {
+            type = (Type)ii;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// FNV-1a over the type and the NUL separated parts of the identifier.
+//
+static unsigned int hashIdentifier(MapGraph::Type type, const std::string& value,
+                                   const std::string& qualifier, const std::string& domain)
+{
+    unsigned int hash = 2166136261u;
+    hash = (hash ^ (unsigned char)type) * 16777619u;
+    const std::string* parts[] = { &value, &qualifier, &domain };
+    for (size_t ii = 0; ii < 3; ii++) {
+        const std::string& part = *parts[ii];
+        for (size_t jj = 0; jj < part.size(); jj++) {
+            hash = (hash ^ (unsigned char)part[jj]) * 16777619u;
+        }
+        hash = (hash ^ 0) * 16777619u;
+    }
+    return hash;
+}
+
+static const char* attributeOrEmpty(const XmlNode* node, const char* name)
+{
+    const char* value = node->attribute(name);
+    return value ? value : "";
+}
+
+//
+// Summarizes each metadata element as its name, followed by its name
+// child's text if it has one, as in "event worm-detected".
+//
+static void readMetadata(const XmlNode* metadata, std::vector<std::string>& out)
+{
+    out.clear();
+    if (!metadata) {
+        return;
+    }
+    out.reserve(metadata->children.size());
+    for (size_t ii = 0; ii < metadata->children.size(); ii++) {
+        const XmlNode* elem = metadata->children[ii];
+        out.push_back(elem->name);
+        const XmlNode* name = elem->child("name");
+        if (name) {
+            out.back() += ' ';
+            out.back() += name->text;
+        }
+    }
+}
+
+static bool hasMetadata(const MapGraph::Edge& edge, const char* name)
+{
+    size_t length = strlen(name);
+    for (size_t ii = 0; ii < edge.metadata.size(); ii++) {
+        const std::string& meta = edge.metadata[ii];
+        if (meta.compare(0, length, name) == 0 && (meta.size() == length || meta[length] == ' ')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+MapGraph::MapGraph()
+    : m_nodeCount(0), m_edgeCount(0), m_slots(1024, NONE), m_inResult(false)
+{
+}
+
+MapGraph::NodeId MapGraph::find(Type type, const std::string& value, const std::string& qualifier,
+                                const std::string& domain) const
+{
+    unsigned int hash = hashIdentifier(type, value, qualifier, domain);
+    for (size_t ii = slot(hash); m_slots[ii] != NONE; ii = (ii + 1) & (m_slots.size() - 1)) {
+        const Node& node = m_nodes[m_slots[ii]];
+        if (node.hash == hash && node.type == type && node.value == value
+            && node.qualifier == qualifier && node.domain == domain) {
+            return m_slots[ii];
+        }
+    }
+    return NONE;
+}
+
+MapGraph::NodeId MapGraph::other(EdgeId edge, NodeId id) const
+{
+    const Edge& e = m_edges[edge];
+    return e.nodes[0] == id ? e.nodes[1] : e.nodes[0];
+}
+
+void MapGraph::identitiesOnIp(const std::string& ip, std::vector<NodeId>& identities) const
+{
+    NodeId ipNode = find(IP_ADDRESS, ip);
+    if (ipNode == NONE) {
+        return;
+    }
+    const std::vector<EdgeId>& ipEdges = m_nodes[ipNode].edges;
+    for (size_t ii = 0; ii < ipEdges.size(); ii++) {
+        NodeId request = other(ipEdges[ii], ipNode);
+        if (m_nodes[request].type != ACCESS_REQUEST) {
+            continue;
+        }
+        const std::vector<EdgeId>& requestEdges = m_nodes[request].edges;
+        for (size_t jj = 0; jj < requestEdges.size(); jj++) {
+            NodeId identity = other(requestEdges[jj], request);
+            if (m_nodes[identity].type != IDENTITY
+                || !hasMetadata(m_edges[requestEdges[jj]], "authenticated-as")) {
+                continue;
+            }
+            size_t kk;
+            for (kk = 0; kk < identities.size() && identities[kk] != identity; kk++) {
+            }
+            if (kk == identities.size()) {
+                identities.push_back(identity);
+            }
+        }
+    }
+}
+
+void MapGraph::forget(const std::string& name)
+{
+    std::map<std::string, std::vector<Item> >::iterator it = m_results.find(name);
+    if (it != m_results.end()) {
+        releaseAll(it->second);
+        m_results.erase(it);
+    }
+}
+
+void MapGraph::searchResultBegin(const char* name)
+{
+    // A response that failed part way never ended its last result.
+    if (m_inResult) {
+        releaseAll(m_current);
+    }
+    m_currentName = name;
+    m_inResult = true;
+}
+
+void MapGraph::identifierResult(const char*, const XmlNode& result)
+{
+    const XmlNode* identifier = result.child("identifier");
+    NodeId id = m_inResult && identifier ? intern(*identifier) : NONE;
+    if (id == NONE) {
+        return;
+    }
+    Node& node = m_nodes[id];
+    node.refs++;
+    readMetadata(result.child("metadata"), node.metadata);
+    Item item = { false, id };
+    m_current.push_back(item);
+}
+
+void MapGraph::linkResult(const char*, const XmlNode& result)
+{
+    const XmlNode* linkNode = result.child("link");
+    if (!m_inResult || !linkNode || linkNode->children.size() != 2) {
+        return;
+    }
+    NodeId a = intern(*linkNode->children[0]);
+    NodeId b = intern(*linkNode->children[1]);
+    if (a == NONE || b == NONE || a == b) {
+        // Drop an endpoint that nothing else refers to.
+        if (a != NONE) {
+            m_nodes[a].refs++;
+            releaseNode(a);
+        }
+        if (b != NONE && b != a) {
+            m_nodes[b].refs++;
+            releaseNode(b);
+        }
+        return;
+    }
+    EdgeId id = link(a, b);
+    Edge& edge = m_edges[id];
+    edge.refs++;
+    readMetadata(result.child("metadata"), edge.metadata);
+    Item item = { true, id };
+    m_current.push_back(item);
+}
+
+void MapGraph::searchResultEnd(const char* name)
+{
+    if (!m_inResult) {
+        return;
+    }
+    // New items already hold their references, so what both results
+    // returned survives releasing the old one.
+    std::vector<Item>& previous = m_results[m_currentName];
+    releaseAll(previous);
+    previous.swap(m_current);
+    if (previous.empty()) {
+        m_results.erase(m_currentName);
+    }
+    m_inResult = false;
+}
+
+//
+// Returns the node for an identifier element, adding it if it is new,
+// or NONE if the element is not an identifier type the graph knows.
+//
+MapGraph::NodeId MapGraph::intern(const XmlNode& identifier)
+{
+    if (identifier.children.empty()) {
+        return NONE;
+    }
+    const XmlNode* ident = identifier.children[0];
+    Type type;
+    if (!parseType(ident->name.c_str(), type)) {
+        return NONE;
+    }
+    std::string value;
+    std::string qualifier;
+    switch (type) {
+    case ACCESS_REQUEST:
+        value = attributeOrEmpty(ident, "name");
+        break;
+    case DEVICE:
+        if (!ident->children.empty()) {
+            qualifier = ident->children[0]->name;
+            value = ident->children[0]->text;
+        }
+        break;
+    case IDENTITY:
+        value = attributeOrEmpty(ident, "name");
+        qualifier = attributeOrEmpty(ident, "type");
+        break;
+    case IP_ADDRESS:
+    case MAC_ADDRESS:
+        value = attributeOrEmpty(ident, "value");
+        break;
+    }
+    std::string domain = attributeOrEmpty(ident, "administrative-domain");
+
+    NodeId id = find(type, value, qualifier, domain);
+    if (id != NONE) {
+        return id;
+    }
+    if (m_freeNodes.empty()) {
+        id = m_nodes.size();
+        m_nodes.push_back(Node());
+    } else {
+        id = m_freeNodes.back();
+        m_freeNodes.pop_back();
+    }
+    Node& node = m_nodes[id];
+    node.type = type;
+    node.value.swap(value);
+    node.qualifier.swap(qualifier);
+    node.domain.swap(domain);
+    node.metadata.clear();
+    node.edges.clear();
+    node.hash = hashIdentifier(type, node.value, node.qualifier, node.domain);
+    node.refs = 0;
+    node.live = true;
+    m_nodeCount++;
+    if (m_nodeCount * 2 > m_slots.size()) {
+        grow();
+    } else {
+        insertSlot(id);
+    }
+    return id;
+}
+
+//
+// Returns the edge between a and b, adding it if there is none. Only
+// the endpoint with fewer links is searched.
+//
+MapGraph::EdgeId MapGraph::link(NodeId a, NodeId b)
+{
+    NodeId from = m_nodes[a].edges.size() <= m_nodes[b].edges.size() ? a : b;
+    NodeId to = from == a ? b : a;
+    const std::vector<EdgeId>& edges = m_nodes[from].edges;
+    for (size_t ii = 0; ii < edges.size(); ii++) {
+        if (other(edges[ii], from) == to) {
+            return edges[ii];
+        }
+    }
+
+    EdgeId id;
+    if (m_freeEdges.empty()) {
+        id = m_edges.size();
+        m_edges.push_back(Edge());
+    } else {
+        id = m_freeEdges.back();
+        m_freeEdges.pop_back();
+    }
+    Edge& edge = m_edges[id];
+    edge.nodes[0] = a;
+    edge.nodes[1] = b;
+    edge.metadata.clear();
+    edge.refs = 0;
+    edge.live = true;
+    m_nodes[a].edges.push_back(id);
+    m_nodes[b].edges.push_back(id);
+    m_edgeCount++;
+    return id;
+}
+
+void MapGraph::release(const Item& item)
+{
+    if (item.isEdge) {
+        releaseEdge(item.id);
+    } else {
+        releaseNode(item.id);
+    }
+}
+
+void MapGraph::releaseAll(std::vector<Item>& items)
+{
+    for (size_t ii = 0; ii < items.size(); ii++) {
+        release(items[ii]);
+    }
+    items.clear();
+}
+
+//
+// Drops one reference to the node, removing it once no result returns
+// it and it has no links.
+//
+void MapGraph::releaseNode(NodeId id)
+{
+    Node& node = m_nodes[id];
+    if (--node.refs > 0 || !node.edges.empty()) {
+        return;
+    }
+    eraseSlot(id);
+    node.live = false;
+    node.metadata.clear();
+    m_freeNodes.push_back(id);
+    m_nodeCount--;
+}
+
+void MapGraph::releaseEdge(EdgeId id)
+{
+    Edge& edge = m_edges[id];
+    if (--edge.refs > 0) {
+        return;
+    }
+    for (int ii = 0; ii < 2; ii++) {
+        std::vector<EdgeId>& edges = m_nodes[edge.nodes[ii]].edges;
+        for (size_t jj = 0; jj < edges.size(); jj++) {
+            if (edges[jj] == id) {
+                edges[jj] = edges.back();
+                edges.pop_back();
+                break;
+            }
+        }
+    }
+    edge.live = false;
+    edge.metadata.clear();
+    m_freeEdges.push_back(id);
+    m_edgeCount--;
+    // The endpoints may now be unreferenced.
+    for (int ii = 0; ii < 2; ii++) {
+        m_nodes[edge.nodes[ii]].refs++;
+        releaseNode(edge.nodes[ii]);
+    }
+}
+
+void MapGraph::insertSlot(NodeId id)
+{
+    size_t ii = slot(m_nodes[id].hash);
+    while (m_slots[ii] != NONE) {
+        ii = (ii + 1) & (m_slots.size() - 1);
+    }
+    m_slots[ii] = id;
+}
+
+//
+// Removes id from the index, moving back any later entries of its
+// probe run so that lookups never stop at the hole.
+//
+void MapGraph::eraseSlot(NodeId id)
+{
+    size_t mask = m_slots.size() - 1;
+    size_t hole = slot(m_nodes[id].hash);
+    while (m_slots[hole] != id) {
+        hole = (hole + 1) & mask;
+    }
+    size_t next = hole;
+    while (true) {
+        next = (next + 1) & mask;
+        if (m_slots[next] == NONE) {
+            break;
+        }
+        // An entry may fill the hole if its home slot is not in the
+        // wrapped range (hole, next].
+        size_t home = slot(m_nodes[m_slots[next]].hash);
+        bool between = hole <= next ? (hole < home && home <= next)
+                                    : (hole < home || home <= next);
+        if (!between) {
+            m_slots[hole] = m_slots[next];
+            hole = next;
+        }
+    }
+    m_slots[hole] = NONE;
+}
+
+void MapGraph::grow()
+{
+    m_slots.assign(m_slots.size() * 2, NONE);
+    for (NodeId id = 0; id < m_nodes.size(); id++) {
+        if (m_nodes[id].live) {
+            insertSlot(id);
+        }
+    }
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_graph_h__
+#define ifmap_graph_h__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "pollstream.h"
+
+/*
+ * Client side copy of the identifiers and links that subscriptions
+ * return, so that questions such as "which user is on this IP" are
+ * answered locally instead of by another search.
+ *
+ * Feed it poll results by passing it to a PollStreamParser, directly
+ * or from another handler. In IF-MAP 1.0 each searchResult in a poll
+ * is the whole current result of its subscription, so the graph keeps
+ * what each subscription last returned: items that no subscription
+ * returns any more are removed when the result ends. The metadata of
+ * an identifier or link is the list its latest result carried.
+ *
+ * Identifiers are found through a hash index in constant time and
+ * each lists its links, so neighbour queries cost O(degree). NodeIds
+ * and EdgeIds are reused once their item is removed. Not thread safe.
+ */
+class MapGraph : public PollResultHandler
+{
+public:
+    enum Type { ACCESS_REQUEST, DEVICE, IDENTITY, IP_ADDRESS, MAC_ADDRESS };
+
+    typedef unsigned int NodeId;
+    typedef unsigned int EdgeId;
+    static const unsigned int NONE = ~0u;
+
+    /*
+     * An identifier. value is the name, address or device name.
+     * qualifier is the identity type, or "aik-name" or "name" for a
+     * device, and is empty for the other types.
+     */
+    struct Node
+    {
+        Type type;
+        std::string value;
+        std::string qualifier;
+        std::string domain;
+        std::vector<std::string> metadata;
+        std::vector<EdgeId> edges;
+
+        unsigned int hash;
+        long refs;
+        bool live;
+    };
+
+    struct Edge
+    {
+        NodeId nodes[2];
+        std::vector<std::string> metadata;
+
+        long refs;
+        bool live;
+    };
+
+    MapGraph();
+
+    /*
+     * Returns the identifier, or NONE if no subscription has it.
+     */
+    NodeId find(Type type, const std::string& value, const std::string& qualifier = "",
+                const std::string& domain = "") const;
+
+    const Node& node(NodeId id) const { return m_nodes[id]; }
+    const Edge& edge(EdgeId id) const { return m_edges[id]; }
+
+    /*
+     * Returns the identifier at the other end of edge from id.
+     */
+    NodeId other(EdgeId edge, NodeId id) const;
+
+    /*
+     * Appends to identities the users authenticated by an access
+     * request on the IP address.
+     */
+    void identitiesOnIp(const std::string& ip, std::vector<NodeId>& identities) const;
+
+    /*
+     * Drops what subscription name returned, as after deleting it.
+     */
+    void forget(const std::string& name);
+
+    size_t nodeCount() const { return m_nodeCount; }
+    size_t edgeCount() const { return m_edgeCount; }
+
+    /*
+     * Returns "ip-address", "identity" and so on.
+     */
+    static const char* typeName(Type type);
+
+    /*
+     * Sets type from a name returned by typeName(). Returns false if
+     * name is not an identifier type.
+     */
+    static bool parseType(const char* name, Type& type);
+
+    virtual void searchResultBegin(const char* name);
+    virtual void identifierResult(const char* searchName, const XmlNode& result);
+    virtual void linkResult(const char* searchName, const XmlNode& result);
+    virtual void searchResultEnd(const char* name);
+
+private:
+    /*
+     * An identifier or link returned by a subscription.
+     */
+    struct Item
+    {
+        bool isEdge;
+        unsigned int id;
+    };
+
+    NodeId intern(const XmlNode& identifier);
+    EdgeId link(NodeId a, NodeId b);
+    void release(const Item& item);
+    void releaseNode(NodeId id);
+    void releaseEdge(EdgeId id);
+    void releaseAll(std::vector<Item>& items);
+
+    size_t slot(unsigned int hash) const { return hash & (m_slots.size() - 1); }
+    void insertSlot(NodeId id);
+    void eraseSlot(NodeId id);
+    void grow();
+
+    std::vector<Node> m_nodes;
+    std::vector<NodeId> m_freeNodes;
+    size_t m_nodeCount;
+    std::vector<Edge> m_edges;
+    std::vector<EdgeId> m_freeEdges;
+    size_t m_edgeCount;
+
+    // Open addressing with linear probing, at most half full.
+    std::vector<NodeId> m_slots;
+
+    std::map<std::string, std::vector<Item> > m_results;
+    std::string m_currentName;
+    std::vector<Item> m_current;
+    bool m_inResult;
+};
+
+#endif /*ifmap_graph_h__*/
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "histogram.h"
+#include <time.h>
+
+//
+// Buckets are split into SUB_BUCKETS linear sub-buckets. Values below
+// SUB_BUCKETS are recorded exactly; each doubling above that reuses the
+// upper half of the sub-buckets at twice the width.
+//
+static const int SUB_BUCKET_BITS = 10;
+static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+static const int HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+static const int MAX_VALUE_BITS = 36;
+static const long long MAX_VALUE = (1LL << MAX_VALUE_BITS) - 1;
+static const int NUM_INDEXES = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) * HALF_SUB_BUCKETS;
+
+long long monotonicMicros()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_counts(NUM_INDEXES)
+{
+    reset();
+}
+
+int LatencyHistogram::indexOf(long long value)
+{
+    int shift = 0;
+    while ((value >> shift) >= SUB_BUCKETS) {
+        shift++;
+    }
+    return shift * HALF_SUB_BUCKETS + (int)(value >> shift);
+}
+
+long long LatencyHistogram::highestValueAt(int index)
+{
+    int shift = index / HALF_SUB_BUCKETS - 1;
+    if (shift < 0) {
+        shift = 0;
+    }
+    long long subBucket = index - shift * HALF_SUB_BUCKETS;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(long long usecs)
+{
+    if (usecs < 0) {
+        usecs = 0;
+    } else if (usecs > MAX_VALUE) {
+        usecs = MAX_VALUE;
+    }
+    m_counts[indexOf(usecs)]++;
+    if (!m_count || usecs < m_min) {
+        m_min = usecs;
+    }
+    if (usecs > m_max) {
+        m_max = usecs;
+    }
+    m_count++;
+    m_total += usecs;
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other)
+{
+    if (!other.m_count) {
+        return;
+    }
+    for (int ii = 0; ii < NUM_INDEXES; ii++) {
+        m_counts[ii] += other.m_counts[ii];
+    }
+    if (!m_count || other.m_min < m_min) {
+        m_min = other.m_min;
+    }
+    if (other.m_max > m_max) {
+        m_max = other.m_max;
+    }
+    m_count += other.m_count;
+    m_total += other.m_total;
+}
+
+void LatencyHistogram::reset()
+{
+    for (int ii = 0; ii < NUM_INDEXES; ii++) {
+        m_counts[ii] = 0;
+    }
+    m_count = 0;
+    m_total = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+long long LatencyHistogram::percentile(double percent) const
+{
+    if (!m_count) {
+        return 0;
+    }
+    long long target = (long long)(percent / 100.0 * m_count + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+    long long seen = 0;
+    for (int ii = 0; ii < NUM_INDEXES; ii++) {
+        seen += m_counts[ii];
+        if (seen >= target) {
+            long long value = highestValueAt(ii);
+            return value < m_max ? value : m_max;
+        }
+    }
+    return m_max;
+}
+
+void LatencyHistogram::print(FILE* out, const char* label) const
+{
+    fprintf(out, "%-15s n=%lld p50=%lld p90=%lld p99=%lld p99.9=%lld max=%lld\n",
+            label, m_count, percentile(50.0), percentile(90.0), percentile(99.0),
+            percentile(99.9), max());
+}
+
+void LatencyHistogram::writeCsv(FILE* out) const
+{
+    fprintf(out, "%lld,%lld,%.1f,%lld,%lld,%lld,%lld,%lld",
+            m_count, min(), mean(), percentile(50.0), percentile(90.0),
+            percentile(99.0), percentile(99.9), max());
+}
+
+void LatencyHistogram::writeJson(FILE* out) const
+{
+    fprintf(out, "{\"count\": %lld, \"min\": %lld, \"mean\": %.1f, \"p50\": %lld, "
+            "\"p90\": %lld, \"p99\": %lld, \"p99.9\": %lld, \"max\": %lld}",
+            m_count, min(), mean(), percentile(50.0), percentile(90.0),
+            percentile(99.0), percentile(99.9), max());
+}
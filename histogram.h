@@ -0,0 +1,96 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_histogram_h__
+#define ifmap_histogram_h__
+
+#include <stdio.h>
+#include <vector>
+
+/*
+ * Returns microseconds from CLOCK_MONOTONIC. Only differences between
+ * two values are meaningful.
+ */
+extern long long monotonicMicros();
+
+/*
+ * Latency histogram in the style of HdrHistogram. Values are
+ * microseconds and are kept to about three significant digits from
+ * 1 microsecond up to roughly 19 hours; larger values are clamped.
+ *
+ * Not thread safe. Callers recording from several threads must
+ * serialize access or keep one histogram per thread and add() them.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(long long usecs);
+    void add(const LatencyHistogram& other);
+    void reset();
+
+    long long count() const { return m_count; }
+    long long min() const { return m_count ? m_min : 0; }
+    long long max() const { return m_max; }
+    double mean() const { return m_count ? (double)m_total / m_count : 0.0; }
+
+    /*
+     * Returns the value below which the given percentage (0-100) of
+     * recorded values fall, to the histogram's precision.
+     */
+    long long percentile(double percent) const;
+
+    /*
+     * Prints a one line summary: label, count, p50, p90, p99, p99.9
+     * and max.
+     */
+    void print(FILE* out, const char* label) const;
+
+    /*
+     * Writes count, min, mean, p50, p90, p99, p99.9 and max as comma
+     * separated values or as the members of a JSON object.
+     */
+    void writeCsv(FILE* out) const;
+    void writeJson(FILE* out) const;
+
+private:
+    static int indexOf(long long value);
+    static long long highestValueAt(int index);
+
+    std::vector<long long> m_counts;
+    long long m_count;
+    long long m_total;
+    long long m_min;
+    long long m_max;
+};
+
+#endif /*ifmap_histogram_h__*/
@@ -0,0 +1,789 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ifmap.nsmap"
+#include "ifmapStub.h"
+#include "ifmapServiceProxy.h"
+#include "call.h"
+#include "intern.h"
+#include "ipmac.h"
+#include "metacache.h"
+#include "pollstream.h"
+#include "publishitem.h"
+
+//
+// Every allocation is counted by replacing malloc and friends with
+// wrappers around glibc's own, which operator new and gSOAP both end
+// up calling. The benchmarks run in a single thread.
+//
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static long long g_allocs;
+static long long g_allocBytes;
+
+extern "C" void* malloc(size_t size)
+{
+    g_allocs++;
+    g_allocBytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    g_allocs++;
+    g_allocBytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    g_allocs++;
+    g_allocBytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+static long long nowNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//
+// What one run of a benchmark cost. Benchmarks call pauseTimer() and
+// resumeTimer() around setup and teardown they do not want measured.
+//
+struct Measurement
+{
+    long long nanos;
+    long long allocs;
+    long long bytes;
+};
+
+static Measurement g_measured;
+static Measurement g_resumed;
+
+static void resumeTimer()
+{
+    g_resumed.allocs = g_allocs;
+    g_resumed.bytes = g_allocBytes;
+    g_resumed.nanos = nowNanos();
+}
+
+static void pauseTimer()
+{
+    g_measured.nanos += nowNanos() - g_resumed.nanos;
+    g_measured.allocs += g_allocs - g_resumed.allocs;
+    g_measured.bytes += g_allocBytes - g_resumed.bytes;
+}
+
+// Identifiers and items are built in batches of this many, with the
+// slab or soap context reset between batches as load does between
+// requests.
+static const long s_batchSize = 1024;
+
+static char g_names[s_batchSize][32];
+static char g_ips[s_batchSize][16];
+
+static void buildNames()
+{
+    for (long ii = 0; ii < s_batchSize; ii++) {
+        snprintf(g_names[ii], sizeof g_names[ii], "name%06ld", ii);
+        snprintf(g_ips[ii], sizeof g_ips[ii], "10.0.%ld.%ld", ii >> 8, ii & 255);
+    }
+}
+
+//
+// Identifiers
+//
+
+static void benchAccessRequest(long iterations)
+{
+    IdentifierSlab slab;
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            slab.reset();
+        }
+        slab.accessRequest(0, g_names[ii % s_batchSize]);
+    }
+    pauseTimer();
+}
+
+static void benchIpAddress(long iterations)
+{
+    IdentifierSlab slab;
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            slab.reset();
+        }
+        slab.ipAddress(0, _ifmap__IPAddressType_type__IPv4, g_ips[ii % s_batchSize]);
+    }
+    pauseTimer();
+}
+
+static void benchMacAddress(long iterations)
+{
+    IdentifierSlab slab;
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            slab.reset();
+        }
+        slab.macAddress(0, g_names[ii % s_batchSize]);
+    }
+    pauseTimer();
+}
+
+static void benchIdentity(long iterations)
+{
+    IdentifierSlab slab;
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            slab.reset();
+        }
+        slab.identity(0, _ifmap__IdentityType_type__username, g_names[ii % s_batchSize]);
+    }
+    pauseTimer();
+}
+
+static void benchDevice(long iterations)
+{
+    IdentifierSlab slab;
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            slab.reset();
+        }
+        slab.device(SOAP_UNION__ifmap__union_DeviceType_name, g_names[ii % s_batchSize]);
+    }
+    pauseTimer();
+}
+
+static void benchInternedIpAddress(long iterations)
+{
+    IdentifierTable table;
+    for (long ii = 0; ii < iterations; ii++) {
+        table.ipAddress(0, _ifmap__IPAddressType_type__IPv4, "10.0.0.1");
+    }
+    pauseTimer();
+}
+
+//
+// Publish items
+//
+
+enum ItemKind { IDENTIFIER_UPDATE, LINK_UPDATE, LINK_DELETE };
+
+static void buildItems(ItemKind kind, long iterations)
+{
+    pauseTimer();
+    struct soap soap;
+    MetadataCache metadata;
+    IdentifierTable identifiers;
+    ifmap__IdentifierType* identifier0 = identifiers.accessRequest(0, "ar000001");
+    ifmap__IdentifierType* identifier1
+        = identifiers.ipAddress(0, _ifmap__IPAddressType_type__IPv4, "10.0.0.1");
+    ifmap__MetadataListType* list
+        = metadata.constant<_meta__access_request_ip>("meta:access-request-ip");
+    resumeTimer();
+
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            soap_destroy(&soap);
+            soap_end(&soap);
+        }
+        switch (kind) {
+        case IDENTIFIER_UPDATE:
+            createIdentifierUpdate(&soap, identifier0, list);
+            break;
+        case LINK_UPDATE:
+            createLinkUpdate(&soap, identifier0, identifier1, list);
+            break;
+        case LINK_DELETE:
+            createLinkDelete(&soap, identifier0, identifier1, "meta:access-request-ip");
+            break;
+        }
+    }
+    soap_destroy(&soap);
+    soap_end(&soap);
+    pauseTimer();
+}
+
+static void benchIdentifierUpdate(long iterations)
+{
+    buildItems(IDENTIFIER_UPDATE, iterations);
+}
+
+static void benchLinkUpdate(long iterations)
+{
+    buildItems(LINK_UPDATE, iterations);
+}
+
+static void benchLinkDelete(long iterations)
+{
+    buildItems(LINK_DELETE, iterations);
+}
+
+//
+// Capabilities, built once per distinct set of roles and then reused
+// from the cache.
+//
+
+static void benchCapabilities(long iterations)
+{
+    pauseTimer();
+    MetadataCache* metadata = 0;
+    std::vector<const char*> roles;
+    roles.push_back("role1");
+    roles.push_back("role2");
+    roles.push_back("role3");
+    roles.push_back("role4");
+    roles.push_back(0);
+    for (long ii = 0; ii < iterations; ii++) {
+        if (ii % s_batchSize == 0) {
+            delete metadata;
+            metadata = new MetadataCache;
+        }
+        roles[4] = g_names[ii % s_batchSize];
+        resumeTimer();
+        metadata->capabilities(roles);
+        pauseTimer();
+    }
+    delete metadata;
+}
+
+static void benchCachedCapabilities(long iterations)
+{
+    pauseTimer();
+    MetadataCache metadata;
+    std::vector<const char*> roles;
+    roles.push_back("role1");
+    roles.push_back("role2");
+    roles.push_back("role3");
+    roles.push_back("role4");
+    roles.push_back("role5");
+    metadata.capabilities(roles);
+    resumeTimer();
+
+    for (long ii = 0; ii < iterations; ii++) {
+        metadata.capabilities(roles);
+    }
+    pauseTimer();
+}
+
+//
+// Metadata serialization. Output goes to a string that keeps its
+// capacity between iterations.
+//
+
+static int appendOutput(struct soap* soap, const char* data, size_t length)
+{
+    ((std::string*)soap->user)->append(data, length);
+    return SOAP_OK;
+}
+
+template <class Meta>
+static void serializeMeta(const Meta& meta, const char* tag, long iterations)
+{
+    pauseTimer();
+    struct soap soap(SOAP_C_UTFSTRING);
+    std::string output;
+    output.reserve(4096);
+    soap.user = &output;
+    soap.fsend = appendOutput;
+    soap.encodingStyle = NULL;
+    resumeTimer();
+
+    for (long ii = 0; ii < iterations; ii++) {
+        output.clear();
+        if (soap_begin_send(&soap)
+            || meta.soap_out(&soap, tag, 0, 0)
+            || soap_end_send(&soap)) {
+            soap_print_fault(&soap, stderr);
+            exit(1);
+        }
+    }
+    pauseTimer();
+}
+
+static void benchAccessRequestDevice(long iterations)
+{
+    _meta__access_request_device meta;
+    serializeMeta(meta, "meta:access-request-device", iterations);
+}
+
+static void benchAccessRequestIp(long iterations)
+{
+    _meta__access_request_ip meta;
+    serializeMeta(meta, "meta:access-request-ip", iterations);
+}
+
+static void benchAccessRequestMac(long iterations)
+{
+    _meta__access_request_mac meta;
+    serializeMeta(meta, "meta:access-request-mac", iterations);
+}
+
+static void benchAuthenticatedAs(long iterations)
+{
+    _meta__authenticated_as meta;
+    serializeMeta(meta, "meta:authenticated-as", iterations);
+}
+
+static void benchAuthenticatedBy(long iterations)
+{
+    _meta__authenticated_by meta;
+    serializeMeta(meta, "meta:authenticated-by", iterations);
+}
+
+static void benchCapability(long iterations)
+{
+    _meta__capability meta;
+    meta.name = "role1";
+    serializeMeta(meta, "meta:capability", iterations);
+}
+
+static void benchDeviceAttribute(long iterations)
+{
+    _meta__device_attribute meta;
+    meta.name = "av-signatures-out-of-date";
+    serializeMeta(meta, "meta:device-attribute", iterations);
+}
+
+static void benchEvent(long iterations)
+{
+    _meta__event meta;
+    _meta__event_type type = _meta__event_type__p2p;
+    meta.name = "p2p traffic";
+    meta.event_recorded_time = 1230768000;
+    meta.magnitude = "50";
+    meta.confidence = "100";
+    meta.significance = _meta__event_significance__important;
+    meta.type = &type;
+    meta.information = "BitTorrent";
+    serializeMeta(meta, "meta:event", iterations);
+}
+
+static void benchLayer2Information(long iterations)
+{
+    _meta__layer2_information meta;
+    meta.vlan = "100";
+    meta.port = "7";
+    serializeMeta(meta, "meta:layer2-information", iterations);
+}
+
+static void benchIpMac(long iterations)
+{
+    _meta__ip_mac meta;
+    time_t start = 1230768000;
+    time_t end = start + 86400;
+    meta.start_time = &start;
+    meta.end_time = &end;
+    meta.dhcp_server = "10.0.0.254";
+    serializeMeta(meta, "meta:ip-mac", iterations);
+}
+
+static void benchRole(long iterations)
+{
+    _meta__role meta;
+    meta.name = "employee";
+    serializeMeta(meta, "meta:role", iterations);
+}
+
+//
+// Envelopes of 100 items, serialized the way they are sent. The
+// requests are built in their own context, outside the timer, since
+// capturing resets the service's context.
+//
+
+static const int s_envelopeItems = 100;
+
+static void captureEnvelope(Service& service, ifmap__PublishRequestType* publishRequest,
+                            ifmap__SubscribeRequestType* subscribeRequest, long iterations)
+{
+    std::string xml;
+    resumeTimer();
+    for (long ii = 0; ii < iterations; ii++) {
+        int code = publishRequest
+            ? ifmapCapturePublish(service, publishRequest, xml)
+            : ifmapCaptureSubscribe(service, subscribeRequest, xml);
+        if (code != SOAP_OK) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+    }
+    pauseTimer();
+    soap_destroy(service.soap);
+    soap_end(service.soap);
+}
+
+static void benchPublishSessions(long iterations)
+{
+    pauseTimer();
+    Service service;
+    service.soap->omode |= SOAP_C_UTFSTRING;
+    struct soap soap;
+    MetadataCache metadata;
+    IdentifierTable identifiers;
+    IdentifierSlab slab;
+    std::vector<const char*> roles;
+    roles.push_back("role1");
+    roles.push_back("role2");
+
+    // The same updates load publishes to start each session.
+    std::vector<__ifmap__union_PublishRequestType> updates;
+    ifmap__IdentifierType* myIp
+        = identifiers.ipAddress(0, _ifmap__IPAddressType_type__IPv4, "10.255.255.1");
+    for (int ii = 0; ii < s_envelopeItems; ii++) {
+        ifmap__IdentifierType* accessRequest = slab.accessRequest(0, g_names[ii]);
+        addUpdate(updates, createIdentifierUpdate(&soap, accessRequest,
+                                                  metadata.capabilities(roles)));
+        addUpdate(updates, createLinkUpdate(
+                      &soap, accessRequest,
+                      slab.identity(0, _ifmap__IdentityType_type__username, g_names[ii]),
+                      metadata.constant<_meta__authenticated_as>("meta:authenticated-as")));
+        addUpdate(updates, createLinkUpdate(
+                      &soap, accessRequest,
+                      slab.ipAddress(0, _ifmap__IPAddressType_type__IPv4, g_ips[ii]),
+                      metadata.constant<_meta__access_request_ip>("meta:access-request-ip")));
+        addUpdate(updates, createLinkUpdate(
+                      &soap, accessRequest,
+                      slab.device(SOAP_UNION__ifmap__union_DeviceType_name, g_names[ii]),
+                      metadata.constant<_meta__access_request_device>(
+                          "meta:access-request-device")));
+        addUpdate(updates, createLinkUpdate(
+                      &soap, accessRequest, myIp,
+                      metadata.constant<_meta__authenticated_by>("meta:authenticated-by")));
+    }
+    ifmap__PublishRequestType publishRequest;
+    publishRequest.__size_PublishRequestType = updates.size();
+    publishRequest.__union_PublishRequestType = &updates[0];
+
+    captureEnvelope(service, &publishRequest, 0, iterations);
+    soap_destroy(&soap);
+    soap_end(&soap);
+}
+
+static void benchPublishIpMac(long iterations)
+{
+    pauseTimer();
+    Service service;
+    service.soap->omode |= SOAP_C_UTFSTRING;
+    MetadataCache metadata;
+    std::vector<IpMacBinding> bindings(s_envelopeItems);
+    std::vector<IpMacRequest> requests(s_envelopeItems);
+    std::vector<__ifmap__union_PublishRequestType> publishes(s_envelopeItems);
+    for (int ii = 0; ii < s_envelopeItems; ii++) {
+        char mac[20];
+        snprintf(mac, sizeof mac, "00:11:22:33:%02x:%02x", ii >> 8, ii & 255);
+        bindings[ii].ip = g_ips[ii];
+        bindings[ii].mac = mac;
+        buildIpMacPublish(metadata, bindings[ii], requests[ii], publishes[ii]);
+    }
+    ifmap__PublishRequestType publishRequest;
+    publishRequest.__size_PublishRequestType = publishes.size();
+    publishRequest.__union_PublishRequestType = &publishes[0];
+
+    captureEnvelope(service, &publishRequest, 0, iterations);
+}
+
+static void benchSubscribe(long iterations)
+{
+    pauseTimer();
+    Service service;
+    service.soap->omode |= SOAP_C_UTFSTRING;
+    struct soap soap;
+    IdentifierSlab slab;
+
+    // The subscriptions load makes to each session's access-request.
+    std::vector<__ifmap__union_SubscribeRequestType> subscriptions;
+    for (int ii = 0; ii < s_envelopeItems; ii++) {
+        char name[60];
+        snprintf(name, sizeof name, "o:%s", g_names[ii]);
+        _ifmap__SubscribeRequestType_update* update
+            = soap_new__ifmap__SubscribeRequestType_update(&soap, -1);
+        update->name = soap_strdup(&soap, name);
+        update->identifier = slab.accessRequest(0, g_names[ii]);
+        update->match_links = "meta:ip-mac or meta:access-request-ip or meta:access-request-mac"
+            " or meta:access-request-device or meta:authenticated-as";
+        update->result_filter = "meta:ip-mac or meta:event";
+        update->max_depth = "3";
+
+        __ifmap__union_SubscribeRequestType req;
+        req.__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_update;
+        req.union_SubscribeRequestType.update = update;
+        subscriptions.push_back(req);
+    }
+    ifmap__SubscribeRequestType subscribeRequest;
+    subscribeRequest.__size_SubscribeRequestType = subscriptions.size();
+    subscribeRequest.__union_SubscribeRequestType = &subscriptions[0];
+
+    captureEnvelope(service, 0, &subscribeRequest, iterations);
+    soap_destroy(&soap);
+    soap_end(&soap);
+}
+
+//
+// Poll responses of 100 search results, each an access-request with
+// two capabilities linked to an IP address that is linked to a MAC
+// address.
+//
+
+static void buildPollResponse(std::string& envelope)
+{
+    envelope = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://schemas.xmlsoap.org/soap/envelope/\""
+        " xmlns:ifmap=\"http://www.trustedcomputinggroup.org/2006/IFMAP/1\""
+        " xmlns:meta=\"http://www.trustedcomputinggroup.org/2006/IFMAP-METADATA/1\">"
+        "<SOAP-ENV:Header><ifmap:session-id>bench</ifmap:session-id></SOAP-ENV:Header>"
+        "<SOAP-ENV:Body><ifmap:response><pollResult>";
+    for (int ii = 0; ii < s_envelopeItems; ii++) {
+        char buf[2048];
+        snprintf(buf, sizeof buf,
+                 "<searchResult name=\"o:%s\">"
+                 "<identifierResult><identifier><access-request name=\"%s\"/></identifier>"
+                 "<metadata>"
+                 "<meta:capability ifmap-cardinality=\"multiValue\"><name>role1</name>"
+                 "</meta:capability>"
+                 "<meta:capability ifmap-cardinality=\"multiValue\"><name>role2</name>"
+                 "</meta:capability>"
+                 "</metadata></identifierResult>"
+                 "<linkResult><link><identifier><access-request name=\"%s\"/></identifier>"
+                 "<identifier><ip-address value=\"%s\" type=\"IPv4\"/></identifier></link>"
+                 "<metadata><meta:access-request-ip ifmap-cardinality=\"singleValue\"/>"
+                 "</metadata></linkResult>"
+                 "<linkResult><link><identifier><ip-address value=\"%s\" type=\"IPv4\"/>"
+                 "</identifier><identifier><mac-address value=\"00:11:22:33:%02x:%02x\"/>"
+                 "</identifier></link>"
+                 "<metadata><meta:ip-mac ifmap-cardinality=\"singleValue\">"
+                 "<start-time>2009-01-01T00:00:00Z</start-time>"
+                 "<end-time>2009-01-02T00:00:00Z</end-time>"
+                 "<dhcp-server>10.0.0.254</dhcp-server></meta:ip-mac>"
+                 "</metadata></linkResult>"
+                 "</searchResult>",
+                 g_names[ii], g_names[ii], g_names[ii], g_ips[ii], g_ips[ii],
+                 ii >> 8, ii & 255);
+        envelope += buf;
+    }
+    envelope += "</pollResult></ifmap:response></SOAP-ENV:Body></SOAP-ENV:Envelope>\n";
+}
+
+static void benchPollDeserialize(long iterations)
+{
+    pauseTimer();
+    Service service;
+    service.soap->imode |= SOAP_C_UTFSTRING | SOAP_DOM_NODE;
+    std::string envelope;
+    buildPollResponse(envelope);
+    char header[200];
+    snprintf(header, sizeof header,
+             "HTTP/1.1 200 OK\r\nContent-Type: text/xml; charset=utf-8\r\n"
+             "Content-Length: %lu\r\n\r\n", (unsigned long)envelope.size());
+    std::string http = header + envelope;
+    resumeTimer();
+
+    for (long ii = 0; ii < iterations; ii++) {
+        struct __wsdl__PollResponse response;
+        if (ifmapParsePoll(service, http, response) != SOAP_OK) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        soap_destroy(service.soap);
+        soap_end(service.soap);
+    }
+    pauseTimer();
+}
+
+static void benchPollStream(long iterations)
+{
+    pauseTimer();
+    PollResultHandler handler;
+    PollStreamParser parser(handler);
+    std::string envelope;
+    buildPollResponse(envelope);
+    resumeTimer();
+
+    for (long ii = 0; ii < iterations; ii++) {
+        parser.reset();
+        parser.feed(envelope.data(), envelope.size());
+        if (!parser.done() || parser.error()) {
+            fprintf(stderr, "Poll response did not parse: %s\n",
+                    parser.error() ? parser.error() : "incomplete");
+            exit(1);
+        }
+    }
+    pauseTimer();
+}
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)(long iterations);
+};
+
+static const Benchmark s_benchmarks[] = {
+    { "identifier/access-request", benchAccessRequest },
+    { "identifier/ip-address", benchIpAddress },
+    { "identifier/mac-address", benchMacAddress },
+    { "identifier/identity", benchIdentity },
+    { "identifier/device", benchDevice },
+    { "identifier/interned-ip-address", benchInternedIpAddress },
+    { "item/identifier-update", benchIdentifierUpdate },
+    { "item/link-update", benchLinkUpdate },
+    { "item/link-delete", benchLinkDelete },
+    { "metadata/capabilities", benchCapabilities },
+    { "metadata/cached-capabilities", benchCachedCapabilities },
+    { "soap-out/access-request-device", benchAccessRequestDevice },
+    { "soap-out/access-request-ip", benchAccessRequestIp },
+    { "soap-out/access-request-mac", benchAccessRequestMac },
+    { "soap-out/authenticated-as", benchAuthenticatedAs },
+    { "soap-out/authenticated-by", benchAuthenticatedBy },
+    { "soap-out/capability", benchCapability },
+    { "soap-out/device-attribute", benchDeviceAttribute },
+    { "soap-out/event", benchEvent },
+    { "soap-out/ip-mac", benchIpMac },
+    { "soap-out/layer2-information", benchLayer2Information },
+    { "soap-out/role", benchRole },
+    { "envelope/publish-sessions-100", benchPublishSessions },
+    { "envelope/publish-ip-mac-100", benchPublishIpMac },
+    { "envelope/subscribe-100", benchSubscribe },
+    { "poll/deserialize-100", benchPollDeserialize },
+    { "poll/stream-100", benchPollStream },
+};
+
+static Measurement measure(const Benchmark& benchmark, long iterations)
+{
+    memset(&g_measured, 0, sizeof g_measured);
+    resumeTimer();
+    benchmark.run(iterations);
+    return g_measured;
+}
+
+static bool byNanos(const Measurement& a, const Measurement& b)
+{
+    return a.nanos < b.nanos;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: ifmap-bench [ -t seconds ] [ -r runs ] [ name-prefix ... ]\n\n");
+    fprintf(stderr, "                   Times client-side request construction,\n"
+                    "                   serialization and response parsing in memory,\n"
+                    "                   without a server. Each benchmark whose name\n"
+                    "                   starts with a name-prefix (default all) runs\n"
+                    "                   enough iterations to take about seconds (default\n"
+                    "                   0.2), runs times (default 5), and the median run\n"
+                    "                   is reported as JSON on standard output.\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = 0.2;
+    int runs = 5;
+    argc--;
+    argv++;
+    while (argc > 0 && argv[0][0] == '-') {
+        const char* option = argv[0];
+        if (strcmp(option, "-t") == 0 && argc > 1) {
+            seconds = atof(argv[1]);
+        } else if (strcmp(option, "-r") == 0 && argc > 1) {
+            runs = atoi(argv[1]);
+        } else {
+            usage();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (seconds <= 0 || runs < 1) {
+        usage();
+    }
+    long long target = (long long)(seconds * 1e9);
+    buildNames();
+
+    printf("{\n  \"benchmarks\": [");
+    const char* separator = "\n";
+    for (size_t ii = 0; ii < sizeof s_benchmarks / sizeof s_benchmarks[0]; ii++) {
+        const Benchmark& benchmark = s_benchmarks[ii];
+        bool selected = argc == 0;
+        for (int jj = 0; jj < argc; jj++) {
+            if (strncmp(benchmark.name, argv[jj], strlen(argv[jj])) == 0) {
+                selected = true;
+            }
+        }
+        if (!selected) {
+            continue;
+        }
+
+        // Grow the iteration count until one run takes the target
+        // time, predicting from the last run but by at most 100x.
+        long iterations = 1;
+        for (;;) {
+            Measurement m = measure(benchmark, iterations);
+            if (m.nanos >= target || iterations >= 1000000000L) {
+                break;
+            }
+            double predicted = m.nanos > 0 ? 1.2 * target * iterations / m.nanos : 1e9;
+            long next = predicted < 100.0 * iterations ? (long)predicted : 100 * iterations;
+            iterations = std::max(next, iterations + 1);
+        }
+
+        std::vector<Measurement> results;
+        for (int jj = 0; jj < runs; jj++) {
+            results.push_back(measure(benchmark, iterations));
+        }
+        std::sort(results.begin(), results.end(), byNanos);
+        const Measurement& median = results[results.size() / 2];
+
+        printf("%s    { \"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f,"
+               " \"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f }",
+               separator, benchmark.name, iterations, (double)median.nanos / iterations,
+               (double)median.allocs / iterations, (double)median.bytes / iterations);
+        separator = ",\n";
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// Checks, without a server, what the state cache tells ip-mac, event
+// and ifmap-publisherd to send. Prints each check's outcome and exits
+// with status 1 if any failed.
+//
+
+#include <stdio.h>
+#include <string>
+#include "statecache.h"
+
+static const char* g_checkName;
+static bool g_failed;
+
+static void expect(bool ok, const char* what)
+{
+    if (!ok) {
+        printf("%s: FAILED: %s\n", g_checkName, what);
+        g_failed = true;
+    }
+}
+
+//
+// Deletes of keys never published are dropped on a new session, but
+// not on one attached to, nor after the server rejected the key.
+//
+static void checkDeletes()
+{
+    StateCache state;
+    state.reset(true);
+    expect(!state.needed("a", "", false), "delete of an unpublished key is dropped");
+    state.published("b", "1", true);
+    expect(state.needed("b", "", false), "delete of a published key is sent");
+    expect(!state.needed("b", "1", true), "repeated update is dropped");
+    expect(state.needed("b", "2", true), "update with a new value is sent");
+    state.forget("b");
+    expect(state.needed("b", "", false), "delete of a rejected key is sent");
+    state.reset(false);
+    expect(state.needed("a", "", false), "delete on an attached session is sent");
+}
+
+//
+// A batch recorded before its publish replaced an expired session, as
+// IfmapClient::publish() does when the server rejects a saved session,
+// is on the new session once published there.
+//
+static void checkReplacedSession()
+{
+    StateCache state;
+    state.reset(true);
+    state.published("old", "1", true);
+    state.beginBatch();
+    expect(state.needed("a", "1", true), "update in the batch is sent");
+    state.published("a", "1", true);
+    expect(state.needed("old", "", false), "delete in the batch is sent");
+    state.published("old", "", false);
+    state.reset(true);
+    state.endBatch();
+    expect(state.needed("a", "", false), "delete after the replaced batch is sent");
+    expect(!state.needed("a", "1", true), "update repeating the replaced batch is dropped");
+    expect(!state.needed("old", "", false), "delete of a key the batch deleted is dropped");
+
+    state.reset(true);
+    expect(!state.needed("a", "", false), "batch is not recorded again once ended");
+}
+
+struct Check
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Check s_checks[] = {
+    { "statecache/deletes", checkDeletes },
+    { "statecache/replaced-session", checkReplacedSession },
+};
+
+int main()
+{
+    bool failed = false;
+    for (size_t ii = 0; ii < sizeof s_checks / sizeof s_checks[0]; ii++) {
+        g_checkName = s_checks[ii].name;
+        g_failed = false;
+        s_checks[ii].run();
+        if (!g_failed) {
+            printf("%s: ok\n", g_checkName);
+        }
+        failed = failed || g_failed;
+    }
+    return failed ? 1 : 0;
+}
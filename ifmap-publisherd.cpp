@@ -0,0 +1,595 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// Publishes ip-mac and event commands from local clients over one
+// long-lived session. Commands arriving within a flush window are
+// coalesced and published together, in requests of at most the batch
+// size. See publisherd.h for the protocol.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "ifmap.nsmap"
+#include "client.h"
+#include "metacache.h"
+#include "histogram.h"
+#include "ipmac.h"
+#include "eventspec.h"
+#include "publishbatch.h"
+#include "publisherd.h"
+
+static void usage()
+{
+    fprintf(stderr, "usage: ifmap-publisherd [ --delta ] socket-path ifmap-server-url\n"
+                    "                        [ -b batch-size ] [ -t flush-ms ]\n"
+                    "                        [ -u user ] [ -p password ]\n\n");
+    fprintf(stderr, "       Commands received within flush-ms (default 100) of the first\n"
+                    "       one waiting are published together, at most batch-size\n"
+                    "       (default 1000) at a time. Set %s to\n"
+                    "       socket-path to make ip-mac and event use the daemon.\n"
+                    "       --delta answers updates already published, and deletes\n"
+                    "       of what was not published, in the session without\n"
+                    "       sending them.\n",
+            IFMAP_PUBLISHERD_SOCKET);
+    exit(1);
+}
+
+struct Connection
+{
+    long id;
+    int fd;
+    std::string input;
+    long commands;
+    long unanswered;
+    bool inputClosed;
+    bool broken;
+};
+
+//
+// A command waiting for the outcome of its publish.
+//
+struct Waiter
+{
+    long connectionId;
+    long command;
+};
+
+//
+// A publish or delete waiting for the next flush, along with every
+// command it stands for.
+//
+struct PendingOp
+{
+    PendingOp() : superseded(false) {}
+
+    bool isEvent;
+    IpMacBinding binding;
+    EventSpec event;
+    std::vector<Waiter> waiters;
+    // Replaced by a later delete, which now answers its waiters.
+    bool superseded;
+};
+
+static std::map<long, Connection*> g_connections;
+static long g_nextConnectionId = 1;
+
+static std::vector<PendingOp> g_pending;
+// The pending operations on each key, in order: at most one delete,
+// first, followed by distinct updates.
+static std::map<std::string, std::vector<size_t> > g_pendingByKey;
+static long long g_firstPendingAt = 0;
+static long g_pendingCommands = 0;
+static long g_flushes = 0;
+
+static void closeConnection(Connection* connection)
+{
+    close(connection->fd);
+    g_connections.erase(connection->id);
+    delete connection;
+}
+
+//
+// Answers a command, if its connection is still open. Replies are
+// small, so a client whose socket buffer is full is not reading them
+// and is dropped rather than waited for. The connection is closed by
+// the event loop, as it may still be in use here.
+//
+static void reply(const Waiter& waiter, const char* error)
+{
+    std::map<long, Connection*>::iterator it = g_connections.find(waiter.connectionId);
+    if (it == g_connections.end()) {
+        return;
+    }
+    char buf[1024];
+    int length;
+    if (error) {
+        length = snprintf(buf, sizeof buf, "%ld error %s", waiter.command, error);
+        if (length >= (int)sizeof buf) {
+            length = sizeof buf - 1;
+        }
+        // The reply must stay on one line.
+        for (char* p = buf; *p; p++) {
+            if (*p == '\n' || *p == '\r') {
+                *p = ' ';
+            }
+        }
+    } else {
+        length = snprintf(buf, sizeof buf, "%ld ok", waiter.command);
+    }
+    buf[length++] = '\n';
+    Connection* connection = it->second;
+    if (write(connection->fd, buf, length) != length) {
+        connection->broken = true;
+    }
+    // A client that has finished sending is closed once answered.
+    if (--connection->unanswered == 0 && connection->inputClosed) {
+        connection->broken = true;
+    }
+}
+
+static void replyAll(const PendingOp& op, const char* error)
+{
+    for (size_t ii = 0; ii < op.waiters.size(); ii++) {
+        reply(op.waiters[ii], error);
+    }
+}
+
+static bool opUpdate(const PendingOp& op)
+{
+    return op.isEvent ? op.event.update : op.binding.update;
+}
+
+static void opState(const PendingOp& op, std::string& key, std::string& value)
+{
+    if (op.isEvent) {
+        eventState(op.event, key, value);
+    } else {
+        ipMacState(op.binding, key, value);
+    }
+}
+
+//
+// Operations on the same link, or on the same event of an identifier,
+// have the same key. Metadata accumulates under a key, so within a
+// flush window only a delete replaces the operations before it, and
+// an update is merged only with an identical one.
+//
+static void addOp(PendingOp& op, const Waiter& waiter)
+{
+    if (g_pending.empty()) {
+        g_firstPendingAt = monotonicMicros();
+    }
+    g_pendingCommands++;
+    std::string key;
+    std::string value;
+    opState(op, key, value);
+    std::vector<size_t>& indexes = g_pendingByKey[key];
+    size_t ii;
+    if (!opUpdate(op) && !indexes.empty()) {
+        PendingOp& first = g_pending[indexes[0]];
+        op.waiters.swap(first.waiters);
+        for (ii = 1; ii < indexes.size(); ii++) {
+            PendingOp& earlier = g_pending[indexes[ii]];
+            op.waiters.insert(op.waiters.end(), earlier.waiters.begin(), earlier.waiters.end());
+            earlier.waiters.clear();
+            earlier.superseded = true;
+        }
+        op.waiters.push_back(waiter);
+        first = op;
+        indexes.resize(1);
+        return;
+    }
+    if (opUpdate(op)) {
+        std::string earlierKey;
+        std::string earlierValue;
+        for (ii = 0; ii < indexes.size(); ii++) {
+            PendingOp& earlier = g_pending[indexes[ii]];
+            if (opUpdate(earlier)) {
+                opState(earlier, earlierKey, earlierValue);
+                if (earlierValue == value) {
+                    earlier.waiters.push_back(waiter);
+                    return;
+                }
+            }
+        }
+    }
+    op.waiters.push_back(waiter);
+    indexes.push_back(g_pending.size());
+    g_pending.push_back(op);
+}
+
+static void runCommand(Connection& connection, char* line)
+{
+    Waiter waiter;
+    waiter.connectionId = connection.id;
+    waiter.command = ++connection.commands;
+    connection.unanswered++;
+
+    PendingOp op;
+    const char* error = 0;
+    if (strncmp(line, "ip-mac ", 7) == 0) {
+        op.isEvent = false;
+        if (!parseIpMacBinding(line + 7, op.binding)) {
+            error = "expected \"ip-mac update|delete ip-address mac-address\"";
+        }
+    } else if (strncmp(line, "event ", 6) == 0) {
+        op.isEvent = true;
+        if (!parseEvent(line + 6, op.event)) {
+            error = "malformed event";
+        } else {
+            error = checkEvent(op.event);
+        }
+    } else {
+        error = "unknown command";
+    }
+    if (error) {
+        reply(waiter, error);
+        return;
+    }
+    addOp(op, waiter);
+}
+
+//
+// Remembers the server's reason for each operation it rejects.
+//
+class OpRejections : public RejectionHandler
+{
+public:
+    OpRejections(std::vector<std::string>& errors) : m_errors(errors) {}
+
+    virtual void rejected(long index, IfmapClient& client)
+    {
+        m_errors[index] = client.faultString();
+    }
+
+private:
+    std::vector<std::string>& m_errors;
+};
+
+//
+// Publishes ops[0] through ops[count - 1] in one request and answers
+// their commands. Returns the number the server rejected, or -1 if the
+// request failed for another reason, leaving them unanswered.
+//
+static long publishOps(IfmapClient& client, PendingOp** ops, long count, StateCache* state)
+{
+    MetadataCache metadata;
+    std::vector<IpMacRequest> ipMacRequests(count);
+    std::vector<EventRequest> eventRequests(count);
+    std::vector<__ifmap__union_PublishRequestType> publishes(count);
+    long ii;
+    for (ii = 0; ii < count; ii++) {
+        if (ops[ii]->isEvent) {
+            buildEventPublish(metadata, ops[ii]->event, eventRequests[ii], publishes[ii]);
+        } else {
+            buildIpMacPublish(metadata, ops[ii]->binding, ipMacRequests[ii], publishes[ii]);
+        }
+    }
+    std::vector<std::string> errors(count);
+    OpRejections rejections(errors);
+    long rejected = publishBatch(client, &publishes[0], count, rejections);
+    if (rejected == -1) {
+        return -1;
+    }
+    std::string key;
+    std::string value;
+    for (ii = 0; ii < count; ii++) {
+        if (!errors[ii].empty()) {
+            if (state) {
+                opState(*ops[ii], key, value);
+                state->forget(key);
+            }
+            replyAll(*ops[ii], errors[ii].c_str());
+            continue;
+        }
+        replyAll(*ops[ii], 0);
+    }
+    return rejected;
+}
+
+//
+// Publishes everything pending, batchSize operations per request, and
+// answers the commands. With a state cache, operations that would not
+// change what the server holds are answered without being sent. If the
+// connection fails, the operations not yet published are answered with
+// the error, and the session is started again, and the cache emptied,
+// on the next flush.
+//
+// Requests are sent and answered synchronously, so no commands are read
+// from any client until the flush is over.
+//
+static void flush(IfmapClient& client, bool& connected, long batchSize)
+{
+    long long start = monotonicMicros();
+    long rejected = 0;
+    long suppressed = 0;
+    if (!connected) {
+        connected = client.newSession() == SOAP_OK;
+    }
+    StateCache* state = connected ? client.stateCache() : 0;
+    std::string key;
+    std::string value;
+    std::vector<PendingOp*> ops;
+    size_t ii;
+    for (ii = 0; ii < g_pending.size(); ii++) {
+        if (g_pending[ii].superseded) {
+            continue;
+        }
+        if (state) {
+            opState(g_pending[ii], key, value);
+            if (!state->needed(key, value, opUpdate(g_pending[ii]))) {
+                replyAll(g_pending[ii], 0);
+                suppressed++;
+                continue;
+            }
+            state->published(key, value, opUpdate(g_pending[ii]));
+        }
+        ops.push_back(&g_pending[ii]);
+    }
+    long count = ops.size();
+    long published = 0;
+    while (connected && published < count) {
+        long slice = count - published < batchSize ? count - published : batchSize;
+        long sliceRejected = publishOps(client, &ops[published], slice, state);
+        if (sliceRejected == -1) {
+            connected = false;
+        } else {
+            rejected += sliceRejected;
+            published += slice;
+        }
+    }
+    if (!connected) {
+        fprintf(stderr, "Could not publish:\n");
+        client.printFault(stderr);
+        std::string error = client.faultString();
+        for (ii = published; ii < ops.size(); ii++) {
+            replyAll(*ops[ii], error.c_str());
+        }
+        client.reset();
+        rejected += count - published;
+    }
+
+    g_flushes++;
+    printf("Flush %ld: %ld commands, %ld operations, %ld suppressed, %ld failed, %.1f ms\n",
+           g_flushes, g_pendingCommands, count, suppressed, rejected,
+           (monotonicMicros() - start) / 1000.0);
+    fflush(stdout);
+    g_pending.clear();
+    g_pendingByKey.clear();
+    g_pendingCommands = 0;
+}
+
+static int listenOn(const char* path)
+{
+    sockaddr_un addr;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        exit(1);
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        exit(1);
+    }
+    unlink(path);
+    if (bind(fd, (sockaddr*)&addr, sizeof addr) == -1 || listen(fd, SOMAXCONN) == -1) {
+        perror(path);
+        exit(1);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void acceptConnections(int epollFd, int listenFd)
+{
+    while (true) {
+        int fd = accept(listenFd, 0, 0);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+            }
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        Connection* connection = new Connection;
+        connection->id = g_nextConnectionId++;
+        connection->fd = fd;
+        connection->commands = 0;
+        connection->unanswered = 0;
+        connection->inputClosed = false;
+        connection->broken = false;
+        g_connections[connection->id] = connection;
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            perror("epoll_ctl");
+            closeConnection(connection);
+        }
+    }
+}
+
+//
+// Reads commands from a client until it has no more for now.
+//
+static void readCommands(int epollFd, Connection& connection)
+{
+    while (!connection.broken) {
+        char buf[65536];
+        ssize_t count = read(connection.fd, buf, sizeof buf);
+        if (count == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                connection.broken = true;
+            }
+            return;
+        }
+        if (count == 0) {
+            // The client may still be waiting for answers.
+            connection.inputClosed = true;
+            connection.broken = connection.unanswered == 0;
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, 0);
+            return;
+        }
+        connection.input.append(buf, count);
+        size_t begin = 0;
+        size_t nl;
+        while ((nl = connection.input.find('\n', begin)) != std::string::npos) {
+            connection.input[nl] = '\0';
+            runCommand(connection, &connection.input[begin]);
+            begin = nl + 1;
+        }
+        connection.input.erase(0, begin);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool delta = false;
+    if (argc > 1 && strcmp(argv[1], "--delta") == 0) {
+        delta = true;
+        argc--;
+        argv++;
+    }
+    if (argc < 3) {
+        usage();
+    }
+    char* socketPath = argv[1];
+    char* url = argv[2];
+    long batchSize = 1000;
+    int flushMillis = 100;
+    char* user = 0;
+    char* password = 0;
+    argv += 2;
+    argc -= 2;
+    while (--argc) {
+        char* option = *++argv;
+        if (!--argc) {
+            usage();
+        }
+        char* argument = *++argv;
+        if (strcmp(option, "-b") == 0) {
+            batchSize = atol(argument);
+        } else if (strcmp(option, "-t") == 0) {
+            flushMillis = atoi(argument);
+        } else if (strcmp(option, "-u") == 0) {
+            user = argument;
+        } else if (strcmp(option, "-p") == 0) {
+            password = argument;
+        } else {
+            usage();
+        }
+    }
+    if (batchSize < 1 || flushMillis < 0) {
+        usage();
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    IfmapClient client(url, user, password);
+    StateCache state;
+    if (delta) {
+        client.setStateCache(&state);
+    }
+    if (client.newSession() != SOAP_OK) {
+        client.printFault(stderr);
+        return 1;
+    }
+    bool connected = true;
+    printf("got session id: %s\n", client.sessionId());
+    fflush(stdout);
+
+    int listenFd = listenOn(socketPath);
+    int epollFd = epoll_create(64);
+    if (epollFd == -1) {
+        perror("epoll_create");
+        return 1;
+    }
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = 0;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == -1) {
+        perror("epoll_ctl");
+        return 1;
+    }
+
+    while (true) {
+        int timeout = -1;
+        if (!g_pending.empty()) {
+            long long wait = g_firstPendingAt + flushMillis * 1000LL - monotonicMicros();
+            timeout = wait > 0 ? (int)((wait + 999) / 1000) : 0;
+        }
+        epoll_event events[64];
+        int n = epoll_wait(epollFd, events, 64, timeout);
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            return 1;
+        }
+        for (int ii = 0; ii < n; ii++) {
+            Connection* connection = (Connection*)events[ii].data.ptr;
+            if (!connection) {
+                acceptConnections(epollFd, listenFd);
+            } else {
+                readCommands(epollFd, *connection);
+            }
+            if ((long)g_pending.size() >= batchSize) {
+                flush(client, connected, batchSize);
+            }
+        }
+        if (!g_pending.empty()
+            && monotonicMicros() >= g_firstPendingAt + flushMillis * 1000LL) {
+            flush(client, connected, batchSize);
+        }
+        std::map<long, Connection*>::iterator it = g_connections.begin();
+        while (it != g_connections.end()) {
+            Connection* connection = (it++)->second;
+            if (connection->broken) {
+                closeConnection(connection);
+            }
+        }
+    }
+    return 0;
+}
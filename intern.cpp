@@ -0,0 +1,234 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "intern.h"
+
+static const size_t s_textChunkSize = 4096;
+
+IdentifierSlab::IdentifierSlab()
+    : m_textChunk(0), m_textUsed(0), m_allocations(0)
+{
+}
+
+IdentifierSlab::~IdentifierSlab()
+{
+    reset();
+    for (size_t ii = 0; ii < m_text.size(); ii++) {
+        delete[] m_text[ii];
+    }
+}
+
+void IdentifierSlab::reset()
+{
+    m_identifiers.reset();
+    m_accessRequests.reset();
+    m_ipAddresses.reset();
+    m_macAddresses.reset();
+    m_identities.reset();
+    m_devices.reset();
+    for (size_t ii = 0; ii < m_longText.size(); ii++) {
+        delete[] m_longText[ii];
+    }
+    m_longText.clear();
+    m_textChunk = 0;
+    m_textUsed = 0;
+}
+
+//
+// Returns a copy of text in the slab, or 0 for 0 or an empty string.
+//
+char* IdentifierSlab::copy(const char* text)
+{
+    if (!text || !*text) {
+        return 0;
+    }
+    size_t size = strlen(text) + 1;
+    char* result;
+    if (size > s_textChunkSize) {
+        result = new char[size];
+        m_longText.push_back(result);
+        m_allocations++;
+    } else {
+        if (m_textChunk < m_text.size() && m_textUsed + size > s_textChunkSize) {
+            m_textChunk++;
+            m_textUsed = 0;
+        }
+        if (m_textChunk == m_text.size()) {
+            m_text.push_back(new char[s_textChunkSize]);
+            m_allocations++;
+        }
+        result = m_text[m_textChunk] + m_textUsed;
+        m_textUsed += size;
+    }
+    memcpy(result, text, size);
+    return result;
+}
+
+ifmap__IdentifierType* IdentifierSlab::accessRequest(const char* domain, const char* name)
+{
+    ifmap__AccessRequestType* accessRequest = m_accessRequests.get(m_allocations);
+    accessRequest->administrative_domain = copy(domain);
+    accessRequest->name = copy(name);
+    ifmap__IdentifierType* identifier = m_identifiers.get(m_allocations);
+    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_access_request;
+    identifier->union_IdentifierType.access_request = accessRequest;
+    return identifier;
+}
+
+ifmap__IdentifierType* IdentifierSlab::ipAddress(const char* domain, int type, const char* value)
+{
+    ifmap__IPAddressType* ipAddr = m_ipAddresses.get(m_allocations);
+    ipAddr->administrative_domain = copy(domain);
+    ipAddr->type = static_cast<_ifmap__IPAddressType_type>(type);
+    ipAddr->value = copy(value);
+    ifmap__IdentifierType* identifier = m_identifiers.get(m_allocations);
+    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
+    identifier->union_IdentifierType.ip_address = ipAddr;
+    return identifier;
+}
+
+ifmap__IdentifierType* IdentifierSlab::macAddress(const char* domain, const char* value)
+{
+    ifmap__MACAddressType* macAddr = m_macAddresses.get(m_allocations);
+    macAddr->administrative_domain = copy(domain);
+    macAddr->value = copy(value);
+    ifmap__IdentifierType* identifier = m_identifiers.get(m_allocations);
+    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_mac_address;
+    identifier->union_IdentifierType.mac_address = macAddr;
+    return identifier;
+}
+
+ifmap__IdentifierType* IdentifierSlab::identity(const char* domain, int type, const char* name,
+                                                const char* other)
+{
+    ifmap__IdentityType* identity = m_identities.get(m_allocations);
+    identity->administrative_domain = copy(domain);
+    identity->name = copy(name);
+    identity->type = static_cast<_ifmap__IdentityType_type>(type);
+    identity->other_type_definition = copy(other);
+    ifmap__IdentifierType* identifier = m_identifiers.get(m_allocations);
+    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_identity;
+    identifier->union_IdentifierType.identity = identity;
+    return identifier;
+}
+
+ifmap__IdentifierType* IdentifierSlab::device(int type, const char* name)
+{
+    ifmap__DeviceType* device = m_devices.get(m_allocations);
+    device->__union_DeviceType = type;
+    char* deviceName = copy(name);
+    if (type == SOAP_UNION__ifmap__union_DeviceType_name) {
+        device->union_DeviceType.name = deviceName;
+    } else {
+        device->union_DeviceType.aik_name = deviceName;
+    }
+    ifmap__IdentifierType* identifier = m_identifiers.get(m_allocations);
+    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_device;
+    identifier->union_IdentifierType.device = device;
+    return identifier;
+}
+
+IdentifierTable::IdentifierTable()
+    : m_hits(0), m_misses(0)
+{
+}
+
+//
+// Returns the table's entry for the identifier, which is 0 if it has
+// not been built yet. kind tells the identifier types apart.
+//
+ifmap__IdentifierType** IdentifierTable::find(char kind, int type, const char* domain,
+                                              const char* value, const char* other)
+{
+    m_key.assign(1, kind);
+    m_key += (char)('0' + type);
+    m_key += domain ? domain : "";
+    m_key += '\0';
+    m_key += value;
+    if (other) {
+        m_key += '\0';
+        m_key += other;
+    }
+    ifmap__IdentifierType*& identifier = m_identifiers[m_key];
+    if (identifier) {
+        m_hits++;
+    } else {
+        m_misses++;
+    }
+    return &identifier;
+}
+
+ifmap__IdentifierType* IdentifierTable::accessRequest(const char* domain, const char* name)
+{
+    ifmap__IdentifierType** identifier = find('a', 0, domain, name, 0);
+    if (!*identifier) {
+        *identifier = m_slab.accessRequest(domain, name);
+    }
+    return *identifier;
+}
+
+ifmap__IdentifierType* IdentifierTable::ipAddress(const char* domain, int type, const char* value)
+{
+    ifmap__IdentifierType** identifier = find('i', type, domain, value, 0);
+    if (!*identifier) {
+        *identifier = m_slab.ipAddress(domain, type, value);
+    }
+    return *identifier;
+}
+
+ifmap__IdentifierType* IdentifierTable::macAddress(const char* domain, const char* value)
+{
+    ifmap__IdentifierType** identifier = find('m', 0, domain, value, 0);
+    if (!*identifier) {
+        *identifier = m_slab.macAddress(domain, value);
+    }
+    return *identifier;
+}
+
+ifmap__IdentifierType* IdentifierTable::identity(const char* domain, int type, const char* name,
+                                                 const char* other)
+{
+    ifmap__IdentifierType** identifier = find('u', type, domain, name, other);
+    if (!*identifier) {
+        *identifier = m_slab.identity(domain, type, name, other);
+    }
+    return *identifier;
+}
+
+ifmap__IdentifierType* IdentifierTable::device(int type, const char* name)
+{
+    ifmap__IdentifierType** identifier = find('d', type, 0, name, 0);
+    if (!*identifier) {
+        *identifier = m_slab.device(type, name);
+    }
+    return *identifier;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_intern_h__
+#define ifmap_intern_h__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ifmapH.h"
+
+/*
+ * Identifiers for one request, such as the names of a single session.
+ * They are carved from chunks that reset() makes available again, so
+ * once a slab has grown to the size of the largest request, building
+ * identifiers allocates nothing. Strings are copied into the slab.
+ *
+ * Identifiers are only valid until reset(). Domains and other type
+ * definitions are left out when 0 or empty. Not thread safe; keep one
+ * per thread.
+ */
+class IdentifierSlab
+{
+public:
+    IdentifierSlab();
+    ~IdentifierSlab();
+
+    ifmap__IdentifierType* accessRequest(const char* domain, const char* name);
+    ifmap__IdentifierType* ipAddress(const char* domain, int type, const char* value);
+    ifmap__IdentifierType* macAddress(const char* domain, const char* value);
+    ifmap__IdentifierType* identity(const char* domain, int type, const char* name,
+                                    const char* other = 0);
+
+    /*
+     * type is SOAP_UNION__ifmap__union_DeviceType_name or _aik_name.
+     */
+    ifmap__IdentifierType* device(int type, const char* name);
+
+    void reset();
+
+    /*
+     * Chunks allocated since the slab was created.
+     */
+    long long allocations() const { return m_allocations; }
+
+private:
+    IdentifierSlab(const IdentifierSlab&);
+    IdentifierSlab& operator=(const IdentifierSlab&);
+
+    template <class T>
+    class Pool
+    {
+    public:
+        Pool() : m_used(0) {}
+
+        ~Pool()
+        {
+            for (size_t ii = 0; ii < m_chunks.size(); ii++) {
+                delete[] m_chunks[ii];
+            }
+        }
+
+        T* get(long long& allocations)
+        {
+            if (m_used == m_chunks.size() * CHUNK_SIZE) {
+                m_chunks.push_back(new T[CHUNK_SIZE]);
+                allocations++;
+            }
+            T* item = &m_chunks[m_used / CHUNK_SIZE][m_used % CHUNK_SIZE];
+            m_used++;
+            *item = T();
+            return item;
+        }
+
+        void reset() { m_used = 0; }
+
+    private:
+        enum { CHUNK_SIZE = 64 };
+
+        std::vector<T*> m_chunks;
+        size_t m_used;
+    };
+
+    char* copy(const char* text);
+
+    Pool<ifmap__IdentifierType> m_identifiers;
+    Pool<ifmap__AccessRequestType> m_accessRequests;
+    Pool<ifmap__IPAddressType> m_ipAddresses;
+    Pool<ifmap__MACAddressType> m_macAddresses;
+    Pool<ifmap__IdentityType> m_identities;
+    Pool<ifmap__DeviceType> m_devices;
+
+    // Strings longer than a chunk get a chunk of their own, which
+    // reset() frees.
+    std::vector<char*> m_text;
+    std::vector<char*> m_longText;
+    size_t m_textChunk;
+    size_t m_textUsed;
+    long long m_allocations;
+};
+
+/*
+ * Identifiers shared by many requests, such as the client's own IP
+ * address, built once and then handed out as the same immutable
+ * instance to every request that asks for the same identifier. The
+ * key is the type, administrative domain and value, along with the
+ * identity type or device name kind.
+ *
+ * Requests only read the identifiers, which live as long as the
+ * table. Not thread safe; keep one per thread.
+ */
+class IdentifierTable
+{
+public:
+    IdentifierTable();
+
+    ifmap__IdentifierType* accessRequest(const char* domain, const char* name);
+    ifmap__IdentifierType* ipAddress(const char* domain, int type, const char* value);
+    ifmap__IdentifierType* macAddress(const char* domain, const char* value);
+    ifmap__IdentifierType* identity(const char* domain, int type, const char* name,
+                                    const char* other = 0);
+    ifmap__IdentifierType* device(int type, const char* name);
+
+    size_t size() const { return m_identifiers.size(); }
+    long long hits() const { return m_hits; }
+    long long misses() const { return m_misses; }
+
+private:
+    ifmap__IdentifierType** find(char kind, int type, const char* domain, const char* value,
+                                 const char* other);
+
+    IdentifierSlab m_slab;
+    std::map<std::string, ifmap__IdentifierType*> m_identifiers;
+    std::string m_key;
+    long long m_hits;
+    long long m_misses;
+};
+
+#endif /*ifmap_intern_h__*/
@@ -31,19 +31,356 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 #include "ifmap.nsmap"
-#include "ifmapServiceProxy.h"
-#include "connect.h"
+#include "client.h"
+#include "tlscache.h"
+#include "metacache.h"
+#include "histogram.h"
+#include "ipmac.h"
+#include "publishbatch.h"
+#include "publisherd.h"
 
 static void usage()
 {
-    fprintf(stderr, "usage: ip-mac update|delete ifmap-server-url ip-address mac-address [ user password ]\n");
+    fprintf(stderr, "usage: ip-mac [ --tls-cache file ] [ --session-file file ]\n"
+                    "              update|delete ifmap-server-url ip-address mac-address\n"
+                    "              [ user password ]\n");
+    fprintf(stderr, "       ip-mac [ --tls-cache file ] [ --session-file file ] [ --delta ]\n"
+                    "              --stream ifmap-server-url [ -f file ] [ -b batch-size ]\n"
+                    "              [ -t flush-ms ] [ -u user ] [ -p password ]\n\n");
+    fprintf(stderr, "              --stream reads \"update|delete ip-address mac-address\"\n"
+                    "              lines from file, or standard input, and publishes\n"
+                    "              them batch-size (default 1000) at a time, or after\n"
+                    "              flush-ms (default 1000) when input is slower.\n"
+                    "              --delta drops updates already published, and\n"
+                    "              deletes of links not published, in the session.\n");
     exit(1);
 }
 
+struct StreamStats
+{
+    StreamStats() : lines(0), published(0), suppressed(0), failed(0), batches(0) {}
+
+    long lines;
+    long published;
+    long suppressed;
+    long failed;
+    long batches;
+};
+
+//
+// Reports the bindings the server rejects by line number.
+//
+class BindingRejections : public RejectionHandler
+{
+public:
+    BindingRejections(const IpMacBinding* bindings, std::vector<bool>& rejected)
+        : m_bindings(bindings), m_rejected(rejected) {}
+
+    virtual void rejected(long index, IfmapClient& client)
+    {
+        fprintf(stderr, "line %ld: ", m_bindings[index].lineNum);
+        client.printFault(stderr);
+        m_rejected[index] = true;
+    }
+
+private:
+    const IpMacBinding* m_bindings;
+    std::vector<bool>& m_rejected;
+};
+
+//
+// Publishes bindings in one request, finding the lines the server
+// rejects if it does and marking them in rejected. Errors other than
+// rejections are fatal.
+//
+// Returns the number of bindings that were rejected.
+//
+static long publishBindings(IfmapClient& client, MetadataCache& metadata,
+                            const IpMacBinding* bindings, long count,
+                            std::vector<bool>& rejected)
+{
+    std::vector<IpMacRequest> requests(count);
+    std::vector<__ifmap__union_PublishRequestType> publishes(count);
+    long ii;
+    for (ii = 0; ii < count; ii++) {
+        buildIpMacPublish(metadata, bindings[ii], requests[ii], publishes[ii]);
+    }
+    BindingRejections rejections(bindings, rejected);
+    long numRejected = publishBatch(client, &publishes[0], count, rejections);
+    if (numRejected == -1) {
+        fprintf(stderr, "Could not publish lines %ld-%ld:\n",
+                bindings[0].lineNum, bindings[count - 1].lineNum);
+        client.printFault(stderr);
+        exit(1);
+    }
+    return numRejected;
+}
+
+//
+// Publishes the pending bindings, leaving out those that would not
+// change what the server holds when the client has a state cache.
+//
+static void flushBindings(IfmapClient& client, MetadataCache& metadata,
+                          std::vector<IpMacBinding>& pending, StreamStats& stats)
+{
+    long long start = monotonicMicros();
+    long firstLine = pending.front().lineNum;
+    long lastLine = pending.back().lineNum;
+    long lines = pending.size();
+    StateCache* state = client.stateCache();
+    std::string key;
+    std::string value;
+    size_t ii;
+    if (state) {
+        // Each line is recorded as it is kept, so that a later line in
+        // the batch is checked against what the earlier ones will do.
+        size_t kept = 0;
+        state->beginBatch();
+        for (ii = 0; ii < pending.size(); ii++) {
+            ipMacState(pending[ii], key, value);
+            if (state->needed(key, value, pending[ii].update)) {
+                state->published(key, value, pending[ii].update);
+                pending[kept++] = pending[ii];
+            }
+        }
+        pending.resize(kept);
+    }
+
+    long count = pending.size();
+    std::vector<bool> rejected(count);
+    long failed = count ? publishBindings(client, metadata, &pending[0], count, rejected) : 0;
+    if (state) {
+        for (ii = 0; ii < pending.size(); ii++) {
+            if (rejected[ii]) {
+                ipMacState(pending[ii], key, value);
+                state->forget(key);
+            }
+        }
+        state->endBatch();
+    }
+    double secs = (monotonicMicros() - start) / 1000000.0;
+
+    stats.batches++;
+    stats.published += count - failed;
+    stats.suppressed += lines - count;
+    stats.failed += failed;
+    printf("Batch %ld: lines %ld-%ld, %ld published, %ld suppressed, %ld failed,"
+           " %.1f ms, %.0f/s\n",
+           stats.batches, firstLine, lastLine, count - failed, lines - count, failed,
+           secs * 1000.0, secs > 0 ? lines / secs : 0.0);
+    fflush(stdout);
+    pending.clear();
+}
+
+//
+// Parses a line of --stream input onto pending. Returns false and
+// reports the line if it is malformed. Blank lines and lines starting
+// with # are skipped without an error.
+//
+static bool parseBinding(char* line, long lineNum, std::vector<IpMacBinding>& pending, bool& skipped)
+{
+    line += strspn(line, " \t\r");
+    skipped = !*line || *line == '#';
+    if (skipped) {
+        return true;
+    }
+    IpMacBinding binding;
+    binding.lineNum = lineNum;
+    if (!parseIpMacBinding(line, binding)) {
+        fprintf(stderr, "line %ld: expected \"update|delete ip-address mac-address\"\n", lineNum);
+        return false;
+    }
+    pending.push_back(binding);
+    return true;
+}
+
+//
+// Publishes the bindings read from fd until end of file. A batch is
+// sent when it is full, or flushMillis after its first line was read
+// if input stops before then.
+//
+// Returns false if any line failed.
+//
+static bool streamBindings(IfmapClient& client, int fd, long batchSize, int flushMillis)
+{
+    MetadataCache metadata;
+    StreamStats stats;
+    std::vector<IpMacBinding> pending;
+    pending.reserve(batchSize);
+    std::string input;
+    long long firstPendingAt = 0;
+    long long start = monotonicMicros();
+    bool eof = false;
+
+    while (!eof || !pending.empty()) {
+        int timeout = -1;
+        if (!pending.empty()) {
+            long long wait = firstPendingAt + flushMillis * 1000LL - monotonicMicros();
+            timeout = wait > 0 ? (int)((wait + 999) / 1000) : 0;
+        }
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        int ready = eof ? 0 : poll(&pfd, 1, timeout);
+        if (ready == -1 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+        if (ready > 0) {
+            char buf[65536];
+            ssize_t count = read(fd, buf, sizeof buf);
+            if (count == -1) {
+                if (errno == EINTR || errno == EAGAIN) {
+                    continue;
+                }
+                perror("read");
+                exit(1);
+            }
+            input.append(buf, count);
+            if (count == 0) {
+                eof = true;
+                if (!input.empty() && input[input.size() - 1] != '\n') {
+                    input += '\n';
+                }
+            }
+            size_t begin = 0;
+            size_t nl;
+            while ((nl = input.find('\n', begin)) != std::string::npos) {
+                input[nl] = '\0';
+                stats.lines++;
+                bool skipped;
+                if (!parseBinding(&input[begin], stats.lines, pending, skipped)) {
+                    stats.failed++;
+                } else if (!skipped && pending.size() == 1) {
+                    firstPendingAt = monotonicMicros();
+                }
+                begin = nl + 1;
+                if ((long)pending.size() >= batchSize) {
+                    flushBindings(client, metadata, pending, stats);
+                }
+            }
+            input.erase(0, begin);
+        }
+        if (!pending.empty()
+            && (eof || monotonicMicros() >= firstPendingAt + flushMillis * 1000LL)) {
+            flushBindings(client, metadata, pending, stats);
+        }
+    }
+
+    double secs = (monotonicMicros() - start) / 1000000.0;
+    printf("Published %ld of %ld lines in %ld batches, %.1f s, %.0f/s, %ld suppressed,"
+           " %ld failed\n",
+           stats.published, stats.lines, stats.batches, secs,
+           secs > 0 ? stats.published / secs : 0.0, stats.suppressed, stats.failed);
+    return stats.failed == 0;
+}
+
+//
+// Options for --stream mode follow the url, in the style of event's.
+//
+static int runStream(int argc, char* argv[], TlsSessionCache* tlsCache, const char* sessionFile,
+                     bool delta)
+{
+    if (argc < 3) {
+        usage();
+    }
+    char* url = argv[2];
+    const char* file = 0;
+    long batchSize = 1000;
+    int flushMillis = 1000;
+    char* user = 0;
+    char* password = 0;
+    argv += 2;
+    argc -= 2;
+    while (--argc) {
+        char* option = *++argv;
+        if (!--argc) {
+            usage();
+        }
+        char* argument = *++argv;
+        if (strcmp(option, "-f") == 0) {
+            file = argument;
+        } else if (strcmp(option, "-b") == 0) {
+            batchSize = atol(argument);
+        } else if (strcmp(option, "-t") == 0) {
+            flushMillis = atoi(argument);
+        } else if (strcmp(option, "-u") == 0) {
+            user = argument;
+        } else if (strcmp(option, "-p") == 0) {
+            password = argument;
+        } else {
+            usage();
+        }
+    }
+    if (batchSize < 1 || flushMillis < 0) {
+        usage();
+    }
+
+    int fd = STDIN_FILENO;
+    if (file) {
+        fd = open(file, O_RDONLY);
+        if (fd == -1) {
+            perror(file);
+            return 1;
+        }
+    }
+
+    IfmapClient client(url, user, password);
+    StateCache state;
+    if (delta) {
+        client.setStateCache(&state);
+    }
+    if (tlsCache) {
+        tlsCache->use(client.soap());
+    }
+    int code = sessionFile ? client.openSession(sessionFile) : client.newSession();
+    if (tlsCache) {
+        tlsCache->report(stderr);
+    }
+    if (code != SOAP_OK) {
+        client.printFault(stderr);
+        return 1;
+    }
+    bool ok = streamBindings(client, fd, batchSize, flushMillis);
+    if (tlsCache) {
+        tlsCache->save(client.soap());
+    }
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 5 && argc != 7) {
+    TlsSessionCache* tlsCache = 0;
+    const char* sessionFile = 0;
+    bool delta = false;
+    while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--stream") == 0) {
+            return runStream(argc, argv, tlsCache, sessionFile, delta);
+        } else if (strcmp(argv[1], "--delta") == 0) {
+            delta = true;
+            argc--;
+            argv++;
+            continue;
+        } else if (strcmp(argv[1], "--tls-cache") == 0) {
+            tlsCache = new TlsSessionCache(argv[2]);
+        } else if (strcmp(argv[1], "--session-file") == 0) {
+            sessionFile = argv[2];
+        } else {
+            usage();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    // --delta only applies to --stream.
+    if (delta || (argc != 5 && argc != 7)) {
         usage();
     }
 
@@ -52,8 +389,10 @@ int main(int argc, char* argv[])
         usage();
     }
     char* url = argv[2];
-    char* ipArg = argv[3];
-    char* macArg = argv[4];
+    IpMacBinding binding;
+    binding.update = strcmp(op, "update") == 0;
+    binding.ip = argv[3];
+    binding.mac = argv[4];
     char* user = 0;
     char* password = 0;
     if (argc == 7) {
@@ -61,74 +400,43 @@ int main(int argc, char* argv[])
         password = argv[6];
     }
 
-    Service service;
-    service.endpoint = url;
-    if (user && password) {
-        service.soap->userid = user;
-        service.soap->passwd = password;
+    const char* publisherdSocket = getenv(IFMAP_PUBLISHERD_SOCKET);
+    if (publisherdSocket) {
+        std::string command = std::string("ip-mac ") + op + " " + binding.ip + " " + binding.mac;
+        std::string reply;
+        if (!sendToPublisherd(publisherdSocket, command, reply)) {
+            fprintf(stderr, "%s\n", reply.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    IfmapClient client(url, user, password);
+    if (tlsCache) {
+        tlsCache->use(client.soap());
+    }
+    int code = sessionFile ? client.openSession(sessionFile) : client.newSession();
+    if (tlsCache) {
+        tlsCache->report(stderr);
     }
-    int code = ifmapConnect(service);
     if (code != SOAP_OK) {
-        soap_print_fault(service.soap, stderr);
+        client.printFault(stderr);
         return 1;
     }
-    
-    service.soap->header->ifmap__publisher_id = 0;
-
-    ifmap__IPAddressType ipAddr;
-    ipAddr.type = _ifmap__IPAddressType_type__IPv4;
-    ipAddr.value = ipArg;
-    ifmap__IdentifierType ipIdent;
-    ipIdent.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
-    ipIdent.union_IdentifierType.ip_address = &ipAddr;
-
-    ifmap__MACAddressType macAddr;
-    macAddr.value = macArg;
-    ifmap__IdentifierType macIdent;
-    macIdent.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_mac_address;
-    macIdent.union_IdentifierType.mac_address = &macAddr;
-    
-    ifmap__IdentifierType* idents[] = { &ipIdent, &macIdent };
-    ifmap__LinkType link;
-    link.__sizeidentifier = 2;
-    link.identifier = idents;
-    
-    struct soap metaSoap(SOAP_XML_DOM);
-    _meta__ip_mac ipMac;
-    ifmap__MetadataListType metadata;
-    ifmap__PublishType update;
-    ifmap__DeleteType delete_;
-    
+
+    MetadataCache metadata;
+    IpMacRequest request;
     __ifmap__union_PublishRequestType publish;
-    if (strcmp(op, "update") == 0) {
-        update.__union_PublishType = SOAP_UNION__ifmap__union_PublishType_link;
-        update.union_PublishType.link = &link;
-        ipMac.soap_out(&metaSoap, "meta:ip-mac", 0, 0);
-        metadata.__size = 1;
-        metadata.__any = metaSoap.dom;
-        update.metadata = &metadata;
-        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-        publish.union_PublishRequestType.update = &update;
-    } else {
-        delete_.__union_DeleteType = SOAP_UNION__ifmap__union_PublishType_link;
-        delete_.union_DeleteType.link = &link;
-        delete_.filter = "meta:ip-mac";
-        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_delete_;
-        publish.union_PublishRequestType.delete_ = &delete_;
-    }
+    buildIpMacPublish(metadata, binding, request, publish);
 
     ifmap__PublishRequestType publishRequest;
     publishRequest.__size_PublishRequestType = 1;
     publishRequest.__union_PublishRequestType = &publish;
-    
-    struct __wsdl__PublishResponse response;
-    bzero(&response, sizeof response);
-
-    code = service.__wsdl__Publish(&publishRequest, response);
+    code = client.publish(&publishRequest);
     if (code != SOAP_OK) {
-        soap_print_fault(service.soap, stderr);
+        client.printFault(stderr);
+    } else if (tlsCache) {
+        tlsCache->save(client.soap());
     }
     return code == SOAP_OK ? 0 : 1;
 }
-
-#include <dom.cpp>
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ipmac.h"
+#include <string.h>
+
+bool parseIpMacBinding(char* line, IpMacBinding& binding)
+{
+    const char* separators = " \t\r";
+    char* op = strtok(line, separators);
+    char* ip = strtok(0, separators);
+    char* mac = strtok(0, separators);
+    if (!op || (strcmp(op, "update") != 0 && strcmp(op, "delete") != 0)
+        || !ip || !mac || strtok(0, separators)) {
+        return false;
+    }
+    binding.update = strcmp(op, "update") == 0;
+    binding.ip = ip;
+    binding.mac = mac;
+    return true;
+}
+
+void ipMacState(const IpMacBinding& binding, std::string& key, std::string& value)
+{
+    key = "meta:ip-mac";
+    key += '\0';
+    key += binding.ip;
+    key += '\0';
+    key += binding.mac;
+    // Every ip-mac this tool publishes is the same.
+    value.clear();
+}
+
+void buildIpMacPublish(MetadataCache& metadata, const IpMacBinding& binding,
+                       IpMacRequest& request, __ifmap__union_PublishRequestType& publish)
+{
+    request.ipAddr.type = _ifmap__IPAddressType_type__IPv4;
+    request.ipAddr.value = const_cast<char*>(binding.ip.c_str());
+    request.ipIdent.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
+    request.ipIdent.union_IdentifierType.ip_address = &request.ipAddr;
+
+    request.macAddr.value = const_cast<char*>(binding.mac.c_str());
+    request.macIdent.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_mac_address;
+    request.macIdent.union_IdentifierType.mac_address = &request.macAddr;
+
+    request.idents[0] = &request.ipIdent;
+    request.idents[1] = &request.macIdent;
+    request.link.__sizeidentifier = 2;
+    request.link.identifier = request.idents;
+
+    if (binding.update) {
+        request.update.__union_PublishType = SOAP_UNION__ifmap__union_PublishType_link;
+        request.update.union_PublishType.link = &request.link;
+        request.update.metadata = metadata.constant<_meta__ip_mac>("meta:ip-mac");
+        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
+        publish.union_PublishRequestType.update = &request.update;
+    } else {
+        request.delete_.__union_DeleteType = SOAP_UNION__ifmap__union_PublishType_link;
+        request.delete_.union_DeleteType.link = &request.link;
+        request.delete_.filter = "meta:ip-mac";
+        publish.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_delete_;
+        publish.union_PublishRequestType.delete_ = &request.delete_;
+    }
+}
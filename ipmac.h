@@ -0,0 +1,85 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_ipmac_h__
+#define ifmap_ipmac_h__
+
+#include <string>
+#include "ifmapH.h"
+#include "metacache.h"
+
+/*
+ * An ip-mac link to publish or delete.
+ */
+struct IpMacBinding
+{
+    IpMacBinding() : lineNum(0), update(true) {}
+
+    long lineNum;
+    bool update;
+    std::string ip;
+    std::string mac;
+};
+
+/*
+ * Parses "update|delete ip-address mac-address" from line, which is
+ * modified. Returns false if the line is malformed.
+ */
+extern bool parseIpMacBinding(char* line, IpMacBinding& binding);
+
+/*
+ * Sets the state cache key and value of binding, see statecache.h.
+ */
+extern void ipMacState(const IpMacBinding& binding, std::string& key, std::string& value);
+
+/*
+ * The request objects for publishing or deleting one ip-mac link.
+ */
+struct IpMacRequest
+{
+    ifmap__IPAddressType ipAddr;
+    ifmap__IdentifierType ipIdent;
+    ifmap__MACAddressType macAddr;
+    ifmap__IdentifierType macIdent;
+    ifmap__IdentifierType* idents[2];
+    ifmap__LinkType link;
+    ifmap__PublishType update;
+    ifmap__DeleteType delete_;
+};
+
+/*
+ * Fills in request and publish for binding. They refer to the
+ * strings in binding, which must outlive them.
+ */
+extern void buildIpMacPublish(MetadataCache& metadata, const IpMacBinding& binding,
+                              IpMacRequest& request, __ifmap__union_PublishRequestType& publish);
+
+#endif /*ifmap_ipmac_h__*/
@@ -36,13 +36,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <map>
 #include <vector>
 #include <string>
+#include <math.h>
+#include <time.h>
 #include <sys/param.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include "ifmap.nsmap"
 #include "ifmapStub.h"
 #include "ifmapServiceProxy.h"
+#include "connect.h"
+#include "call.h"
+#include "display.h"
+#include "histogram.h"
+#include "metacache.h"
+#include "intern.h"
+#include "publishitem.h"
+#include "encoder.h"
+#include "pollstream.h"
 
 static const char* g_programName;
 static pid_t g_pollPid = -1;
@@ -54,9 +71,105 @@ static bool g_purgePublisher = false;
 static int g_startIp = 0x01010101;
 static int g_step = 500;
 static int g_start = 0;
+static int g_threads = 1;
+static bool g_ownSessions = false;
+static int g_inflight = 1;
+static int g_batch = 1;
+static bool g_soak = false;
+static bool g_directEncoder = false;
+static bool g_verifyEncoder = false;
+static bool g_pollStream = false;
+static bool g_noKeepAlive = false;
+static int g_retries = 0;
+static const char* g_latencyDumpFile = 0;
+
+// Open-loop load: sessions are started at g_rate sessions/second,
+// following g_ramp, whether or not earlier sessions have completed.
+// A rate of 0 means closed-loop.
+struct RampProfile
+{
+    enum Kind { NONE, LINEAR, STEP, BURST };
+
+    Kind kind;
+    double seconds;     // LINEAR: ramp time; STEP: time per step;
+                        // BURST: burst length
+    int steps;          // STEP: number of steps up to g_rate
+    double factor;      // BURST: rate multiplier during a burst
+    double period;      // BURST: time from one burst to the next
+};
+
+static double g_rate = 0;
+static double g_requestRate = 0;
+static RampProfile g_ramp = { RampProfile::NONE, 0, 0, 0, 0 };
+static long long g_scheduleStart = 0;
 static char* g_clientUsername = "ifmc";
 static char* g_clientPassword = "ifmc";
 
+// Session numbers still to be started and statistics shared by all
+// load threads. Protected by g_statsLock.
+static pthread_mutex_t g_statsLock = PTHREAD_MUTEX_INITIALIZER;
+static int g_nextSession = 0;
+static int g_endSession = 0;
+static long long g_sessionsScheduled = 0;
+static long long g_sessionsDone = 0;
+static long long g_requestsDone = 0;
+static long long g_stepFirstSession = 0;
+static long long g_stepFirstRequest = 0;
+static long long g_reconnects = 0;
+static long long g_stepFirstReconnect = 0;
+static long long g_stepStart;
+static long g_stepStartRss = 0;
+
+enum Operation
+{
+    OP_PUBLISH,
+    OP_SUBSCRIBE,
+    OP_POLL,
+    OP_PURGE_PUBLISHER,
+    OP_SESSION,
+    OP_CONNECT,
+    NUM_OPERATIONS
+};
+
+static const char* g_operationNames[NUM_OPERATIONS] = {
+    "Publish", "Subscribe", "Poll", "PurgePublisher", "Session", "Connect"
+};
+
+// Request latencies of the current step and of the whole run, in
+// microseconds. Also protected by g_statsLock.
+static LatencyHistogram g_stepLatency[NUM_OPERATIONS];
+static LatencyHistogram g_totalLatency[NUM_OPERATIONS];
+static FILE* g_latencyDump = 0;
+static bool g_latencyDumpCsv = false;
+static int g_stepNum = 0;
+
+// Shared with the poller process: g_publishedAt[n] is when the publish
+// for session g_start + n was sent and g_notifiedAt[n] when the poller
+// saw its notification (0 until then), and *g_runStartAt is when the
+// first session was due.
+static volatile long long* g_publishedAt = 0;
+static volatile long long* g_notifiedAt = 0;
+static volatile long long* g_runStartAt = 0;
+static int g_numSessions = 0;
+
+// Also shared with the poller, which stores each poll's latency in
+// usecs[n % s_pollSampleSlots] before counting it in written. The load
+// process moves them into its Poll histograms as steps end.
+static const int s_pollSampleSlots = 65536;
+
+struct PollSamples
+{
+    volatile long long written;
+    volatile long long largestResult;
+    volatile long long usecs[s_pollSampleSlots];
+};
+
+static PollSamples* g_pollSamples = 0;
+static long long g_pollSamplesRead = 0;
+
+// Poller process count of sessions notified
+static int g_numNotified = 0;
+
 static void onExit(void)
 {
     if (g_pollPid > 0) {
@@ -69,11 +182,24 @@ static void onSigChld(int)
     exit(0);
 }
 
+static void printNotificationLatency()
+{
+    LatencyHistogram latency;
+    for (int ii = 0; ii < g_numSessions; ii++) {
+        if (g_notifiedAt[ii]) {
+            latency.record(g_notifiedAt[ii] - g_publishedAt[ii]);
+        }
+    }
+    printf("Publish to notification latency (usec):\n");
+    latency.print(stdout, "Notification");
+}
+
 static void usage()
 {
     fprintf(stderr, 
-            "usage: %s [ --usage ] [ --help ] [ --startip <ip> ] [ --nosub ] [ --pause ] [ --purge ] [ --step step ] [ --start start ] [ --username u ] [ --password p ] url num-sessions\n",
-            g_programName);
+            "usage: %s [ --usage ] [ --help ] [ --startip <ip> ] [ --nosub ] [ --pause ] [ --purge ] [ --step step ] [ --start start ] [ --threads n ] [ --own-sessions ] [ --inflight k ] [ --latency-dump file ] [ --rate r | --request-rate r ] [ --ramp profile ] [ --batch k ] [ --soak ] [ --encoder gsoap|direct ] [ --verify-encoder ] [ --poll-stream ] [ --no-keepalive ] [ --retries n ] [ --username u ] [ --password p ] url num-sessions\n"
+            "       %s [ --batch k ] --verify-encoder\n",
+            g_programName, g_programName);
     exit(1);
 }
 
@@ -110,6 +236,73 @@ static void help()
             "--start <n>     User number to start from. Usernames have the form\n"
             "                user<nnnnnn>. Default is %d\n"
             "                                \n"
+            "--threads <n>   Number of threads starting sessions in parallel, each\n"
+            "                with its own connection. Default is %d\n"
+            "                                \n"
+            "--own-sessions  Each thread creates its own IF-MAP session instead of\n"
+            "                attaching to the main session. Subscriptions made on\n"
+            "                these sessions are not polled\n"
+            "                                \n"
+            "--inflight <k>  Keep up to k requests outstanding per thread, each on\n"
+            "                its own keep-alive connection, instead of waiting for\n"
+            "                every response before sending the next request.\n"
+            "                Default is %d\n"
+            "                                \n"
+            "--latency-dump <file>\n"
+            "                Write per-step and whole-run latency percentiles to\n"
+            "                file, as CSV if its name ends in .csv and as JSON\n"
+            "                otherwise\n"
+            "                                \n"
+            "--rate <r>      Start r sessions per second on schedule, whether or\n"
+            "                not earlier sessions have completed. Latencies are\n"
+            "                measured from the time each session was due to\n"
+            "                start. Default is to start each session when the\n"
+            "                previous one completes\n"
+            "                                \n"
+            "--request-rate <r>\n"
+            "                Same as --rate, but r is in requests per second\n"
+            "                                \n"
+            "--ramp <profile>\n"
+            "                How the --rate is reached:\n"
+            "                linear:<secs>  rise linearly from 0 over secs\n"
+            "                step:<n>:<secs>\n"
+            "                               rise in n equal steps, each lasting\n"
+            "                               secs\n"
+            "                burst:<factor>:<period>:<secs>\n"
+            "                               every period seconds, run at factor\n"
+            "                               times the rate for secs seconds\n"
+            "                                \n"
+            "--batch <k>     Start k sessions with each publish request and\n"
+            "                subscribe to them with a single subscribe request.\n"
+            "                Default is %d\n"
+            "                                \n"
+            "--soak          Keep starting the same num-sessions sessions over and\n"
+            "                over until interrupted\n"
+            "                                \n"
+            "--encoder <e>   How to encode publish requests:\n"
+            "                gsoap   build and serialize gSOAP objects (default)\n"
+            "                direct  fill in XML templates compiled from gSOAP\n"
+            "                        output\n"
+            "                                \n"
+            "--verify-encoder\n"
+            "                Check that the direct encoder produces the same bytes\n"
+            "                as gSOAP before starting sessions. Without url and\n"
+            "                num-sessions, check in memory, without a server, and\n"
+            "                exit\n"
+            "                                \n"
+            "--poll-stream   Parse poll responses as they arrive, one result at a\n"
+            "                time, instead of deserializing them whole\n"
+            "                                \n"
+            "--no-keepalive  Open a new connection for every publish and\n"
+            "                subscribe request. The time taken to connect,\n"
+            "                including any TLS handshake, is reported as Connect\n"
+            "                latency either way\n"
+            "                                \n"
+            "--retries <n>   Send a publish or subscribe request again, on a new\n"
+            "                connection, when its connection is lost, up to n\n"
+            "                times in a row. Its latency includes the failed\n"
+            "                attempts. Default is %d\n"
+            "                                \n"
             "--username <u>  Username of IF-MAP client. Default is %s\n"
             "                                   \n"
             "--password <p>  Password of IF-MAP client. Default is %s\n"
@@ -117,106 +310,260 @@ static void help()
             defaultStartIp,
             g_step,
             g_start,
+            g_threads,
+            g_inflight,
+            g_batch,
+            g_retries,
             g_clientUsername,
             g_clientPassword);
     exit(1);
 }
 
-static int ifmapConnect(Service& service)
+//
+// Sets the credentials given on the command line for a connection
+// about to be set up with ifmapConnect() or ifmapAttach().
+//
+static void useClientCredentials(Service& service)
 {
-    service.soap->imode |= SOAP_C_UTFSTRING;
-    service.soap->omode |= SOAP_C_UTFSTRING;
     service.soap->userid = g_clientUsername;
     service.soap->passwd = g_clientPassword;
+}
 
-    int code = soap_ssl_client_context(service.soap,
-                                       SOAP_SSL_NO_AUTHENTICATION,
-                                       0, 0, 0, 0, 0);
-    if (code != SOAP_OK) {
-        return code;
+//
+// Returns zeroed memory that stays shared with the poller after fork().
+//
+static void* mapShared(size_t size)
+{
+    void* shared = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
     }
+    bzero(shared, size);
+    return shared;
+}
 
-    service.soap->header = soap_new_SOAP_ENV__Header(service.soap, -1);
-    service.soap->header->ifmap__new_session = "";
-    service.soap->header->ifmap__attach_session = 0;
-    service.soap->header->ifmap__session_id = 0;
-    service.soap->header->ifmap__publisher_id = 0;
-    struct __wsdl__NewSessionResponse response;
-    bzero(&response, sizeof response);
-    return service.__wsdl__NewSession("", response);
+//
+// Allocates the publish and notification times shared with the poller.
+// Must be called before startPolling() forks.
+//
+static void sharePublishTimes(int numSessions)
+{
+    g_runStartAt = (volatile long long*)mapShared((2 * numSessions + 1) * sizeof(long long));
+    g_publishedAt = g_runStartAt + 1;
+    g_notifiedAt = g_publishedAt + numSessions;
+    g_numSessions = numSessions;
 }
 
-static void displayMetadata(struct soap_dom_element& elem)
+//
+// Called in the poller after each poll response.
+//
+static void notePoll(long long sentAt)
 {
-    switch (elem.type) {
-    case SOAP_TYPE__meta__capability:
-        {
-            _meta__capability* cap = (_meta__capability*)elem.node;
-            printf("Capability: %s\n", cap->name);
+    long long written = g_pollSamples->written;
+    g_pollSamples->usecs[written % s_pollSampleSlots] = monotonicMicros() - sentAt;
+    __sync_synchronize();
+    g_pollSamples->written = written + 1;
+}
+
+//
+// Moves the poll latencies the poller has recorded since the last call
+// into the current step. Must be called with g_statsLock held.
+//
+static void collectPollLatency()
+{
+    if (!g_pollSamples) {
+        return;
+    }
+    long long written = g_pollSamples->written;
+    __sync_synchronize();
+    // If the poller has lapped us, its oldest samples are gone.
+    if (written - g_pollSamplesRead > s_pollSampleSlots) {
+        g_pollSamplesRead = written - s_pollSampleSlots;
+    }
+    for (; g_pollSamplesRead < written; g_pollSamplesRead++) {
+        g_stepLatency[OP_POLL].record(g_pollSamples->usecs[g_pollSamplesRead % s_pollSampleSlots]);
+    }
+}
+
+//
+// Prints what only the poller knows, once the sessions are done.
+//
+static void printPollerSummary()
+{
+    if (g_pollStream) {
+        printf("Largest poll result: %lld bytes\n", g_pollSamples->largestResult);
+    }
+    if (g_notifiedAt) {
+        int notified = 0;
+        for (int ii = 0; ii < g_numSessions; ii++) {
+            if (g_notifiedAt[ii]) {
+                notified++;
+            }
         }
-        break;
-    case SOAP_TYPE__meta__event:
-        {
-            _meta__event* event = (_meta__event*)elem.node;
-            printf("Event: %s\n", event->name);
-            break;
+        if (notified < g_numSessions) {
+            printf("Poller saw %d of %d sessions\n", notified, g_numSessions);
+            printNotificationLatency();
         }
     }
 }
 
-static void displaySearchResult(ifmap__SearchResultType& result)
+static void notePublished(int sessionNum, long long sentAt)
+{
+    int index = sessionNum - g_start;
+    if (g_publishedAt && index >= 0 && index < g_numSessions && !g_publishedAt[index]) {
+        g_publishedAt[index] = sentAt;
+    }
+}
+
+//
+// Called in the poller for each search result. Subscription names have
+// the form o:<publisher-id>:ar<session number>. The first result for a
+// session's subscription is its notification.
+//
+static void noteNotification(const char* name)
 {
-    if (!g_verbose) {
+    if (!name || !g_publishedAt) {
         return;
     }
-    printf("\n\nSearch result for %s\n", result.name);
-    int ii;
-    for (ii = 0; ii < result.__sizeidentifierResult; ii++) {
-        // Look for IP address and identity identifiers
-        // Look for access-request identifier, and get capabilities
-        ifmap__IdentifierType* ident = result.identifierResult[ii]->identifier;
-        switch (ident->__union_IdentifierType) {
-        case SOAP_UNION__ifmap__union_IdentifierType_access_request:
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_identity:
-            printf("userName: %s\n", ident->union_IdentifierType.identity->name);
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_ip_address:
-            printf("IP Address: %s\n", ident->union_IdentifierType.ip_address->value);
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_mac_address:
-            printf("MAC Address: %s\n", ident->union_IdentifierType.mac_address->value);
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_device:
-            if (ident->union_IdentifierType.device->__union_DeviceType == SOAP_UNION__ifmap__union_DeviceType_aik_name) {
-                printf("AIK Device: %s\n", ident->union_IdentifierType.device->union_DeviceType.aik_name);
-            } else if (ident->union_IdentifierType.device->__union_DeviceType == SOAP_UNION__ifmap__union_DeviceType_name) {
-                printf("Device: %s\n", ident->union_IdentifierType.device->union_DeviceType.aik_name);
-            }
-            break;
+    const char* ar = strstr(name, ":ar");
+    while (ar && strstr(ar + 1, ":ar")) {
+        ar = strstr(ar + 1, ":ar");
+    }
+    if (!ar) {
+        return;
+    }
+    int index = atoi(ar + 3) - g_start;
+    if (index < 0 || index >= g_numSessions || g_notifiedAt[index] || !g_publishedAt[index]) {
+        return;
+    }
+    long long now = monotonicMicros();
+    g_notifiedAt[index] = now;
+    g_numNotified++;
+    if (g_numNotified == g_numSessions) {
+        printf("Poller saw all %d sessions\n", g_numSessions);
+        printf("Time to converge: %g\n", (float)(now - *g_runStartAt) / 1000000.0);
+        printNotificationLatency();
+        fflush(stdout);
+    }
+}
+
+//
+// Per-connection state kept outside the connection's soap context, so
+// that everything allocated in the context can be freed after each
+// request completes.
+//
+struct RequestArena
+{
+    MetadataCache metadata;
+    SOAP_ENV__Header header;
+    std::string sessionId;
+    std::string publisherId;
+
+    // Publish templates by number of sessions, for --encoder direct.
+    std::map<int, XmlTemplate> sessionTemplates;
+    std::string encodeBuffer;
+
+    // Identifiers shared by every session, and those of the request
+    // being built, which resetArena() releases.
+    IdentifierTable identifiers;
+    IdentifierSlab slab;
+};
+
+//
+// Frees all request and response data of a connection, leaving its
+// connection open and its session header in place.
+//
+static void resetArena(Service& service, RequestArena& arena)
+{
+    soap_destroy(service.soap);
+    soap_end(service.soap);
+    arena.slab.reset();
+    bzero(&arena.header, sizeof arena.header);
+    arena.header.ifmap__session_id = const_cast<char*>(arena.sessionId.c_str());
+    service.soap->header = &arena.header;
+}
+
+//
+// Saves the session ID from service.soap->header in arena, along with
+// publisherId, or the header's publisher ID if publisherId is 0.
+//
+static void initArena(Service& service, RequestArena& arena, const char* publisherId)
+{
+    SOAP_ENV__Header* header = service.soap->header;
+    if (header && header->ifmap__session_id) {
+        arena.sessionId = header->ifmap__session_id;
+    } else if (header && header->ifmap__attach_session) {
+        arena.sessionId = header->ifmap__attach_session;
+    }
+    if (!publisherId && header) {
+        publisherId = header->ifmap__publisher_id;
+    }
+    arena.publisherId = publisherId ? publisherId : "";
+    resetArena(service, arena);
+}
+
+//
+// Tracks notifications as poll results stream in.
+//
+class NotificationHandler : public PollResultHandler
+{
+public:
+    virtual void searchResultBegin(const char* name)
+    {
+        noteNotification(name);
+        if (g_verbose) {
+            printf("\n\nSearch result for %s\n", name);
         }
-        ifmap__MetadataListType* md = result.identifierResult[ii]->metadata;
-        if (!md) {
-            continue;
+    }
+
+    virtual void identifierResult(const char*, const XmlNode& result)
+    {
+        if (g_verbose) {
+            displayIdentifierResult(result);
         }
-        for (int jj = 0; jj < md->__size; jj++) {
-            displayMetadata(*(md->__any + jj));
+    }
+
+    virtual void linkResult(const char*, const XmlNode& result)
+    {
+        if (g_verbose) {
+            displayLinkResult(result);
         }
     }
-    for (ii = 0; ii < result.__sizelinkResult; ii++) {
-        ifmap__MetadataListType* md = result.linkResult[ii]->metadata;
-        if (!md) {
-            continue;
+
+    virtual void searchResultEnd(const char*)
+    {
+        if (g_verbose) {
+            fflush(stdout);
         }
-        for (int jj = 0; jj < md->__size; jj++) {
-            displayMetadata(*(md->__any + jj));
+    }
+
+    virtual void errorResult(const char* errorCode, const char* errorString)
+    {
+        fprintf(stderr, "Poll error %s: %s\n", errorCode, errorString);
+    }
+};
+
+static void streamPolls(Service& service)
+{
+    NotificationHandler handler;
+    PollStreamParser parser(handler);
+    while (true) {
+        ifmap__PollRequestType pollRequest;
+        long long sentAt = monotonicMicros();
+        if (ifmapSendPoll(service, &pollRequest) != SOAP_OK
+            || ifmapRecvPollStream(service, parser) != SOAP_OK) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
         }
+        notePoll(sentAt);
+        g_pollSamples->largestResult = parser.largestResult();
     }
-    fflush(stdout);
 }
 
 static void startPolling(const char* url, const char* sessionId)
 {
+    g_pollSamples = (PollSamples*)mapShared(sizeof *g_pollSamples);
     g_pollPid = fork();
     if (g_pollPid == -1) {
         perror("fork");
@@ -226,366 +573,1181 @@ static void startPolling(const char* url, const char* sessionId)
         atexit(onExit);
         return;
     }
-    Service service;
-    service.soap->imode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE | SOAP_DOM_NODE;
-    service.soap->omode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE | SOAP_DOM_NODE;
-    service.endpoint = url;
-    service.soap->userid = g_clientUsername;
-    service.soap->passwd = g_clientPassword;
-    if (soap_ssl_client_context(service.soap,
-                                SOAP_SSL_NO_AUTHENTICATION,
-                                0, 0, 0, 0, 0)) {
-        soap_print_fault(service.soap, stderr);
-        exit(1);
+    Service service;
+    int mode = SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE;
+    if (!g_pollStream) {
+        mode |= SOAP_DOM_NODE;
+    }
+    service.soap->imode |= mode;
+    service.soap->omode |= mode;
+    service.endpoint = url;
+    useClientCredentials(service);
+    int code = ifmapAttach(service, sessionId);
+    if (code) {
+        soap_print_fault(service.soap, stderr);
+        exit(1);
+    }
+    RequestArena arena;
+    initArena(service, arena, "");
+
+    if (g_pollStream) {
+        streamPolls(service);
+    }
+
+    while (true) {
+        resetArena(service, arena);
+        ifmap__PollRequestType pollRequest;
+        __wsdl__PollResponse pollResponse;
+        long long sentAt = monotonicMicros();
+        code = service.__wsdl__Poll(&pollRequest, pollResponse);
+        if (code) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        notePoll(sentAt);
+        if (pollResponse.ifmap__response) {
+            if (pollResponse.ifmap__response->__union_ResponseType !=
+                SOAP_UNION__ifmap__union_ResponseType_pollResult) {
+                fprintf(stderr, "Unexpected result type: %d",
+                        pollResponse.ifmap__response->__union_ResponseType);
+                continue;
+            }
+            ifmap__PollResultType* pollResult = pollResponse.ifmap__response->union_ResponseType.pollResult;
+            for (int ii = 0; ii < pollResult->__size_PollResultType; ii++) {
+                if (pollResult->__union_PollResultType[ii].__union_PollResultType
+                    == SOAP_UNION__ifmap__union_PollResultType_searchResult) {
+                    ifmap__SearchResultType* searchResult
+                        = pollResult->__union_PollResultType[ii].union_PollResultType.searchResult;
+                    noteNotification(searchResult->name);
+                    if (g_verbose) {
+                        displaySearchResult(*searchResult);
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void getIp(int sessionNum, char* result, int resultSize)
+{
+    int ip = g_startIp + sessionNum;
+    snprintf(result, resultSize, "%d.%d.%d.%d", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+}
+
+//
+// The identifier names that vary between sessions. fields() lists them
+// in the order addSessionUpdates() and the direct encoder take them.
+//
+struct SessionNames
+{
+    enum { NUM_FIELDS = 4 };
+
+    char accessRequest[50];
+    char ip[50];
+    char userName[50];
+    char device[50];
+
+    void fields(const char** result) const
+    {
+        result[0] = accessRequest;
+        result[1] = ip;
+        result[2] = userName;
+        result[3] = device;
+    }
+};
+
+static void getSessionNames(int sessionNum, const char* pubId, SessionNames& names)
+{
+    snprintf(names.accessRequest, sizeof names.accessRequest, "%s:ar%06d", pubId, sessionNum);
+    getIp(sessionNum, names.ip, sizeof names.ip);
+    snprintf(names.userName, sizeof names.userName, "user%06d", sessionNum);
+    snprintf(names.device, sizeof names.device, "device%06d", sessionNum);
+}
+
+//
+// Appends the updates that start a session to updates. fields holds
+// the session's names in SessionNames::fields() order. Request objects
+// are allocated in soap and the session's identifiers in arena.slab.
+// Metadata and the client's own address never vary between sessions,
+// so they come from arena.metadata and arena.identifiers.
+//
+static void addSessionUpdates(struct soap* soap, RequestArena& arena, const char** fields,
+                              std::vector<__ifmap__union_PublishRequestType>& updates)
+{
+    const char* accessRequest = fields[0];
+    const char* ip = fields[1];
+    const char* userName = fields[2];
+    const char* device = fields[3];
+    MetadataCache& metadata = arena.metadata;
+
+    ifmap__IdentifierType* accessRequestIdent = arena.slab.accessRequest(0, accessRequest);
+    ifmap__IdentifierType* ipAddressIdent
+        = arena.slab.ipAddress(0, _ifmap__IPAddressType_type__IPv4, ip);
+    ifmap__IdentifierType* identityIdent
+        = arena.slab.identity(0, _ifmap__IdentityType_type__username, userName);
+    ifmap__IdentifierType* myIpIdent
+        = arena.identifiers.ipAddress(0, _ifmap__IPAddressType_type__IPv4, g_myIp);
+    ifmap__IdentifierType* deviceIdent
+        = arena.slab.device(SOAP_UNION__ifmap__union_DeviceType_name, device);
+    
+    // capability
+    std::vector<const char*> roles;
+    roles.push_back("role1");
+    roles.push_back("role2");
+    roles.push_back("role3");
+    roles.push_back("role4");
+    roles.push_back("role5");
+    addUpdate(updates, createIdentifierUpdate(soap, accessRequestIdent,
+                                              metadata.capabilities(roles)));
+
+    // authenticated-as
+    addUpdate(updates, createLinkUpdate(
+                  soap, accessRequestIdent, identityIdent,
+                  metadata.constant<_meta__authenticated_as>("meta:authenticated-as")));
+    
+    // access-request-ip
+    addUpdate(updates, createLinkUpdate(
+                  soap, accessRequestIdent, ipAddressIdent,
+                  metadata.constant<_meta__access_request_ip>("meta:access-request-ip")));
+
+    // access-request-device
+    addUpdate(updates, createLinkUpdate(
+                  soap, accessRequestIdent, deviceIdent,
+                  metadata.constant<_meta__access_request_device>("meta:access-request-device")));
+
+    // authenticated-by
+    addUpdate(updates, createLinkUpdate(
+                  soap, accessRequestIdent, myIpIdent,
+                  metadata.constant<_meta__authenticated_by>("meta:authenticated-by")));
+}
+
+//
+// Appends the subscription for a session's access-request to
+// subscriptions.
+//
+static void addSessionSubscription(struct soap* soap, IdentifierSlab& slab, int sessionNum,
+                                   const char* pubId,
+                                   std::vector<__ifmap__union_SubscribeRequestType>& subscriptions)
+{
+    char accessRequest[50];
+    snprintf(accessRequest, sizeof accessRequest, "%s:ar%06d", pubId, sessionNum);
+    char name[60];
+    snprintf(name, sizeof name, "o:%s", accessRequest);
+
+    _ifmap__SubscribeRequestType_update* update
+        = soap_new__ifmap__SubscribeRequestType_update(soap, -1);
+    update->name = soap_strdup(soap, name);
+    update->identifier = slab.accessRequest(0, accessRequest);
+    update->match_links = "meta:ip-mac or meta:access-request-ip or meta:access-request-mac"
+        " or meta:access-request-device or meta:authenticated-as";
+    update->result_filter = "meta:ip-mac or meta:event";
+    update->max_depth = "3";
+
+    __ifmap__union_SubscribeRequestType req;
+    req.__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_update;
+    req.union_SubscribeRequestType.update = update;
+    subscriptions.push_back(req);
+}
+
+//
+// Serializes the publish request starting count sessions, named by
+// fields, into xml the way ifmapSendPublish would send it. The session
+// ID in the header is replaced with sessionId.
+//
+static int captureSessionPublish(Service& service, RequestArena& arena, const char* sessionId,
+                                 const char** fields, int count, std::string& xml)
+{
+    std::vector<__ifmap__union_PublishRequestType> updates;
+    int ii;
+    for (ii = 0; ii < count; ii++) {
+        addSessionUpdates(service.soap, arena, fields + ii * SessionNames::NUM_FIELDS,
+                          updates);
+    }
+    ifmap__PublishRequestType publishRequest;
+    publishRequest.__size_PublishRequestType = updates.size();
+    publishRequest.__union_PublishRequestType = &updates[0];
+
+    arena.header.ifmap__session_id = const_cast<char*>(sessionId);
+    int code = ifmapCapturePublish(service, &publishRequest, xml);
+    arena.header.ifmap__session_id = const_cast<char*>(arena.sessionId.c_str());
+    return code;
+}
+
+//
+// Returns the direct encoder template for publish requests starting
+// count sessions. Field 0 is the session ID, followed by the fields of
+// each session.
+//
+static const XmlTemplate& sessionTemplate(Service& service, RequestArena& arena, int count)
+{
+    XmlTemplate& result = arena.sessionTemplates[count];
+    if (result.empty()) {
+        int numFields = 1 + count * SessionNames::NUM_FIELDS;
+        std::vector<std::string> names;
+        std::vector<const char*> fields;
+        int ii;
+        for (ii = 0; ii < numFields; ii++) {
+            names.push_back(XmlTemplate::field(ii));
+        }
+        for (ii = 0; ii < numFields; ii++) {
+            fields.push_back(names[ii].c_str());
+        }
+        std::string xml;
+        if (captureSessionPublish(service, arena, fields[0], &fields[1], count, xml) != SOAP_OK) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        if (!result.compile(xml, numFields, service.soap->mode & SOAP_C_UTFSTRING)) {
+            fprintf(stderr, "Could not compile publish template for %d sessions\n", count);
+            exit(1);
+        }
+    }
+    return result;
+}
+
+//
+// Builds and sends one publish request starting count sessions from
+// firstSession. sentAt is set to the time the request started going out.
+// With sender, the request is only buffered there to be written as the
+// connection takes it.
+//
+static int sendSessionPublish(Service& service, RequestArena& arena, int firstSession, int count,
+                              long long& sentAt, RequestSender* sender = 0)
+{
+    const char* pubId = arena.publisherId.c_str();
+    std::vector<SessionNames> names(count);
+    std::vector<const char*> fields(1 + count * SessionNames::NUM_FIELDS);
+    fields[0] = arena.sessionId.c_str();
+    int ii;
+    for (ii = 0; ii < count; ii++) {
+        if (g_verbose) {
+            printf("startSession %d\n", firstSession + ii);
+            fflush(stdout);
+        }
+        getSessionNames(firstSession + ii, pubId, names[ii]);
+        names[ii].fields(&fields[1 + ii * SessionNames::NUM_FIELDS]);
+    }
+
+    if (g_directEncoder) {
+        const XmlTemplate& publishTemplate = sessionTemplate(service, arena, count);
+        publishTemplate.render(&fields[0], arena.encodeBuffer);
+        sentAt = monotonicMicros();
+        for (ii = 0; ii < count; ii++) {
+            notePublished(firstSession + ii, sentAt);
+        }
+        return sender
+            ? sender->beginRaw(service, arena.encodeBuffer.data(), arena.encodeBuffer.size())
+            : ifmapSendRaw(service, arena.encodeBuffer.data(), arena.encodeBuffer.size());
+    }
+
+    std::vector<__ifmap__union_PublishRequestType> updates;
+    for (ii = 0; ii < count; ii++) {
+        addSessionUpdates(service.soap, arena, &fields[1 + ii * SessionNames::NUM_FIELDS],
+                          updates);
+    }
+
+    ifmap__PublishRequestType publishRequest;
+    publishRequest.__size_PublishRequestType = updates.size();
+    publishRequest.__union_PublishRequestType = &updates[0];
+
+    sentAt = monotonicMicros();
+    for (ii = 0; ii < count; ii++) {
+        notePublished(firstSession + ii, sentAt);
+    }
+    return sender
+        ? sender->beginPublish(service, &publishRequest)
+        : ifmapSendPublish(service, &publishRequest);
+}
+
+//
+// Reports the first difference between what gSOAP and the direct
+// encoder produced for the same request. Returns true if they match.
+//
+static bool compareEncodings(const char* what, const std::string& expected,
+                             const std::string& actual)
+{
+    if (expected == actual) {
+        return true;
+    }
+    size_t ii = 0;
+    while (ii < expected.size() && ii < actual.size() && expected[ii] == actual[ii]) {
+        ii++;
+    }
+    size_t from = ii > 40 ? ii - 40 : 0;
+    fprintf(stderr, "Direct encoder differs from gSOAP for %s at byte %lu:\n"
+            "  gsoap:  ...%s\n"
+            "  direct: ...%s\n",
+            what, (unsigned long)ii,
+            expected.substr(from, 80).c_str(), actual.substr(from, 80).c_str());
+    return false;
+}
+
+//
+// Checks that the direct encoder produces the same bytes as gSOAP for
+// the publish requests load sends, with both ordinary session names
+// and names that need escaping, and for a link delete with a filter.
+// Exits if any differ.
+//
+static void verifyEncoder(Service& service, RequestArena& arena)
+{
+    const char* pubId = arena.publisherId.c_str();
+    const char* odd[SessionNames::NUM_FIELDS] = {
+        "ar&<>\"'\t\r\n", "10.0.0.1\"", "user <\xc3\xa9>", "device&amp;\n"
+    };
+    int counts[] = { 1, g_batch };
+    int checked = 0;
+    bool ok = true;
+    int ii;
+    for (ii = 0; ii < sizeof counts / sizeof counts[0]; ii++) {
+        int count = counts[ii];
+        std::vector<SessionNames> names(count);
+        std::vector<const char*> fields(1 + count * SessionNames::NUM_FIELDS);
+        int pass;
+        for (pass = 0; pass < 2; pass++) {
+            fields[0] = pass ? "session&<id>" : arena.sessionId.c_str();
+            int jj;
+            for (jj = 0; jj < count; jj++) {
+                const char** sessionFields = &fields[1 + jj * SessionNames::NUM_FIELDS];
+                if (pass) {
+                    memcpy(sessionFields, odd, sizeof odd);
+                } else {
+                    getSessionNames(g_start + jj, pubId, names[jj]);
+                    names[jj].fields(sessionFields);
+                }
+            }
+            std::string expected;
+            if (captureSessionPublish(service, arena, fields[0], &fields[1], count,
+                                      expected) != SOAP_OK) {
+                soap_print_fault(service.soap, stderr);
+                exit(1);
+            }
+            std::string actual;
+            sessionTemplate(service, arena, count).render(&fields[0], actual);
+            char what[50];
+            snprintf(what, sizeof what, "%d session%s%s", count, count == 1 ? "" : "s",
+                     pass ? " with escaped names" : "");
+            ok = compareEncodings(what, expected, actual) && ok;
+            checked++;
+        }
+    }
+
+    // Link delete with filter, which load itself does not send.
+    std::string names[3];
+    const char* fields[3];
+    for (ii = 0; ii < 3; ii++) {
+        names[ii] = XmlTemplate::field(ii);
+        fields[ii] = names[ii].c_str();
+    }
+    XmlTemplate deleteTemplate;
+    const char* values[3] = { "ar\"1\"", "10.0.0.<1>", "meta:access-request-ip[@x=\"a&b\"]" };
+    for (ii = 0; ii < 2; ii++) {
+        const char** prototype = ii ? values : fields;
+        std::vector<__ifmap__union_PublishRequestType> updates;
+        addDelete(updates, createLinkDelete(
+                      service.soap,
+                      arena.slab.accessRequest(0, prototype[0]),
+                      arena.slab.ipAddress(0, _ifmap__IPAddressType_type__IPv4, prototype[1]),
+                      prototype[2]));
+        ifmap__PublishRequestType publishRequest;
+        publishRequest.__size_PublishRequestType = updates.size();
+        publishRequest.__union_PublishRequestType = &updates[0];
+        std::string xml;
+        if (ifmapCapturePublish(service, &publishRequest, xml) != SOAP_OK) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        if (ii == 0) {
+            if (!deleteTemplate.compile(xml, 3, service.soap->mode & SOAP_C_UTFSTRING)) {
+                fprintf(stderr, "Could not compile link delete template\n");
+                exit(1);
+            }
+        } else {
+            std::string actual;
+            deleteTemplate.render(values, actual);
+            ok = compareEncodings("link delete", xml, actual) && ok;
+            checked++;
+        }
+    }
+    resetArena(service, arena);
+
+    if (!ok) {
+        exit(1);
+    }
+    printf("Direct encoder matches gSOAP for %d requests\n", checked);
+    fflush(stdout);
+}
+
+//
+// Runs verifyEncoder() without a server, on made-up session and
+// publisher IDs, both with and without SOAP_C_UTFSTRING.
+//
+static void checkEncoder()
+{
+    int utf8;
+    for (utf8 = 0; utf8 < 2; utf8++) {
+        Service service;
+        if (utf8) {
+            service.soap->omode |= SOAP_C_UTFSTRING;
+        }
+        RequestArena arena;
+        arena.sessionId = "check-session";
+        arena.publisherId = "check-publisher";
+        resetArena(service, arena);
+        verifyEncoder(service, arena);
+    }
+}
+
+//
+// Builds and sends one subscribe request for count sessions from
+// firstSession.
+//
+static int sendSessionSubscribe(Service& service, RequestArena& arena, int firstSession, int count,
+                                long long& sentAt, RequestSender* sender = 0)
+{
+    const char* pubId = arena.publisherId.c_str();
+    std::vector<__ifmap__union_SubscribeRequestType> subscriptions;
+    for (int ii = 0; ii < count; ii++) {
+        addSessionSubscription(service.soap, arena.slab, firstSession + ii, pubId,
+                               subscriptions);
+    }
+
+    ifmap__SubscribeRequestType subscribeRequest;
+    subscribeRequest.__size_SubscribeRequestType = subscriptions.size();
+    subscribeRequest.__union_SubscribeRequestType = &subscriptions[0];
+
+    sentAt = monotonicMicros();
+    return sender
+        ? sender->beginSubscribe(service, &subscribeRequest)
+        : ifmapSendSubscribe(service, &subscribeRequest);
+}
+
+//
+// Returns the number of seconds after the start of the run at which
+// session number n (counting from 0) is due, by inverting the number of
+// sessions the ramp profile has started by a given time.
+//
+static double scheduledOffset(double n)
+{
+    double rate = g_rate;
+    switch (g_ramp.kind) {
+    case RampProfile::NONE:
+        break;
+    case RampProfile::LINEAR:
+        {
+            // rate * t^2 / (2 * seconds) sessions by time t < seconds
+            double rampSessions = rate * g_ramp.seconds / 2;
+            if (n < rampSessions) {
+                return sqrt(2 * g_ramp.seconds * n / rate);
+            }
+            return g_ramp.seconds + (n - rampSessions) / rate;
+        }
+    case RampProfile::STEP:
+        {
+            double offset = 0;
+            for (int ii = 1; ii <= g_ramp.steps; ii++) {
+                double stepRate = rate * ii / g_ramp.steps;
+                double stepSessions = stepRate * g_ramp.seconds;
+                if (n < stepSessions) {
+                    return offset + n / stepRate;
+                }
+                n -= stepSessions;
+                offset += g_ramp.seconds;
+            }
+            return offset + n / rate;
+        }
+    case RampProfile::BURST:
+        {
+            double burstSessions = rate * g_ramp.factor * g_ramp.seconds;
+            double periodSessions = burstSessions + rate * (g_ramp.period - g_ramp.seconds);
+            double periods = floor(n / periodSessions);
+            double offset = periods * g_ramp.period;
+            n -= periods * periodSessions;
+            if (n < burstSessions) {
+                return offset + n / (rate * g_ramp.factor);
+            }
+            return offset + g_ramp.seconds + (n - burstSessions) / rate;
+        }
+    }
+    return n / rate;
+}
+
+static bool parseRamp(const char* arg)
+{
+    if (sscanf(arg, "linear:%lf", &g_ramp.seconds) == 1 && g_ramp.seconds > 0) {
+        g_ramp.kind = RampProfile::LINEAR;
+    } else if (sscanf(arg, "step:%d:%lf", &g_ramp.steps, &g_ramp.seconds) == 2
+               && g_ramp.steps > 0 && g_ramp.seconds > 0) {
+        g_ramp.kind = RampProfile::STEP;
+    } else if (sscanf(arg, "burst:%lf:%lf:%lf", &g_ramp.factor, &g_ramp.period,
+                      &g_ramp.seconds) == 3
+               && g_ramp.factor > 0 && g_ramp.seconds > 0 && g_ramp.period > g_ramp.seconds) {
+        g_ramp.kind = RampProfile::BURST;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void sleepUntil(long long usecs)
+{
+    timespec when;
+    when.tv_sec = usecs / 1000000;
+    when.tv_nsec = (usecs % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, 0) == EINTR) {
+    }
+}
+
+static void recordLatency(Operation op, long long sentAt, int times = 1)
+{
+    long long usecs = monotonicMicros() - sentAt;
+    pthread_mutex_lock(&g_statsLock);
+    for (int ii = 0; ii < times; ii++) {
+        g_stepLatency[op].record(usecs);
+    }
+    pthread_mutex_unlock(&g_statsLock);
+}
+
+// How gSOAP opens connections, wrapped by timedConnect().
+static int (*g_tcpConnect)(struct soap*, const char*, const char*, int) = 0;
+
+static int timedConnect(struct soap* soap, const char* endpoint, const char* host, int port)
+{
+    long long start = monotonicMicros();
+    int socket = g_tcpConnect(soap, endpoint, host, port);
+    if (soap_valid_socket(socket)) {
+        recordLatency(OP_CONNECT, start);
+    }
+    return socket;
+}
+
+//
+// Records the time each connection service opens takes as Connect
+// latency. Must first be called before load threads start.
+//
+static void timeConnections(Service& service)
+{
+    if (!g_tcpConnect) {
+        g_tcpConnect = service.soap->fopen;
+    }
+    service.soap->fopen = timedConnect;
+}
+
+//
+// Called after a request failed on service. Returns true if it should
+// be sent again: its connection was lost, and fewer than g_retries
+// attempts have been made. The connection is then closed, so that the
+// next request opens a new one.
+//
+static bool retryRequest(Service& service, int& attempts)
+{
+    int error = service.soap->error;
+    if (attempts >= g_retries
+        || (error != SOAP_EOF && error != SOAP_TCP_ERROR && error != SOAP_SSL_ERROR)) {
+        return false;
+    }
+    attempts++;
+    service.soap->keep_alive = 0;
+    soap_closesock(service.soap);
+    pthread_mutex_lock(&g_statsLock);
+    g_reconnects++;
+    // The lost attempt counts as a request sent, like the one that
+    // completes the session.
+    g_requestsDone++;
+    pthread_mutex_unlock(&g_statsLock);
+    return true;
+}
+
+//
+// Starts count sessions from firstSession and waits for them to
+// complete. In open-loop mode dueAt is the time the sessions were
+// scheduled to start, and their publish and overall latency are
+// measured from then rather than from when the request was actually
+// sent.
+//
+static void startSessions(Service& service, RequestArena& arena, int firstSession, int count,
+                          long long dueAt)
+{
+    long long sentAt;
+    int attempts = 0;
+    struct __wsdl__PublishResponse response;
+    bzero(&response, sizeof response);
+    while (sendSessionPublish(service, arena, firstSession, count, sentAt) != SOAP_OK
+           || ifmapRecvPublish(service, response) != SOAP_OK) {
+        if (!dueAt) {
+            dueAt = sentAt;
+        }
+        if (!retryRequest(service, attempts)) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        resetArena(service, arena);
+    }
+    resetArena(service, arena);
+    if (!dueAt) {
+        dueAt = sentAt;
+    }
+    recordLatency(OP_PUBLISH, dueAt);
+
+    if (g_nosub) {
+        recordLatency(OP_SESSION, dueAt, count);
+        return;
+    }
+
+    __wsdl__SubscribeResponse subscribeResponse;
+    long long firstSentAt = 0;
+    attempts = 0;
+    while (sendSessionSubscribe(service, arena, firstSession, count, sentAt) != SOAP_OK
+           || ifmapRecvSubscribe(service, subscribeResponse) != SOAP_OK) {
+        if (!firstSentAt) {
+            firstSentAt = sentAt;
+        }
+        if (!retryRequest(service, attempts)) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        resetArena(service, arena);
+    }
+    resetArena(service, arena);
+    recordLatency(OP_SUBSCRIBE, firstSentAt ? firstSentAt : sentAt);
+    recordLatency(OP_SESSION, dueAt, count);
+}
+
+static void purgePublisher(Service& service, const char* publisherId)
+{
+    long long start = monotonicMicros();
+
+    ifmap__PurgePublisherRequestType purgePublisherRequest;
+    purgePublisherRequest.soap = service.soap;
+    purgePublisherRequest.publisher_id = soap_strdup(service.soap, publisherId);
+    struct __wsdl__PurgePublisherResponse response;
+    bzero(&response, sizeof response);
+    int code = service.__wsdl__PurgePublisher(&purgePublisherRequest, response);
+    if (code != SOAP_OK) {
+        fprintf(stderr, "Could not purge:\n");
+        soap_print_fault(service.soap, stderr);
+    }
+    recordLatency(OP_PURGE_PUBLISHER, start);
+    float total = (float)(monotonicMicros() - start) / 1000000.0;
+
+    printf("Time to purge: %g\n", total);
+    fflush(stdout);
+}
+
+//
+// Hands out the next batch of up to g_batch sessions to start. Returns
+// false when all sessions have been handed out. In open-loop mode dueAt
+// is set to the time the last session of the batch is scheduled to
+// start, otherwise to 0.
+//
+static bool nextSessions(int& firstSession, int& count, long long& dueAt)
+{
+    pthread_mutex_lock(&g_statsLock);
+    if (g_soak && g_nextSession >= g_endSession) {
+        g_nextSession = g_start;
+    }
+    bool more = g_nextSession < g_endSession;
+    if (more) {
+        firstSession = g_nextSession;
+        count = g_endSession - firstSession;
+        if (count > g_batch) {
+            count = g_batch;
+        }
+        g_nextSession += count;
+        g_sessionsScheduled += count;
+        dueAt = 0;
+        if (g_rate > 0) {
+            dueAt = g_scheduleStart
+                + (long long)(scheduledOffset(g_sessionsScheduled - 1) * 1000000.0);
+        }
+    }
+    pthread_mutex_unlock(&g_statsLock);
+    return more;
+}
+
+static void openLatencyDump()
+{
+    if (!g_latencyDumpFile) {
+        return;
+    }
+    g_latencyDump = fopen(g_latencyDumpFile, "w");
+    if (!g_latencyDump) {
+        perror(g_latencyDumpFile);
+        exit(1);
+    }
+    size_t len = strlen(g_latencyDumpFile);
+    g_latencyDumpCsv = len > 4 && strcmp(g_latencyDumpFile + len - 4, ".csv") == 0;
+    if (g_latencyDumpCsv) {
+        fprintf(g_latencyDump, "scope,sessions,operation,count,min,mean,p50,p90,p99,p99.9,max\n");
+    } else {
+        fprintf(g_latencyDump, "{\"steps\": [");
+    }
+}
+
+//
+// Writes one step's (or the whole run's) histograms to the latency dump
+// file. scope is "step" or "total".
+//
+static void dumpLatency(const char* scope, int sessions, const LatencyHistogram* latency)
+{
+    if (!g_latencyDump) {
+        return;
+    }
+    bool total = strcmp(scope, "total") == 0;
+    if (g_latencyDumpCsv) {
+        for (int op = 0; op < NUM_OPERATIONS; op++) {
+            if (total) {
+                fprintf(g_latencyDump, "total,%d,%s,", sessions, g_operationNames[op]);
+            } else {
+                fprintf(g_latencyDump, "step%d,%d,%s,", g_stepNum, sessions, g_operationNames[op]);
+            }
+            latency[op].writeCsv(g_latencyDump);
+            fprintf(g_latencyDump, "\n");
+        }
+        return;
+    }
+    if (total) {
+        fprintf(g_latencyDump, "],\n \"total\": {\"sessions\": %d", sessions);
+    } else {
+        fprintf(g_latencyDump, "%s\n  {\"step\": %d, \"sessions\": %d",
+                g_stepNum > 1 ? "," : "", g_stepNum, sessions);
     }
-    
-    struct __wsdl__AttachSessionResponse response;
-    bzero(&response, sizeof response);
-
-    SOAP_ENV__Header header;
-    bzero(&header, sizeof header);
-    header.ifmap__attach_session = const_cast<char*>(sessionId);
-    service.soap->header = &header;
+    for (int op = 0; op < NUM_OPERATIONS; op++) {
+        fprintf(g_latencyDump, ", \"%s\": ", g_operationNames[op]);
+        latency[op].writeJson(g_latencyDump);
+    }
+    fprintf(g_latencyDump, "}");
+}
 
-    int code = service.__wsdl__AttachSession("", response);
-    if (code) {
-        soap_print_fault(service.soap, stderr);
-        exit(1);
+static void closeLatencyDump()
+{
+    if (!g_latencyDump) {
+        return;
     }
+    if (!g_latencyDumpCsv) {
+        fprintf(g_latencyDump, "}\n");
+    }
+    fclose(g_latencyDump);
+    g_latencyDump = 0;
+}
 
-    while (true) {
-        ifmap__PollRequestType pollRequest;
-        __wsdl__PollResponse pollResponse;
-        code = service.__wsdl__Poll(&pollRequest, pollResponse);
-        if (code) {
-            soap_print_fault(service.soap, stderr);
-            exit(1);
-        }
-        if (pollResponse.ifmap__response) {
-            if (pollResponse.ifmap__response->__union_ResponseType !=
-                SOAP_UNION__ifmap__union_ResponseType_pollResult) {
-                fprintf(stderr, "Unexpected result type: %d",
-                        pollResponse.ifmap__response->__union_ResponseType);
-                continue;
-            }
-            ifmap__PollResultType* pollResult = pollResponse.ifmap__response->union_ResponseType.pollResult;
-            for (int ii = 0; ii < pollResult->__size_PollResultType; ii++) {
-                if (pollResult->__union_PollResultType[ii].__union_PollResultType
-                    == SOAP_UNION__ifmap__union_PollResultType_searchResult) {
-                    displaySearchResult(*pollResult->__union_PollResultType[ii].union_PollResultType.searchResult);
-                }
-            }
+static void printLatency(const char* title, const LatencyHistogram* latency)
+{
+    printf("%s latency (usec):\n", title);
+    for (int op = 0; op < NUM_OPERATIONS; op++) {
+        if (latency[op].count()) {
+            latency[op].print(stdout, g_operationNames[op]);
         }
     }
 }
 
-static void getIp(int sessionNum, char* result, int resultSize)
+//
+// Moves the current step's latencies into the whole-run histograms.
+// Must be called with g_statsLock held.
+//
+static void endStep(int sessions)
 {
-    int ip = g_startIp + sessionNum;
-    snprintf(result, resultSize, "%d.%d.%d.%d", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+    g_stepNum++;
+    dumpLatency("step", sessions, g_stepLatency);
+    for (int op = 0; op < NUM_OPERATIONS; op++) {
+        g_totalLatency[op].add(g_stepLatency[op]);
+        g_stepLatency[op].reset();
+    }
 }
 
-static soap_dom_element*
-createCapabilityElements(struct soap* soap, const std::vector<char*>& roles, int& count)
+//
+// Prints the resident set size now, its change since the start of the
+// step, and its peak so far. Returns the current size in KB.
+//
+static long printMemory(long stepStartRss)
 {
-    soap_dom_element* save = soap->dom;
-    std::vector<soap_dom_element*> elems;
-    int ii;
-    for (ii = 0; ii < roles.size(); ii++) {
-        soap->dom = 0;
-        _meta__capability capability;
-        capability.name = roles[ii];
-        capability.soap_out(soap, "meta:capability", 0, 0);
-        elems.push_back(soap->dom);
+    long rss = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        long size, resident;
+        if (fscanf(statm, "%ld %ld", &size, &resident) == 2) {
+            rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+        fclose(statm);
     }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Memory: rss %ld KB (%+ld KB this step), peak rss %ld KB\n",
+           rss, rss - stepStartRss, usage.ru_maxrss);
+    return rss;
+}
 
-    soap_dom_element* result = 0;
-    count = elems.size();
-    if (count) {
-        result = soap_new_xsd__anyType(soap, count);
-        for (ii = 0; ii < elems.size(); ii++) {
-            result[ii] = *elems[ii];
+//
+// Counts started sessions and the requests it took to start them, and
+// prints step statistics for all threads combined whenever another
+// g_step sessions have been started.
+//
+static void sessionsDone(int count)
+{
+    pthread_mutex_lock(&g_statsLock);
+    long long before = g_sessionsDone;
+    g_sessionsDone += count;
+    g_requestsDone += g_nosub ? 1 : 2;
+    if (g_sessionsDone / g_step != before / g_step) {
+        long long stepDone = monotonicMicros();
+        float total = (float)(stepDone - g_stepStart) / 1000000.0;
+        int sessions = (int)(g_sessionsDone - g_stepFirstSession);
+        int requests = (int)(g_requestsDone - g_stepFirstRequest);
+        printf("%lld sessions so far\n", g_sessionsDone);
+        printf("step: Time to start %d sessions: %g\n", sessions, total);
+        printf("That's %g sessions/second.\n", (float)sessions / total);
+        printf("That's %g requests/second.\n", (float)requests / total);
+        if (g_retries) {
+            printf("Reconnects: %lld\n", g_reconnects - g_stepFirstReconnect);
         }
+        collectPollLatency();
+        printLatency("step", g_stepLatency);
+        g_stepStartRss = printMemory(g_stepStartRss);
+        fflush(stdout);
+        endStep(sessions);
+        g_stepStart = stepDone;
+        g_stepFirstSession = g_sessionsDone;
+        g_stepFirstRequest = g_requestsDone;
+        g_stepFirstReconnect = g_reconnects;
     }
-
-    soap->dom = save;
-    return result;
+    pthread_mutex_unlock(&g_statsLock);
 }
 
-static ifmap__IdentifierType*
-createAccessRequestIdentifier(struct soap* soap, const char* domain, const char* name)
+static void runSessions(Service& service, RequestArena& arena)
 {
-    ifmap__AccessRequestType* accessRequest = soap_new_ifmap__AccessRequestType(soap, -1);
-    if (domain && *domain) {
-        accessRequest->administrative_domain = soap_strdup(soap, domain);
+    int firstSession;
+    int count;
+    long long dueAt;
+    while (nextSessions(firstSession, count, dueAt)) {
+        if (dueAt) {
+            sleepUntil(dueAt);
+        }
+        startSessions(service, arena, firstSession, count, dueAt);
+        sessionsDone(count);
     }
-    accessRequest->name = soap_strdup(soap, name);
-    ifmap__IdentifierType* identifier = soap_new_ifmap__IdentifierType(soap, -1);
-    identifier->__union_IdentifierType
-        = SOAP_UNION__ifmap__union_IdentifierType_access_request;
-    identifier->union_IdentifierType.access_request = accessRequest;
-    return identifier;
 }
 
-static ifmap__IdentifierType*
-createIpAddressIdentifier(struct soap* soap, const char* domain, int type, const char* ip)
+//
+// Under --no-keepalive, makes service close its connection after each
+// response from now on.
+//
+static void dropKeepAlive(Service& service)
 {
-    ifmap__IPAddressType* ipAddr = soap_new_ifmap__IPAddressType(soap, -1);
-    if (domain && *domain) {
-        ipAddr->administrative_domain = soap_strdup(soap, domain);
+    if (g_noKeepAlive) {
+        service.soap->imode &= ~SOAP_IO_KEEPALIVE;
+        service.soap->omode &= ~SOAP_IO_KEEPALIVE;
     }
-    ipAddr->type = static_cast<_ifmap__IPAddressType_type>(type);
-    ipAddr->value = soap_strdup(soap, ip);
-    ifmap__IdentifierType* identifier = soap_new_ifmap__IdentifierType(soap, -1);
-    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
-    identifier->union_IdentifierType.ip_address = ipAddr;
-    return identifier;
 }
 
-static ifmap__IdentifierType*
-createIdentityIdentifier(struct soap* soap, const char* domain, const char* name,
-                         int type, const char* other)
+//
+// Opens a connection for a load thread or pipeline slot, attaching to
+// the main session unless --own-sessions was given, and sets up its
+// arena.
+//
+static void connectWorker(Service& service, RequestArena& arena, const char* url,
+                          const char* sessionId, const char* publisherId)
 {
-    ifmap__IdentityType* identity = soap_new_ifmap__IdentityType(soap, -1);
-    if (domain && *domain) {
-        identity->administrative_domain = soap_strdup(soap, domain);
+    service.endpoint = url;
+    service.soap->imode |= SOAP_IO_KEEPALIVE;
+    service.soap->omode |= SOAP_IO_KEEPALIVE;
+
+    useClientCredentials(service);
+    timeConnections(service);
+    int code;
+    if (g_ownSessions) {
+        code = ifmapConnect(service);
+    } else {
+        code = ifmapAttach(service, sessionId);
     }
-    identity->name = soap_strdup(soap, name);
-    identity->type = static_cast<_ifmap__IdentityType_type>(type);
-    if (other && *other) {
-        identity->other_type_definition = soap_strdup(soap, other);
+    if (code != SOAP_OK) {
+        fprintf(stderr, "Could not connect to %s:\n", url);
+        soap_print_fault(service.soap, stderr);
+        exit(1);
     }
-    ifmap__IdentifierType* identifier = soap_new_ifmap__IdentifierType(soap, -1);
-    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_identity;
-    identifier->union_IdentifierType.identity = identity;
-    return identifier;
+    dropKeepAlive(service);
+    initArena(service, arena, g_ownSessions ? 0 : publisherId);
 }
 
-static ifmap__IdentifierType*
-createDeviceIdentifier(struct soap* soap, int type, const char* name)
+//
+// One of the g_inflight connections used by runPipeline(). Each has at
+// most one request outstanding, which is written by sender as the
+// connection takes it and then read by receiver as it arrives.
+//
+struct PipelineSlot
 {
-    ifmap__DeviceType* device = soap_new_ifmap__DeviceType(soap, -1);
-    device->__union_DeviceType = type;
+    enum State { IDLE, WAITING, PUBLISHING, SUBSCRIBING };
 
-    char* deviceName = soap_strdup(soap, name);
-    if (type == SOAP_UNION__ifmap__union_DeviceType_name) {
-        device->union_DeviceType.name = deviceName;
-    } else {
-        device->union_DeviceType.aik_name = deviceName;
-    }
+    Service service;
+    RequestArena arena;
+    RequestSender sender;
+    ResponseReceiver receiver;
+    State state;
+    int firstSession;
+    int count;
+    int fd;
+    int attempts;
+    long long dueAt;
+    long long sentAt;
+};
 
-    ifmap__IdentifierType* identifier = soap_new_ifmap__IdentifierType(soap, -1);
-    identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_device;
-    identifier->union_IdentifierType.device = device;
-    return identifier;
+//
+// Waits for a slot's connection to take more of its request or, once
+// all of it is written, for the response.
+//
+static void watchSlot(int epollFd, PipelineSlot* slot)
+{
+    epoll_event event;
+    event.events = (slot->sender.done() ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+    event.data.ptr = slot;
+    slot->fd = slot->service.soap->socket;
+    // The socket may be new if the server closed the previous one
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, slot->fd, &event) == -1
+        && (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, slot->fd, &event) == -1)) {
+        perror("epoll_ctl");
+        exit(1);
+    }
 }
 
-static ifmap__MetadataListType*
-createMetadataList(struct soap* soap, soap_dom_element* elems, int count)
+//
+// Writes as much of a slot's request as its connection takes now, and
+// waits for the rest to be taken or for the response.
+//
+static int writeRequest(int epollFd, PipelineSlot* slot)
 {
-    ifmap__MetadataListType* list = soap_new_ifmap__MetadataListType(soap, -1);
-    list->__size = count;
-    list->__any = elems;
-    return list;
+    if (slot->sender.write(slot->service) != SOAP_OK) {
+        return slot->service.soap->error;
+    }
+    if (slot->sender.done()) {
+        slot->receiver.begin(slot->service);
+    }
+    watchSlot(epollFd, slot);
+    return SOAP_OK;
 }
 
-static ifmap__PublishType*
-createIdentifierUpdate(struct soap* soap, ifmap__IdentifierType* identifier,
-                       ifmap__MetadataListType* metadata)
+static void sendPublish(int epollFd, PipelineSlot* slot)
 {
-    ifmap__PublishType* update = soap_new_ifmap__PublishType(soap, -1);
-    update->__union_PublishType = SOAP_UNION__ifmap__union_PublishType_identifier;
-    update->union_PublishType.identifier = identifier;
-    update->metadata = metadata;
-    return update;
+    slot->state = PipelineSlot::PUBLISHING;
+    while (sendSessionPublish(slot->service, slot->arena, slot->firstSession, slot->count,
+                              slot->sentAt, &slot->sender) != SOAP_OK
+           || writeRequest(epollFd, slot) != SOAP_OK) {
+        if (!slot->dueAt) {
+            slot->dueAt = slot->sentAt;
+        }
+        if (!retryRequest(slot->service, slot->attempts)) {
+            soap_print_fault(slot->service.soap, stderr);
+            exit(1);
+        }
+        resetArena(slot->service, slot->arena);
+    }
+    if (!slot->dueAt) {
+        slot->dueAt = slot->sentAt;
+    }
 }
 
-static ifmap__LinkType*
-createLink(struct soap* soap, ifmap__IdentifierType* identifier0,
-           ifmap__IdentifierType* identifier1)
+//
+// Sends the subscribe for the sessions a slot has published. A retried
+// request's latency is measured from its first attempt.
+//
+static void sendSubscribe(int epollFd, PipelineSlot* slot)
 {
-    ifmap__LinkType* link = soap_new_ifmap__LinkType(soap, -1);
-    link->__sizeidentifier = 2;
-    link->identifier = (ifmap__IdentifierType**)soap_malloc(soap, sizeof(ifmap__IdentifierType*) * 2);
-    link->identifier[0] = identifier0;
-    link->identifier[1] = identifier1;
-    return link;
+    slot->state = PipelineSlot::SUBSCRIBING;
+    while (true) {
+        long long sentAt;
+        int code = sendSessionSubscribe(slot->service, slot->arena, slot->firstSession,
+                                        slot->count, sentAt, &slot->sender);
+        if (!slot->attempts) {
+            slot->sentAt = sentAt;
+        }
+        if (code == SOAP_OK) {
+            code = writeRequest(epollFd, slot);
+        }
+        if (code == SOAP_OK) {
+            break;
+        }
+        if (!retryRequest(slot->service, slot->attempts)) {
+            soap_print_fault(slot->service.soap, stderr);
+            exit(1);
+        }
+        resetArena(slot->service, slot->arena);
+    }
 }
 
-static ifmap__PublishType*
-createLinkUpdate(struct soap* soap, ifmap__IdentifierType* identifier0,
-                 ifmap__IdentifierType* identifier1,
-                 ifmap__MetadataListType* metadata)
+//
+// Sends the publish for the next session on an idle slot, or leaves the
+// slot WAITING if the session is not due yet. Returns false when there
+// are no sessions left to start.
+//
+static bool startNextSession(int epollFd, PipelineSlot* slot)
 {
-    ifmap__LinkType* link = createLink(soap, identifier0, identifier1);
-    ifmap__PublishType* update = soap_new_ifmap__PublishType(soap, -1);
-    update->__union_PublishType = SOAP_UNION__ifmap__union_PublishType_link;
-    update->union_PublishType.link = link;
-    update->metadata = metadata;
-    return update;
+    if (!nextSessions(slot->firstSession, slot->count, slot->dueAt)) {
+        slot->state = PipelineSlot::IDLE;
+        return false;
+    }
+    if (slot->dueAt > monotonicMicros()) {
+        slot->state = PipelineSlot::WAITING;
+        return true;
+    }
+    sendPublish(epollFd, slot);
+    return true;
 }
 
-static void startSession(Service& service, int sessionNum, const char* pubId)
+//
+// Writes more of a slot's request, or reads what has arrived of its
+// response, without waiting on the connection. Once the response is
+// complete, sends the slot's next request. Returns false when the slot
+// has gone idle.
+//
+static bool continueSession(int epollFd, PipelineSlot* slot)
 {
-    if (g_verbose) {
-        printf("startSession %d\n", sessionNum);
-        fflush(stdout);
+    Service& service = slot->service;
+    int code;
+    if (!slot->sender.done()) {
+        code = writeRequest(epollFd, slot);
+        if (code == SOAP_OK) {
+            return true;
+        }
+    } else {
+        code = slot->receiver.read(service);
+        if (code == SOAP_OK && !slot->receiver.done()) {
+            watchSlot(epollFd, slot);
+            return true;
+        }
     }
-    char userName[50];
-    snprintf(userName, sizeof userName, "user%06d", sessionNum);
-    char device[50];
-    snprintf(device, sizeof device, "device%06d", sessionNum);
-    char accessRequest[50];
-    snprintf(accessRequest, sizeof accessRequest, "%s:ar%06d", pubId, sessionNum);
-    char ip[50];
-    getIp(sessionNum, ip, sizeof ip);
-
-    ifmap__IdentifierType* accessRequestIdent
-        = createAccessRequestIdentifier(service.soap, 0, accessRequest);
-    ifmap__IdentifierType* ipAddressIdent
-        = createIpAddressIdentifier(service.soap, 0, _ifmap__IPAddressType_type__IPv4, ip);
-    ifmap__IdentifierType* identityIdent
-        = createIdentityIdentifier(service.soap, 0, userName, _ifmap__IdentityType_type__username, 0);
-    ifmap__IdentifierType* myIpIdent
-        = createIpAddressIdentifier(service.soap, 0, _ifmap__IPAddressType_type__IPv4, g_myIp);
-    ifmap__IdentifierType* deviceIdent =
-        createDeviceIdentifier(service.soap, SOAP_UNION__ifmap__union_DeviceType_name, device);
-    
-    // capability
-    struct soap metaSoap(SOAP_XML_DOM);
-    std::vector<char*> roles;
-    roles.push_back("role1");
-    roles.push_back("role2");
-    roles.push_back("role3");
-    roles.push_back("role4");
-    roles.push_back("role5");
-    int count;
-    soap_dom_element* elems = ::createCapabilityElements(&metaSoap, roles, count);
-    ifmap__MetadataListType* caps = createMetadataList(service.soap, elems, count);
-    ifmap__PublishType* accessRequestUpdate
-        = createIdentifierUpdate(service.soap, accessRequestIdent, caps);
-
-    // authenticated-as
-    _meta__authenticated_as authenticatedAs;
-    authenticatedAs.soap_out(&metaSoap, "meta:authenticated-as", 0, 0);
-    ifmap__MetadataListType authenticatedAsMetadata;
-    authenticatedAsMetadata.__size = 1;
-    authenticatedAsMetadata.__any = metaSoap.dom;
-    metaSoap.dom = 0;
-    ifmap__PublishType* authenticatedAsUpdate
-        = createLinkUpdate(service.soap, accessRequestIdent, identityIdent, &authenticatedAsMetadata);
-    
-    // access-request-ip
-    ifmap__MetadataListType accessRequestIpMetadataList;
-    ifmap__PublishType* accessRequestIpUpdate = 0;
-    _meta__access_request_ip accessRequestIpMetadata;
-    accessRequestIpMetadata.soap_out(&metaSoap, "meta:access-request-ip", 0, 0);
-    accessRequestIpMetadataList.__size = 1;
-    accessRequestIpMetadataList.__any = metaSoap.dom;
-    metaSoap.dom = 0;
-    accessRequestIpUpdate
-        = createLinkUpdate(service.soap, accessRequestIdent, ipAddressIdent, &accessRequestIpMetadataList);
-
-    // access-request-device
-    _meta__access_request_device accessRequestDeviceMetadata;
-    accessRequestDeviceMetadata.soap_out(&metaSoap, "meta:access-request-device", 0, 0);
-    ifmap__MetadataListType accessRequestDeviceMetadataList;
-    accessRequestDeviceMetadataList.__size = 1;
-    accessRequestDeviceMetadataList.__any = metaSoap.dom;
-    metaSoap.dom = 0;
-    ifmap__PublishType* accessRequestDeviceUpdate
-        = createLinkUpdate(service.soap, accessRequestIdent, deviceIdent, &accessRequestDeviceMetadataList);
 
-    // authenticated-by
-    _meta__authenticated_by authenticatedByMetadata;
-    authenticatedByMetadata.soap_out(&metaSoap, "meta:authenticated-by", 0, 0);
-    ifmap__MetadataListType authenticatedByMetadataList;
-    authenticatedByMetadataList.__size = 1;
-    authenticatedByMetadataList.__any = metaSoap.dom;
-    metaSoap.dom = 0;
-    ifmap__PublishType* authenticatedByUpdate
-        = createLinkUpdate(service.soap, accessRequestIdent, myIpIdent, &authenticatedByMetadataList);
-
-    __ifmap__union_PublishRequestType updateArray[7];
-    int numUpdates = 0;
-    updateArray[numUpdates].__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-    updateArray[numUpdates++].union_PublishRequestType.update = accessRequestUpdate;
-    updateArray[numUpdates].__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-    updateArray[numUpdates++].union_PublishRequestType.update = authenticatedAsUpdate;
-    updateArray[numUpdates].__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-    updateArray[numUpdates++].union_PublishRequestType.update = accessRequestIpUpdate;
-    updateArray[numUpdates].__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-    updateArray[numUpdates++].union_PublishRequestType.update = accessRequestDeviceUpdate;
-    updateArray[numUpdates].__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
-    updateArray[numUpdates++].union_PublishRequestType.update = authenticatedByUpdate;
+    struct __wsdl__PublishResponse response;
+    __wsdl__SubscribeResponse subscribeResponse;
+    if (code == SOAP_OK) {
+        code = slot->state == PipelineSlot::PUBLISHING
+            ? slot->receiver.parsePublish(service, response)
+            : slot->receiver.parseSubscribe(service, subscribeResponse);
+    }
+    if (code != SOAP_OK) {
+        if (!retryRequest(service, slot->attempts)) {
+            soap_print_fault(service.soap, stderr);
+            exit(1);
+        }
+        resetArena(service, slot->arena);
+        if (slot->state == PipelineSlot::PUBLISHING) {
+            sendPublish(epollFd, slot);
+        } else {
+            sendSubscribe(epollFd, slot);
+        }
+        return true;
+    }
 
-    ifmap__PublishRequestType publishRequest;
-    publishRequest.__size_PublishRequestType = sizeof updateArray/sizeof *updateArray;
-    publishRequest.__union_PublishRequestType = updateArray;
+    if (slot->state == PipelineSlot::PUBLISHING) {
+        slot->attempts = 0;
+        resetArena(service, slot->arena);
+        recordLatency(OP_PUBLISH, slot->dueAt);
+        if (!g_nosub) {
+            sendSubscribe(epollFd, slot);
+            return true;
+        }
+    } else {
+        slot->attempts = 0;
+        resetArena(service, slot->arena);
+        recordLatency(OP_SUBSCRIBE, slot->sentAt);
+    }
+    recordLatency(OP_SESSION, slot->dueAt, slot->count);
+    sessionsDone(slot->count);
+    return startNextSession(epollFd, slot);
+}
 
-    struct __wsdl__PublishResponse response;
-    bzero(&response, sizeof response);
-    int code = service.__wsdl__Publish(&publishRequest, response);
-    if (code != 0) {
-        soap_print_fault(service.soap, stderr);
+//
+// Starts sessions over g_inflight connections at once, sending each
+// connection's next request as soon as its previous response has been
+// read.
+//
+static void runPipeline(const char* url, const char* sessionId, const char* publisherId)
+{
+    int epollFd = epoll_create(g_inflight);
+    if (epollFd == -1) {
+        perror("epoll_create");
         exit(1);
     }
 
-    if (g_nosub) {
-        return;
+    std::vector<PipelineSlot*> slots(g_inflight);
+    int active = 0;
+    int ii;
+    for (ii = 0; ii < g_inflight; ii++) {
+        slots[ii] = new PipelineSlot;
+        slots[ii]->state = PipelineSlot::IDLE;
+        slots[ii]->fd = -1;
+        slots[ii]->attempts = 0;
+        connectWorker(slots[ii]->service, slots[ii]->arena, url, sessionId, publisherId);
+    }
+    for (ii = 0; ii < g_inflight; ii++) {
+        if (startNextSession(epollFd, slots[ii])) {
+            active++;
+        }
     }
 
-    _ifmap__SubscribeRequestType_update update;
-    std::string name("o:");
-    name += accessRequest;
-    update.name = const_cast<char*>(name.c_str());
-    update.identifier = accessRequestIdent;
-    update.match_links = "meta:ip-mac or meta:access-request-ip or meta:access-request-mac"
-        " or meta:access-request-device or meta:authenticated-as";
-    update.result_filter = "meta:ip-mac or meta:event";
-    update.max_depth = "3";
+    while (active) {
+        // Wake up in time for the earliest session that is not due yet
+        int timeout = -1;
+        long long now = monotonicMicros();
+        for (ii = 0; ii < g_inflight; ii++) {
+            if (slots[ii]->state == PipelineSlot::WAITING) {
+                int wait = (int)((slots[ii]->dueAt - now + 999) / 1000);
+                if (wait < 0) {
+                    wait = 0;
+                }
+                if (timeout == -1 || wait < timeout) {
+                    timeout = wait;
+                }
+            }
+        }
 
-    ifmap__SubscribeRequestType subscribeRequest;
-    subscribeRequest.__size_SubscribeRequestType = 1;
-    __ifmap__union_SubscribeRequestType req;
-    req.__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_update;
-    req.union_SubscribeRequestType.update = &update;
-    subscribeRequest.__union_SubscribeRequestType = &req;
+        epoll_event events[64];
+        int count = epoll_wait(epollFd, events, sizeof events/sizeof *events, timeout);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(1);
+        }
+        for (ii = 0; ii < count; ii++) {
+            if (!continueSession(epollFd, (PipelineSlot*)events[ii].data.ptr)) {
+                active--;
+            }
+        }
 
-    __wsdl__SubscribeResponse subscribeResponse;
-    code = service.__wsdl__Subscribe(&subscribeRequest, subscribeResponse);
-    if (code != 0) {
-        soap_print_fault(service.soap, stderr);
-        exit(1);
+        now = monotonicMicros();
+        for (ii = 0; ii < g_inflight; ii++) {
+            if (slots[ii]->state == PipelineSlot::WAITING && slots[ii]->dueAt <= now) {
+                sendPublish(epollFd, slots[ii]);
+            }
+        }
+    }
+
+    for (ii = 0; ii < g_inflight; ii++) {
+        delete slots[ii];
     }
+    close(epollFd);
 }
 
-static void purgePublisher(Service& service, const char* publisherId)
+struct LoadWorker
 {
-    timeval start;
-    gettimeofday(&start, 0);
+    pthread_t thread;
+    const char* url;
+    const char* sessionId;
+    const char* publisherId;
+};
 
-    ifmap__PurgePublisherRequestType purgePublisherRequest;
-    purgePublisherRequest.soap = service.soap;
-    purgePublisherRequest.publisher_id = soap_strdup(service.soap, publisherId);
-    struct __wsdl__PurgePublisherResponse response;
-    bzero(&response, sizeof response);
-    int code = service.__wsdl__PurgePublisher(&purgePublisherRequest, response);
-    if (code != SOAP_OK) {
-        fprintf(stderr, "Could not purge:\n");
-        soap_print_fault(service.soap, stderr);
+static void* runLoadWorker(void* arg)
+{
+    LoadWorker* worker = (LoadWorker*)arg;
+    if (g_inflight > 1) {
+        runPipeline(worker->url, worker->sessionId, worker->publisherId);
+        return 0;
     }
-    timeval done;
-    gettimeofday(&done, 0);
-    
-    timeval diff;
-    timersub(&done, &start, &diff);
-
-    int msecs = diff.tv_sec * 1000 + diff.tv_usec / 1000;
-    float total = (float)msecs / 1000.0;
 
-    printf("Time to purge: %g\n", total);
-    fflush(stdout);
+    Service service;
+    RequestArena arena;
+    connectWorker(service, arena, worker->url, worker->sessionId, worker->publisherId);
+    runSessions(service, arena);
+    return 0;
 }
 
 static void loadTest(const char* url, int numSessions)
@@ -594,6 +1756,8 @@ static void loadTest(const char* url, int numSessions)
     service.endpoint = url;
     service.soap->imode |= SOAP_IO_KEEPALIVE;
     service.soap->omode |= SOAP_IO_KEEPALIVE;
+    useClientCredentials(service);
+    timeConnections(service);
 
     int code = ifmapConnect(service);
     if (code != SOAP_OK) {
@@ -601,50 +1765,77 @@ static void loadTest(const char* url, int numSessions)
         soap_print_fault(service.soap, stderr);
         exit(1);
     }
-    const char* publisherId = service.soap->header->ifmap__publisher_id;
-    service.soap->header->ifmap__publisher_id = 0;
+    dropKeepAlive(service);
+    RequestArena arena;
+    initArena(service, arena, 0);
+    const char* sessionId = arena.sessionId.c_str();
+    const char* publisherId = arena.publisherId.c_str();
     
-    printf("got session id: %s\n", service.soap->header->ifmap__session_id);
+    printf("got session id: %s\n", sessionId);
     fflush(stdout);
+    openLatencyDump();
     if (g_purgePublisher) {
         purgePublisher(service, publisherId);
+        resetArena(service, arena);
     }
-    startPolling(url, service.soap->header->ifmap__session_id);
-
-    timeval start;
-    gettimeofday(&start, 0);
+    if (g_verifyEncoder) {
+        verifyEncoder(service, arena);
+    }
+    if (!g_nosub && !g_ownSessions) {
+        sharePublishTimes(numSessions);
+    }
+    startPolling(url, sessionId);
 
-    timeval stepStart = start;
+    g_nextSession = g_start;
+    g_endSession = g_start + numSessions;
 
-    for (int ii = 0; ii < numSessions; ii++) {
-        startSession(service, ii + g_start, publisherId);
-        if ((ii + 1) % g_step == 0) {
-            timeval stepDone;
-            gettimeofday(&stepDone, 0);
-            timeval diff;
-            timersub(&stepDone, &stepStart, &diff);
+    long long start = monotonicMicros();
+    g_stepStart = start;
+    g_scheduleStart = start;
+    if (g_runStartAt) {
+        *g_runStartAt = start;
+    }
 
-            int msecs = diff.tv_sec * 1000 + diff.tv_usec / 1000;
-            float total = (float)msecs / 1000.0;
-            printf("%d sessions so far\n", ii + 1);
-            printf("step: Time to start %d sessions: %g\n", g_step, total);
-            printf("That's %g sessions/second.\n", (float)g_step / total);
-            fflush(stdout);
-            stepStart = stepDone;
+    if (g_threads == 1 && g_inflight == 1) {
+        runSessions(service, arena);
+    } else if (g_threads == 1) {
+        runPipeline(url, sessionId, publisherId);
+    } else {
+        std::vector<LoadWorker> workers(g_threads);
+        int ii;
+        for (ii = 0; ii < g_threads; ii++) {
+            workers[ii].url = url;
+            workers[ii].sessionId = sessionId;
+            workers[ii].publisherId = publisherId;
+            if (pthread_create(&workers[ii].thread, 0, runLoadWorker, &workers[ii])) {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+        for (ii = 0; ii < g_threads; ii++) {
+            pthread_join(workers[ii].thread, 0);
         }
     }
     printf("Done with sessions\n");
-    timeval done;
-    gettimeofday(&done, 0);
-    
-    timeval diff;
-    timersub(&done, &start, &diff);
-
-    int msecs = diff.tv_sec * 1000 + diff.tv_usec / 1000;
-    float total = (float)msecs / 1000.0;
+    float total = (float)(monotonicMicros() - start) / 1000000.0;
     printf("Time to start %d sessions: %g\n", numSessions, total);
     printf("That's %g sessions/second.\n", (float)numSessions / total);
+    printf("That's %g requests/second.\n", (float)g_requestsDone / total);
+    if (g_retries) {
+        printf("Reconnects: %lld\n", g_reconnects);
+    }
+    collectPollLatency();
+    if (g_sessionsDone > g_stepFirstSession) {
+        endStep(g_sessionsDone - g_stepFirstSession);
+    } else {
+        // Polls still count after the last full step.
+        g_totalLatency[OP_POLL].add(g_stepLatency[OP_POLL]);
+    }
+    printLatency("Overall", g_totalLatency);
+    printPollerSummary();
     fflush(stdout);
+    dumpLatency("total", numSessions, g_totalLatency);
+    closeLatencyDump();
 
     if (g_pause) {
         pause();
@@ -695,6 +1886,86 @@ int main(int argc, char* argv[])
                 fprintf(stderr, "start must be greater than or equal to 0\n");
                 exit(1);
             }
+        } else if (strcmp(*argv, "--threads") == 0) {
+            argc--;
+            argv++;
+            g_threads = atoi(*argv);
+            if (g_threads <= 0) {
+                fprintf(stderr, "threads must be greater than 0\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--own-sessions") == 0) {
+            g_ownSessions = true;
+        } else if (strcmp(*argv, "--inflight") == 0) {
+            argc--;
+            argv++;
+            g_inflight = atoi(*argv);
+            if (g_inflight <= 0) {
+                fprintf(stderr, "inflight must be greater than 0\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--latency-dump") == 0) {
+            argc--;
+            argv++;
+            g_latencyDumpFile = *argv;
+        } else if (strcmp(*argv, "--rate") == 0) {
+            argc--;
+            argv++;
+            g_rate = atof(*argv);
+            if (g_rate <= 0) {
+                fprintf(stderr, "rate must be greater than 0\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--request-rate") == 0) {
+            argc--;
+            argv++;
+            g_requestRate = atof(*argv);
+            if (g_requestRate <= 0) {
+                fprintf(stderr, "request-rate must be greater than 0\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--ramp") == 0) {
+            argc--;
+            argv++;
+            if (!parseRamp(*argv)) {
+                fprintf(stderr, "Unable to parse ramp profile %s\n", *argv);
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--batch") == 0) {
+            argc--;
+            argv++;
+            g_batch = atoi(*argv);
+            if (g_batch <= 0) {
+                fprintf(stderr, "batch must be greater than 0\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--retries") == 0) {
+            argc--;
+            argv++;
+            g_retries = atoi(*argv);
+            if (g_retries < 0) {
+                fprintf(stderr, "retries must not be negative\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--soak") == 0) {
+            g_soak = true;
+        } else if (strcmp(*argv, "--encoder") == 0) {
+            argc--;
+            argv++;
+            if (strcmp(*argv, "direct") == 0) {
+                g_directEncoder = true;
+            } else if (strcmp(*argv, "gsoap") == 0) {
+                g_directEncoder = false;
+            } else {
+                fprintf(stderr, "encoder must be gsoap or direct\n");
+                exit(1);
+            }
+        } else if (strcmp(*argv, "--verify-encoder") == 0) {
+            g_verifyEncoder = true;
+        } else if (strcmp(*argv, "--poll-stream") == 0) {
+            g_pollStream = true;
+        } else if (strcmp(*argv, "--no-keepalive") == 0) {
+            g_noKeepAlive = true;
         } else if (strcmp(*argv, "--username") == 0) {
             argc--;
             argv++;
@@ -711,6 +1982,12 @@ int main(int argc, char* argv[])
         }
     }
         
+    if (argc == 0 && g_verifyEncoder) {
+        // g_myIp only has to look like an address here.
+        snprintf(g_myIp, sizeof g_myIp, "192.0.2.1");
+        checkEncoder();
+        return 0;
+    }
     if (argc != 2) {
         usage();
     }
@@ -718,6 +1995,17 @@ int main(int argc, char* argv[])
     const char* url = argv[0];
     int numSessions = atoi(argv[1]);
 
+    if (g_requestRate > 0) {
+        // Each batch is a publish, plus a subscribe unless --nosub
+        g_rate = g_requestRate * g_batch / (g_nosub ? 1 : 2);
+    }
+    if (g_ramp.kind != RampProfile::NONE && g_rate <= 0) {
+        fprintf(stderr, "--ramp requires --rate or --request-rate\n");
+        exit(1);
+    }
+    // A server closing a connection mid-request is a failed request.
+    signal(SIGPIPE, SIG_IGN);
+
     char hostName[MAXHOSTNAMELEN];
     if (gethostname(hostName, sizeof hostName) == -1) {
         perror("gethostname");
@@ -736,5 +2024,3 @@ int main(int argc, char* argv[])
     loadTest(url, numSessions);
     return 0;
 }
-
-#include <dom.cpp>
@@ -0,0 +1,765 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// A mock IF-MAP server holding the MAP in memory (MapStore,
+// mapstore.h), so that clients can be benchmarked on one machine.
+// Each connection is served by its own thread, since polls block
+// until a subscription changes.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ifmap.nsmap"
+#include "connect.h"
+#include "intern.h"
+#include "mapstore.h"
+
+static const char* s_ifmapNamespace = "http://www.trustedcomputinggroup.org/2006/IFMAP/1";
+static const size_t s_threadStackSize = 256 * 1024;
+
+static MapStore g_store;
+static bool g_verbose = false;
+
+static void usage()
+{
+    fprintf(stderr, "usage: mapserver-mock port [ -k keyfile.pem ] [ -b bind-address ] [ -v ]\n\n");
+    fprintf(stderr, "       Serves IF-MAP from memory, over TLS with the key and\n"
+                    "       certificate in keyfile.pem if given, such as the\n"
+                    "       self-signed one \"make mapserver-mock.pem\" creates.\n"
+                    "       -v prints each session started.\n");
+    exit(1);
+}
+
+//
+// Returns the session ID of the request, or 0.
+//
+static const char* requestSession(struct soap* soap)
+{
+    return soap->header ? soap->header->ifmap__session_id : 0;
+}
+
+static int invalidSession(struct soap* soap)
+{
+    return soap_sender_fault(soap, "Invalid session-id", 0);
+}
+
+static void setResponseHeader(struct soap* soap, const std::string& sessionId,
+                              const std::string* publisherId)
+{
+    soap->header = soap_new_SOAP_ENV__Header(soap, -1);
+    soap->header->ifmap__new_session = 0;
+    soap->header->ifmap__attach_session = 0;
+    soap->header->ifmap__session_id = soap_strdup(soap, sessionId.c_str());
+    soap->header->ifmap__publisher_id
+        = publisherId ? soap_strdup(soap, publisherId->c_str()) : 0;
+}
+
+static ifmap__ResponseType* newResponse(struct soap* soap, int which)
+{
+    ifmap__ResponseType* response = soap_new_ifmap__ResponseType(soap, -1);
+    response->__union_ResponseType = which;
+    return response;
+}
+
+static ifmap__ErrorResultType* newErrorResult(struct soap* soap, int errorCode,
+                                              const char* errorString, const char* name)
+{
+    ifmap__ErrorResultType* error = soap_new_ifmap__ErrorResultType(soap, -1);
+    error->errorCode = (enum _ifmap__ErrorResultType_errorCode)errorCode;
+    error->errorString = soap_strdup(soap, errorString);
+    error->name = name ? soap_strdup(soap, name) : 0;
+    return error;
+}
+
+static ifmap__ResponseType* errorResponse(struct soap* soap, int errorCode,
+                                          const char* errorString)
+{
+    ifmap__ResponseType* response
+        = newResponse(soap, SOAP_UNION__ifmap__union_ResponseType_errorResult);
+    response->union_ResponseType.errorResult = newErrorResult(soap, errorCode, errorString, 0);
+    return response;
+}
+
+//
+// The received elements are empty; depending on how wsdl2h typed
+// them they are strings or DOM elements.
+//
+static void setReceived(struct soap* soap, char*& received, const char*)
+{
+    received = soap_strdup(soap, "");
+}
+
+static void setReceived(struct soap* soap, soap_dom_element*& received, const char* name)
+{
+    received = soap_new_xsd__anyType(soap, -1);
+    received->nstr = s_ifmapNamespace;
+    received->name = soap_strdup(soap, name);
+}
+
+//
+// Copies identifier into result. Returns 0, or an error message with
+// errorCode set if it is malformed.
+//
+static const char* convertIdentifier(const ifmap__IdentifierType* identifier,
+                                     MapIdentifier& result, int& errorCode)
+{
+    errorCode = _ifmap__ErrorResultType_errorCode__InvalidIdentifier;
+    if (!identifier) {
+        return "Missing identifier";
+    }
+    const char* domain = 0;
+    const char* value = 0;
+    const _ifmap__union_IdentifierType& choice = identifier->union_IdentifierType;
+    switch (identifier->__union_IdentifierType) {
+    case SOAP_UNION__ifmap__union_IdentifierType_access_request:
+        if (choice.access_request) {
+            result.type = MapIdentifier::ACCESS_REQUEST;
+            domain = choice.access_request->administrative_domain;
+            value = choice.access_request->name;
+        }
+        break;
+    case SOAP_UNION__ifmap__union_IdentifierType_identity:
+        if (choice.identity) {
+            result.type = MapIdentifier::IDENTITY;
+            result.subtype = choice.identity->type;
+            domain = choice.identity->administrative_domain;
+            value = choice.identity->name;
+            if (choice.identity->type == _ifmap__IdentityType_type__other) {
+                if (!choice.identity->other_type_definition) {
+                    return "Identity of type other without other-type-definition";
+                }
+                result.other = choice.identity->other_type_definition;
+            }
+        }
+        break;
+    case SOAP_UNION__ifmap__union_IdentifierType_ip_address:
+        if (choice.ip_address) {
+            result.type = MapIdentifier::IP_ADDRESS;
+            result.subtype = choice.ip_address->type;
+            domain = choice.ip_address->administrative_domain;
+            value = choice.ip_address->value;
+            unsigned char address[16];
+            int family = choice.ip_address->type == _ifmap__IPAddressType_type__IPv6
+                ? AF_INET6 : AF_INET;
+            if (value && inet_pton(family, value, address) != 1) {
+                return "Invalid IP address";
+            }
+        }
+        break;
+    case SOAP_UNION__ifmap__union_IdentifierType_mac_address:
+        if (choice.mac_address) {
+            result.type = MapIdentifier::MAC_ADDRESS;
+            domain = choice.mac_address->administrative_domain;
+            value = choice.mac_address->value;
+        }
+        break;
+    case SOAP_UNION__ifmap__union_IdentifierType_device:
+        if (choice.device) {
+            result.type = MapIdentifier::DEVICE;
+            result.subtype = choice.device->__union_DeviceType;
+            value = result.subtype == SOAP_UNION__ifmap__union_DeviceType_aik_name
+                ? choice.device->union_DeviceType.aik_name
+                : choice.device->union_DeviceType.name;
+        }
+        break;
+    default:
+        errorCode = _ifmap__ErrorResultType_errorCode__InvalidIdentifierType;
+        return "Unknown identifier type";
+    }
+    if (!value || !*value) {
+        return "Identifier without a value";
+    }
+    result.domain = domain ? domain : "";
+    result.value = value;
+    return 0;
+}
+
+static ifmap__IdentifierType* soapIdentifier(IdentifierSlab& slab,
+                                             const MapIdentifier& identifier)
+{
+    const char* domain = identifier.domain.c_str();
+    const char* value = identifier.value.c_str();
+    switch (identifier.type) {
+    case MapIdentifier::ACCESS_REQUEST:
+        return slab.accessRequest(domain, value);
+    case MapIdentifier::DEVICE:
+        return slab.device(identifier.subtype, value);
+    case MapIdentifier::IDENTITY:
+        return slab.identity(domain, identifier.subtype, value, identifier.other.c_str());
+    case MapIdentifier::IP_ADDRESS:
+        return slab.ipAddress(domain, identifier.subtype, value);
+    case MapIdentifier::MAC_ADDRESS:
+        return slab.macAddress(domain, value);
+    }
+    return 0;
+}
+
+static void convertElement(const soap_dom_element& dom, MapElement& element)
+{
+    element.ns = dom.nstr ? dom.nstr : "";
+    element.name = dom.name ? dom.name : "";
+    element.text = dom.data ? dom.data : "";
+    for (soap_dom_attribute* attribute = dom.atts; attribute; attribute = attribute->next) {
+        if (attribute->name && strncmp(attribute->name, "xmlns", 5) != 0) {
+            element.attributes.push_back(std::make_pair(std::string(attribute->name),
+                                                        std::string(attribute->data
+                                                                    ? attribute->data : "")));
+        }
+    }
+    for (soap_dom_element* child = dom.elts; child; child = child->next) {
+        element.children.push_back(MapElement());
+        convertElement(*child, element.children.back());
+    }
+}
+
+static void soapElement(struct soap* soap, const MapElement& element, soap_dom_element& dom)
+{
+    dom.soap = soap;
+    dom.nstr = element.ns.empty() ? 0 : soap_strdup(soap, element.ns.c_str());
+    dom.name = soap_strdup(soap, element.name.c_str());
+    dom.data = element.text.empty() ? 0 : soap_strdup(soap, element.text.c_str());
+    soap_dom_attribute** tail = &dom.atts;
+    for (size_t ii = 0; ii < element.attributes.size(); ii++) {
+        soap_dom_attribute* attribute
+            = (soap_dom_attribute*)soap_malloc(soap, sizeof(soap_dom_attribute));
+        bzero(attribute, sizeof *attribute);
+        attribute->soap = soap;
+        attribute->name = soap_strdup(soap, element.attributes[ii].first.c_str());
+        attribute->data = soap_strdup(soap, element.attributes[ii].second.c_str());
+        *tail = attribute;
+        tail = &attribute->next;
+    }
+    if (!element.children.empty()) {
+        soap_dom_element* children = soap_new_xsd__anyType(soap, element.children.size());
+        for (size_t ii = 0; ii < element.children.size(); ii++) {
+            soapElement(soap, element.children[ii], children[ii]);
+            children[ii].prnt = &dom;
+            children[ii].next = ii + 1 < element.children.size() ? &children[ii + 1] : 0;
+        }
+        dom.elts = children;
+    }
+}
+
+static ifmap__MetadataListType* soapMetadata(struct soap* soap,
+                                             const std::vector<const MapElement*>& metadata)
+{
+    if (metadata.empty()) {
+        return 0;
+    }
+    ifmap__MetadataListType* list = soap_new_ifmap__MetadataListType(soap, -1);
+    list->__size = metadata.size();
+    list->__any = soap_new_xsd__anyType(soap, metadata.size());
+    for (size_t ii = 0; ii < metadata.size(); ii++) {
+        soapElement(soap, *metadata[ii], list->__any[ii]);
+    }
+    return list;
+}
+
+//
+// Builds the gSOAP search and poll results for what a MapStore
+// reports, copying it into soap's memory as it arrives.
+//
+class ResultBuilder : public MapResultHandler
+{
+public:
+    ResultBuilder(struct soap* soap, IdentifierSlab& slab)
+        : m_soap(soap), m_slab(slab), m_result(0)
+    {
+    }
+
+    virtual void searchResultBegin(const char* name)
+    {
+        m_result = soap_new_ifmap__SearchResultType(m_soap, -1);
+        m_result->name = name ? soap_strdup(m_soap, name) : 0;
+        m_identifierResults.clear();
+        m_linkResults.clear();
+    }
+
+    virtual void identifierResult(const MapIdentifier& identifier,
+                                  const std::vector<const MapElement*>& metadata)
+    {
+        ifmap__IdentifierResultType* result = soap_new_ifmap__IdentifierResultType(m_soap, -1);
+        result->identifier = soapIdentifier(m_slab, identifier);
+        result->metadata = soapMetadata(m_soap, metadata);
+        m_identifierResults.push_back(result);
+    }
+
+    virtual void linkResult(const MapIdentifier& identifier0, const MapIdentifier& identifier1,
+                            const std::vector<const MapElement*>& metadata)
+    {
+        ifmap__LinkResultType* result = soap_new_ifmap__LinkResultType(m_soap, -1);
+        result->link = soap_new_ifmap__LinkType(m_soap, -1);
+        result->link->__sizeidentifier = 2;
+        result->link->identifier
+            = (ifmap__IdentifierType**)soap_malloc(m_soap, 2 * sizeof(ifmap__IdentifierType*));
+        result->link->identifier[0] = soapIdentifier(m_slab, identifier0);
+        result->link->identifier[1] = soapIdentifier(m_slab, identifier1);
+        result->metadata = soapMetadata(m_soap, metadata);
+        m_linkResults.push_back(result);
+    }
+
+    virtual void searchResultEnd(const char* name)
+    {
+        m_result->__sizeidentifierResult = m_identifierResults.size();
+        m_result->identifierResult = (ifmap__IdentifierResultType**)soap_malloc(
+            m_soap, m_identifierResults.size() * sizeof(ifmap__IdentifierResultType*));
+        std::copy(m_identifierResults.begin(), m_identifierResults.end(),
+                  m_result->identifierResult);
+        m_result->__sizelinkResult = m_linkResults.size();
+        m_result->linkResult = (ifmap__LinkResultType**)soap_malloc(
+            m_soap, m_linkResults.size() * sizeof(ifmap__LinkResultType*));
+        std::copy(m_linkResults.begin(), m_linkResults.end(), m_result->linkResult);
+
+        __ifmap__union_PollResultType item;
+        item.__union_PollResultType = SOAP_UNION__ifmap__union_PollResultType_searchResult;
+        item.union_PollResultType.searchResult = m_result;
+        m_pollResults.push_back(item);
+    }
+
+    virtual void searchResultTooBig(const char* name)
+    {
+        __ifmap__union_PollResultType item;
+        item.__union_PollResultType = SOAP_UNION__ifmap__union_PollResultType_errorResult;
+        item.union_PollResultType.errorResult
+            = newErrorResult(m_soap, _ifmap__ErrorResultType_errorCode__SearchResultsTooBig,
+                             "Search results exceed max-size", name);
+        m_pollResults.push_back(item);
+    }
+
+    ifmap__ResponseType* searchResponse()
+    {
+        const __ifmap__union_PollResultType& item = m_pollResults.at(0);
+        if (item.__union_PollResultType == SOAP_UNION__ifmap__union_PollResultType_errorResult) {
+            ifmap__ResponseType* response
+                = newResponse(m_soap, SOAP_UNION__ifmap__union_ResponseType_errorResult);
+            response->union_ResponseType.errorResult = item.union_PollResultType.errorResult;
+            return response;
+        }
+        ifmap__ResponseType* response
+            = newResponse(m_soap, SOAP_UNION__ifmap__union_ResponseType_searchResult);
+        response->union_ResponseType.searchResult = item.union_PollResultType.searchResult;
+        return response;
+    }
+
+    ifmap__ResponseType* pollResponse()
+    {
+        ifmap__PollResultType* pollResult = soap_new_ifmap__PollResultType(m_soap, -1);
+        pollResult->__size_PollResultType = m_pollResults.size();
+        pollResult->__union_PollResultType = (__ifmap__union_PollResultType*)soap_malloc(
+            m_soap, m_pollResults.size() * sizeof(__ifmap__union_PollResultType));
+        std::copy(m_pollResults.begin(), m_pollResults.end(),
+                  pollResult->__union_PollResultType);
+        ifmap__ResponseType* response
+            = newResponse(m_soap, SOAP_UNION__ifmap__union_ResponseType_pollResult);
+        response->union_ResponseType.pollResult = pollResult;
+        return response;
+    }
+
+private:
+    struct soap* m_soap;
+    IdentifierSlab& m_slab;
+    ifmap__SearchResultType* m_result;
+    std::vector<ifmap__IdentifierResultType*> m_identifierResults;
+    std::vector<ifmap__LinkResultType*> m_linkResults;
+    std::vector<__ifmap__union_PollResultType> m_pollResults;
+};
+
+static IdentifierSlab& connectionSlab(struct soap* soap)
+{
+    return *(IdentifierSlab*)soap->user;
+}
+
+int __wsdl__NewSession(struct soap* soap, char* newSession,
+                       struct __wsdl__NewSessionResponse& response)
+{
+    std::string sessionId;
+    std::string publisherId;
+    g_store.newSession(soap->userid, sessionId, publisherId);
+    if (g_verbose) {
+        printf("new session %s for %s\n", sessionId.c_str(), publisherId.c_str());
+        fflush(stdout);
+    }
+    setResponseHeader(soap, sessionId, &publisherId);
+    return SOAP_OK;
+}
+
+int __wsdl__AttachSession(struct soap* soap, char* attachSession,
+                          struct __wsdl__AttachSessionResponse& response)
+{
+    // The client library sends the session ID in the header.
+    if (soap->header && soap->header->ifmap__attach_session) {
+        attachSession = soap->header->ifmap__attach_session;
+    }
+    std::string sessionId = attachSession ? attachSession : "";
+    std::string publisherId;
+    if (!g_store.attachSession(sessionId, publisherId)) {
+        return invalidSession(soap);
+    }
+    setResponseHeader(soap, sessionId, &publisherId);
+    return SOAP_OK;
+}
+
+static const char* convertLinkOrIdentifier(ifmap__IdentifierType* identifier,
+                                           ifmap__LinkType* link, bool isLink,
+                                           MapPublish& publish, int& errorCode)
+{
+    publish.isLink = isLink;
+    if (!isLink) {
+        return convertIdentifier(identifier, publish.identifiers[0], errorCode);
+    }
+    if (!link || link->__sizeidentifier != 2) {
+        errorCode = _ifmap__ErrorResultType_errorCode__InvalidIdentifier;
+        return "Link without two identifiers";
+    }
+    const char* error = convertIdentifier(link->identifier[0], publish.identifiers[0], errorCode);
+    return error ? error : convertIdentifier(link->identifier[1], publish.identifiers[1], errorCode);
+}
+
+static const char* convertPublish(const __ifmap__union_PublishRequestType& request,
+                                  MapPublish& publish, int& errorCode)
+{
+    const _ifmap__union_PublishRequestType& choice = request.union_PublishRequestType;
+    if (request.__union_PublishRequestType == SOAP_UNION__ifmap__union_PublishRequestType_update
+        && choice.update) {
+        const ifmap__PublishType* update = choice.update;
+        const char* error = convertLinkOrIdentifier(
+            update->union_PublishType.identifier, update->union_PublishType.link,
+            update->__union_PublishType == SOAP_UNION__ifmap__union_PublishType_link,
+            publish, errorCode);
+        if (error) {
+            return error;
+        }
+        for (int ii = 0; update->metadata && ii < update->metadata->__size; ii++) {
+            publish.metadata.push_back(MapElement());
+            convertElement(update->metadata->__any[ii], publish.metadata.back());
+        }
+        return 0;
+    }
+    if (request.__union_PublishRequestType == SOAP_UNION__ifmap__union_PublishRequestType_delete_
+        && choice.delete_) {
+        const ifmap__DeleteType* remove = choice.delete_;
+        publish.update = false;
+        const char* error = convertLinkOrIdentifier(
+            remove->union_DeleteType.identifier, remove->union_DeleteType.link,
+            remove->__union_DeleteType == SOAP_UNION__ifmap__union_DeleteType_link,
+            publish, errorCode);
+        if (error) {
+            return error;
+        }
+        publish.hasFilter = remove->filter != 0;
+        if (!publish.filter.parse(remove->filter)) {
+            errorCode = _ifmap__ErrorResultType_errorCode__Failure;
+            return "Invalid filter";
+        }
+        return 0;
+    }
+    errorCode = _ifmap__ErrorResultType_errorCode__Failure;
+    return "Neither update nor delete";
+}
+
+int __wsdl__Publish(struct soap* soap, ifmap__PublishRequestType* request,
+                    struct __wsdl__PublishResponse& response)
+{
+    if (!requestSession(soap)) {
+        return invalidSession(soap);
+    }
+    std::string sessionId = requestSession(soap);
+    std::vector<MapPublish> publishes;
+    for (int ii = 0; request && ii < request->__size_PublishRequestType; ii++) {
+        publishes.push_back(MapPublish());
+        int errorCode;
+        const char* error = convertPublish(request->__union_PublishRequestType[ii],
+                                           publishes.back(), errorCode);
+        if (error) {
+            response.ifmap__response = errorResponse(soap, errorCode, error);
+            setResponseHeader(soap, sessionId, 0);
+            return SOAP_OK;
+        }
+    }
+    if (!g_store.publish(sessionId, publishes)) {
+        return invalidSession(soap);
+    }
+    response.ifmap__response
+        = newResponse(soap, SOAP_UNION__ifmap__union_ResponseType_publishReceived);
+    setReceived(soap, response.ifmap__response->union_ResponseType.publishReceived,
+                "ifmap:publishReceived");
+    setResponseHeader(soap, sessionId, 0);
+    return SOAP_OK;
+}
+
+static const char* convertSearch(const ifmap__SearchRequestType* request, MapSearch& search,
+                                 int& errorCode)
+{
+    const char* error = convertIdentifier(request->identifier, search.start, errorCode);
+    if (error) {
+        return error;
+    }
+    errorCode = _ifmap__ErrorResultType_errorCode__Failure;
+    if (!search.matchLinks.parse(request->match_links)) {
+        return "Invalid match-links";
+    }
+    if (!search.resultFilter.parse(request->result_filter)) {
+        return "Invalid result-filter";
+    }
+    search.maxDepth = request->max_depth ? atoi(request->max_depth) : 0;
+    search.maxSize = request->max_size ? atol(request->max_size) : -1;
+    return 0;
+}
+
+int __wsdl__Search(struct soap* soap, ifmap__SearchRequestType* request,
+                   struct __wsdl__SearchResponse& response)
+{
+    if (!requestSession(soap)) {
+        return invalidSession(soap);
+    }
+    std::string sessionId = requestSession(soap);
+    MapSearch search;
+    int errorCode = _ifmap__ErrorResultType_errorCode__Failure;
+    const char* error = request ? convertSearch(request, search, errorCode) : "Missing search";
+    if (error) {
+        response.ifmap__response = errorResponse(soap, errorCode, error);
+        setResponseHeader(soap, sessionId, 0);
+        return SOAP_OK;
+    }
+    ResultBuilder builder(soap, connectionSlab(soap));
+    if (!g_store.search(sessionId, search, builder)) {
+        return invalidSession(soap);
+    }
+    response.ifmap__response = builder.searchResponse();
+    setResponseHeader(soap, sessionId, 0);
+    return SOAP_OK;
+}
+
+int __wsdl__Subscribe(struct soap* soap, ifmap__SubscribeRequestType* request,
+                      struct __wsdl__SubscribeResponse& response)
+{
+    if (!requestSession(soap)) {
+        return invalidSession(soap);
+    }
+    std::string sessionId = requestSession(soap);
+    std::vector<MapSubscribe> subscribes;
+    for (int ii = 0; request && ii < request->__size_SubscribeRequestType; ii++) {
+        const __ifmap__union_SubscribeRequestType& item = request->__union_SubscribeRequestType[ii];
+        const _ifmap__union_SubscribeRequestType& choice = item.union_SubscribeRequestType;
+        subscribes.push_back(MapSubscribe());
+        MapSubscribe& subscribe = subscribes.back();
+        int errorCode = _ifmap__ErrorResultType_errorCode__Failure;
+        const char* error = "Neither update nor delete";
+        if (item.__union_SubscribeRequestType == SOAP_UNION__ifmap__union_SubscribeRequestType_update
+            && choice.update) {
+            subscribe.name = choice.update->name ? choice.update->name : "";
+            error = convertSearch(choice.update, subscribe.search, errorCode);
+        } else if (item.__union_SubscribeRequestType
+                   == SOAP_UNION__ifmap__union_SubscribeRequestType_delete_ && choice.delete_) {
+            subscribe.update = false;
+            subscribe.name = choice.delete_->name ? choice.delete_->name : "";
+            error = 0;
+        }
+        if (error) {
+            response.ifmap__response = errorResponse(soap, errorCode, error);
+            setResponseHeader(soap, sessionId, 0);
+            return SOAP_OK;
+        }
+    }
+    if (!g_store.subscribe(sessionId, subscribes)) {
+        return invalidSession(soap);
+    }
+    response.ifmap__response
+        = newResponse(soap, SOAP_UNION__ifmap__union_ResponseType_subscribeReceived);
+    setReceived(soap, response.ifmap__response->union_ResponseType.subscribeReceived,
+                "ifmap:subscribeReceived");
+    setResponseHeader(soap, sessionId, 0);
+    return SOAP_OK;
+}
+
+int __wsdl__Poll(struct soap* soap, ifmap__PollRequestType* request,
+                 struct __wsdl__PollResponse& response)
+{
+    if (!requestSession(soap)) {
+        return invalidSession(soap);
+    }
+    std::string sessionId = requestSession(soap);
+    ResultBuilder builder(soap, connectionSlab(soap));
+    if (!g_store.poll(sessionId, builder)) {
+        return invalidSession(soap);
+    }
+    response.ifmap__response = builder.pollResponse();
+    setResponseHeader(soap, sessionId, 0);
+    return SOAP_OK;
+}
+
+int __wsdl__PurgePublisher(struct soap* soap, ifmap__PurgePublisherRequestType* request,
+                           struct __wsdl__PurgePublisherResponse& response)
+{
+    if (!requestSession(soap)) {
+        return invalidSession(soap);
+    }
+    std::string sessionId = requestSession(soap);
+    std::string publisherId = request && request->publisher_id ? request->publisher_id : "";
+    if (!g_store.purge(sessionId, publisherId)) {
+        return invalidSession(soap);
+    }
+    response.ifmap__response
+        = newResponse(soap, SOAP_UNION__ifmap__union_ResponseType_purgePublisherReceived);
+    setReceived(soap, response.ifmap__response->union_ResponseType.purgePublisherReceived,
+                "ifmap:purgePublisherReceived");
+    setResponseHeader(soap, sessionId, 0);
+    return SOAP_OK;
+}
+
+//
+// Frees what one request allocated before the next one on the
+// connection is read.
+//
+static int endRequest(struct soap* soap)
+{
+    connectionSlab(soap).reset();
+    soap_destroy(soap);
+    soap_end(soap);
+    return SOAP_OK;
+}
+
+static void* serveConnection(void* arg)
+{
+    struct soap* soap = (struct soap*)arg;
+    IdentifierSlab slab;
+    soap->user = &slab;
+    soap->fserveloop = endRequest;
+    if (!soap->ctx || soap_ssl_accept(soap) == SOAP_OK) {
+        ifmap_serve(soap);
+    }
+    soap_destroy(soap);
+    soap_end(soap);
+    soap_free(soap);
+    return 0;
+}
+
+//
+// Copies master for a new connection. gSOAP may free the SSL context
+// of a copy when done with it, so each copy holds a reference.
+//
+static struct soap* copyConnection(struct soap* master)
+{
+    struct soap* soap = soap_copy(master);
+    if (soap && soap->ctx) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        SSL_CTX_up_ref(soap->ctx);
+#else
+        CRYPTO_add(&soap->ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+    }
+    return soap;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage();
+    }
+    int port = atoi(argv[1]);
+    char* keyfile = 0;
+    char* host = 0;
+    argv++;
+    argc--;
+    while (--argc) {
+        char* option = *++argv;
+        if (strcmp(option, "-v") == 0) {
+            g_verbose = true;
+            continue;
+        }
+        if (!--argc) {
+            usage();
+        }
+        char* argument = *++argv;
+        if (strcmp(option, "-k") == 0) {
+            keyfile = argument;
+        } else if (strcmp(option, "-b") == 0) {
+            host = argument;
+        } else {
+            usage();
+        }
+    }
+    if (port <= 0) {
+        usage();
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int mode = SOAP_IO_KEEPALIVE | SOAP_C_UTFSTRING;
+    struct soap master;
+    soap_init2(&master, mode | SOAP_DOM_TREE, mode);
+    master.bind_flags = SO_REUSEADDR;
+    // Keep connections open for as many requests as clients send.
+    master.max_keep_alive = 0;
+    if (keyfile) {
+        ifmapInitSslLocking();
+        if (soap_ssl_server_context(&master, SOAP_SSL_NO_AUTHENTICATION, keyfile,
+                                    0, 0, 0, 0, 0, 0) != SOAP_OK) {
+            soap_print_fault(&master, stderr);
+            return 1;
+        }
+    }
+    if (!soap_valid_socket(soap_bind(&master, host, port, 100))) {
+        soap_print_fault(&master, stderr);
+        return 1;
+    }
+    printf("listening on port %d%s\n", port, keyfile ? " with TLS" : "");
+    fflush(stdout);
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attributes, s_threadStackSize);
+    while (true) {
+        if (!soap_valid_socket(soap_accept(&master))) {
+            soap_print_fault(&master, stderr);
+            continue;
+        }
+        struct soap* soap = copyConnection(&master);
+        pthread_t thread;
+        if (!soap || pthread_create(&thread, &attributes, serveConnection, soap) != 0) {
+            fprintf(stderr, "cannot start a thread for a connection\n");
+            if (soap) {
+                soap_free(soap);
+            } else {
+                soap_closesock(&master);
+            }
+        }
+    }
+}
@@ -0,0 +1,847 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "mapstore.h"
+
+static const char* s_metaNamespace = "http://www.trustedcomputinggroup.org/2006/IFMAP-METADATA/1";
+
+// The metadata the schema derives from SingleValueMetadataType.
+static const char* s_singleValued[] = {
+    "access-request-device", "access-request-ip", "access-request-mac", "authenticated-as",
+    "authenticated-by", "ip-mac", "layer2-information"
+};
+
+static const char* afterPrefix(const char* name)
+{
+    const char* colon = strrchr(name, ':');
+    return colon ? colon + 1 : name;
+}
+
+std::string MapIdentifier::key() const
+{
+    std::string result(1, (char)('a' + type));
+    char subtypeBuf[20];
+    snprintf(subtypeBuf, sizeof subtypeBuf, "%d", subtype);
+    result += subtypeBuf;
+    result += '\0';
+    result += domain;
+    result += '\0';
+    result += value;
+    result += '\0';
+    result += other;
+    return result;
+}
+
+const char* MapElement::localName() const
+{
+    return afterPrefix(name.c_str());
+}
+
+const std::string* MapElement::attribute(const char* localName) const
+{
+    for (size_t ii = 0; ii < attributes.size(); ii++) {
+        if (strcmp(afterPrefix(attributes[ii].first.c_str()), localName) == 0) {
+            return &attributes[ii].second;
+        }
+    }
+    return 0;
+}
+
+const std::string* MapElement::childText(const char* localName) const
+{
+    for (size_t ii = 0; ii < children.size(); ii++) {
+        if (strcmp(children[ii].localName(), localName) == 0) {
+            return &children[ii].text;
+        }
+    }
+    return 0;
+}
+
+void MapElement::setAttribute(const char* name, const std::string& value)
+{
+    for (size_t ii = 0; ii < attributes.size(); ii++) {
+        if (attributes[ii].first == name) {
+            attributes[ii].second = value;
+            return;
+        }
+    }
+    attributes.push_back(std::make_pair(std::string(name), value));
+}
+
+size_t MapElement::size() const
+{
+    size_t result = 2 * name.size() + 5 + text.size();
+    for (size_t ii = 0; ii < attributes.size(); ii++) {
+        result += attributes[ii].first.size() + attributes[ii].second.size() + 4;
+    }
+    for (size_t ii = 0; ii < children.size(); ii++) {
+        result += children[ii].size();
+    }
+    return result;
+}
+
+static void skipSpaces(const char*& p)
+{
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+}
+
+//
+// True if p starts with word followed by white space.
+//
+static bool startsWord(const char* p, const char* word)
+{
+    size_t length = strlen(word);
+    return strncmp(p, word, length) == 0 && isspace((unsigned char)p[length]);
+}
+
+bool MetadataFilter::parse(const char* filter)
+{
+    m_terms.clear();
+    m_all = !filter;
+    if (!filter) {
+        return true;
+    }
+    const char* p = filter;
+    skipSpaces(p);
+    if (!*p) {
+        // Matches nothing.
+        return true;
+    }
+    for (;;) {
+        Term term;
+        const char* start = p;
+        while (*p && !isspace((unsigned char)*p) && *p != '[') {
+            p++;
+        }
+        if (p == start) {
+            return false;
+        }
+        term.name = afterPrefix(std::string(start, p).c_str());
+        skipSpaces(p);
+        if (*p == '[') {
+            p++;
+            for (;;) {
+                skipSpaces(p);
+                Predicate predicate;
+                predicate.attribute = *p == '@';
+                if (predicate.attribute) {
+                    p++;
+                }
+                start = p;
+                while (*p && *p != '=' && *p != ']' && !isspace((unsigned char)*p)) {
+                    p++;
+                }
+                if (p == start) {
+                    return false;
+                }
+                predicate.name = afterPrefix(std::string(start, p).c_str());
+                skipSpaces(p);
+                if (*p != '=') {
+                    return false;
+                }
+                p++;
+                skipSpaces(p);
+                char quote = *p;
+                if (quote != '"' && quote != '\'') {
+                    return false;
+                }
+                start = ++p;
+                while (*p && *p != quote) {
+                    p++;
+                }
+                if (!*p) {
+                    return false;
+                }
+                predicate.value.assign(start, p - start);
+                p++;
+                term.predicates.push_back(predicate);
+                skipSpaces(p);
+                if (*p == ']') {
+                    p++;
+                    break;
+                }
+                if (!startsWord(p, "and")) {
+                    return false;
+                }
+                p += 3;
+            }
+        }
+        m_terms.push_back(term);
+        skipSpaces(p);
+        if (!*p) {
+            return true;
+        }
+        if (!startsWord(p, "or")) {
+            return false;
+        }
+        p += 2;
+        skipSpaces(p);
+    }
+}
+
+bool MetadataFilter::matches(const MapElement& element) const
+{
+    if (m_all) {
+        return true;
+    }
+    for (size_t ii = 0; ii < m_terms.size(); ii++) {
+        const Term& term = m_terms[ii];
+        if (term.name != element.localName()) {
+            continue;
+        }
+        size_t jj;
+        for (jj = 0; jj < term.predicates.size(); jj++) {
+            const Predicate& predicate = term.predicates[jj];
+            const std::string* value = predicate.attribute
+                ? element.attribute(predicate.name.c_str())
+                : element.childText(predicate.name.c_str());
+            if (!value || *value != predicate.value) {
+                break;
+            }
+        }
+        if (jj == term.predicates.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool singleValued(const MapElement& element)
+{
+    const std::string* cardinality = element.attribute("cardinality");
+    if (cardinality) {
+        return *cardinality == "singleValue";
+    }
+    if (element.ns != s_metaNamespace) {
+        return false;
+    }
+    for (size_t ii = 0; ii < sizeof s_singleValued / sizeof s_singleValued[0]; ii++) {
+        if (strcmp(element.localName(), s_singleValued[ii]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string timestamp()
+{
+    time_t now = time(0);
+    struct tm fields;
+    gmtime_r(&now, &fields);
+    char buf[32];
+    strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%SZ", &fields);
+    return buf;
+}
+
+//
+// FNV-1a, to tell whether a subscription's result has changed.
+//
+static void mix(unsigned long long& hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t ii = 0; ii < length; ii++) {
+        hash = (hash ^ bytes[ii]) * 1099511628211ULL;
+    }
+}
+
+MapStore::MapStore()
+    : m_serial(0), m_sessionCount(0)
+{
+    pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_changed, 0);
+}
+
+MapStore::~MapStore()
+{
+    std::map<std::string, Session*>::iterator session;
+    for (session = m_sessions.begin(); session != m_sessions.end(); session++) {
+        std::map<std::string, Subscription*>::iterator it;
+        for (it = session->second->subscriptions.begin();
+             it != session->second->subscriptions.end(); it++) {
+            delete it->second;
+        }
+        delete session->second;
+    }
+    std::map<std::pair<Node*, Node*>, Link*>::iterator link;
+    for (link = m_links.begin(); link != m_links.end(); link++) {
+        delete link->second;
+    }
+    std::map<std::string, Node*>::iterator node;
+    for (node = m_nodes.begin(); node != m_nodes.end(); node++) {
+        delete node->second;
+    }
+    pthread_cond_destroy(&m_changed);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void MapStore::newSession(const char* user, std::string& sessionId, std::string& publisherId)
+{
+    pthread_mutex_lock(&m_mutex);
+    long number = ++m_sessionCount;
+    char buf[100];
+    snprintf(buf, sizeof buf, "%s-%ld", user && *user ? user : "publisher", number);
+    publisherId = buf;
+    // The start time keeps IDs saved from an earlier run from matching.
+    snprintf(buf, sizeof buf, "%lx-%ld", (unsigned long)time(0), number);
+    sessionId = buf;
+
+    Session* session = new Session;
+    session->id = sessionId;
+    session->publisherId = publisherId;
+    session->dirty = 0;
+    m_sessions[sessionId] = session;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool MapStore::attachSession(const std::string& sessionId, std::string& publisherId)
+{
+    pthread_mutex_lock(&m_mutex);
+    Session* session = findSession(sessionId);
+    if (session) {
+        publisherId = session->publisherId;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return session != 0;
+}
+
+MapStore::Session* MapStore::findSession(const std::string& id)
+{
+    std::map<std::string, Session*>::iterator it = m_sessions.find(id);
+    return it == m_sessions.end() ? 0 : it->second;
+}
+
+MapStore::Node* MapStore::findNode(const std::string& key)
+{
+    std::map<std::string, Node*>::iterator it = m_nodes.find(key);
+    return it == m_nodes.end() ? 0 : it->second;
+}
+
+MapStore::Node* MapStore::node(const MapIdentifier& identifier)
+{
+    std::string key = identifier.key();
+    Node*& node = m_nodes[key];
+    if (!node) {
+        node = new Node;
+        node->identifier = identifier;
+        node->key = key;
+    }
+    return node;
+}
+
+MapStore::Link* MapStore::findLink(Node* node0, Node* node1)
+{
+    if (node1 < node0) {
+        std::swap(node0, node1);
+    }
+    std::map<std::pair<Node*, Node*>, Link*>::iterator it
+        = m_links.find(std::make_pair(node0, node1));
+    return it == m_links.end() ? 0 : it->second;
+}
+
+MapStore::Link* MapStore::link(Node* node0, Node* node1)
+{
+    if (node1 < node0) {
+        std::swap(node0, node1);
+    }
+    Link*& link = m_links[std::make_pair(node0, node1)];
+    if (!link) {
+        link = new Link;
+        link->nodes[0] = node0;
+        link->nodes[1] = node1;
+        node0->links.push_back(link);
+        node1->links.push_back(link);
+    }
+    return link;
+}
+
+void MapStore::update(std::vector<Metadata>& list, const MapElement& element,
+                      const std::string& publisherId, const std::string& timestamp)
+{
+    if (singleValued(element)) {
+        size_t kept = 0;
+        for (size_t ii = 0; ii < list.size(); ii++) {
+            if (strcmp(list[ii].element.localName(), element.localName()) != 0
+                || list[ii].element.ns != element.ns) {
+                if (kept != ii) {
+                    list[kept] = list[ii];
+                }
+                kept++;
+            }
+        }
+        list.resize(kept);
+    }
+    list.push_back(Metadata());
+    Metadata& metadata = list.back();
+    metadata.element = element;
+    metadata.element.setAttribute("publisher-id", publisherId);
+    metadata.element.setAttribute("timestamp", timestamp);
+    metadata.publisherId = publisherId;
+    metadata.serial = ++m_serial;
+    metadata.size = metadata.element.size();
+}
+
+//
+// Removes the metadata publish's filter matches, returning whether
+// there was any.
+//
+bool MapStore::remove(std::vector<Metadata>& list, const MapPublish& publish)
+{
+    size_t kept = 0;
+    for (size_t ii = 0; ii < list.size(); ii++) {
+        if (publish.hasFilter && !publish.filter.matches(list[ii].element)) {
+            if (kept != ii) {
+                list[kept] = list[ii];
+            }
+            kept++;
+        }
+    }
+    bool removed = kept != list.size();
+    list.resize(kept);
+    return removed;
+}
+
+bool MapStore::removePublisher(std::vector<Metadata>& list, const std::string& publisherId)
+{
+    size_t kept = 0;
+    for (size_t ii = 0; ii < list.size(); ii++) {
+        if (list[ii].publisherId != publisherId) {
+            if (kept != ii) {
+                list[kept] = list[ii];
+            }
+            kept++;
+        }
+    }
+    bool removed = kept != list.size();
+    list.resize(kept);
+    return removed;
+}
+
+void MapStore::apply(const MapPublish& publish, const std::string& publisherId,
+                     const std::string& timestamp)
+{
+    if (publish.update) {
+        Node* node0 = node(publish.identifiers[0]);
+        if (publish.isLink) {
+            Node* node1 = node(publish.identifiers[1]);
+            Link* link = this->link(node0, node1);
+            for (size_t ii = 0; ii < publish.metadata.size(); ii++) {
+                update(link->metadata, publish.metadata[ii], publisherId, timestamp);
+            }
+            changed(node0->key);
+            changed(node1->key);
+            prune(link);
+        } else {
+            for (size_t ii = 0; ii < publish.metadata.size(); ii++) {
+                update(node0->metadata, publish.metadata[ii], publisherId, timestamp);
+            }
+            changed(node0->key);
+            prune(node0);
+        }
+        return;
+    }
+
+    Node* node0 = findNode(publish.identifiers[0].key());
+    if (!node0) {
+        return;
+    }
+    if (publish.isLink) {
+        Node* node1 = findNode(publish.identifiers[1].key());
+        Link* link = node1 ? findLink(node0, node1) : 0;
+        if (link && remove(link->metadata, publish)) {
+            changed(node0->key);
+            changed(node1->key);
+            prune(link);
+        }
+    } else if (remove(node0->metadata, publish)) {
+        changed(node0->key);
+        prune(node0);
+    }
+}
+
+void MapStore::prune(Link* link)
+{
+    if (!link->metadata.empty()) {
+        return;
+    }
+    Node* node0 = link->nodes[0];
+    Node* node1 = link->nodes[1];
+    m_links.erase(std::make_pair(node0, node1));
+    node0->links.erase(std::find(node0->links.begin(), node0->links.end(), link));
+    node1->links.erase(std::find(node1->links.begin(), node1->links.end(), link));
+    delete link;
+    changed(node0->key);
+    changed(node1->key);
+    prune(node0);
+    prune(node1);
+}
+
+void MapStore::prune(Node* node)
+{
+    if (node->metadata.empty() && node->links.empty()) {
+        m_nodes.erase(node->key);
+        delete node;
+    }
+}
+
+//
+// Marks the subscriptions that reached the identifier.
+//
+void MapStore::changed(const std::string& key)
+{
+    std::map<std::string, std::set<Subscription*> >::iterator it = m_watchers.find(key);
+    if (it == m_watchers.end()) {
+        return;
+    }
+    std::set<Subscription*>::iterator subscription;
+    for (subscription = it->second.begin(); subscription != it->second.end(); subscription++) {
+        if (!(*subscription)->dirty) {
+            (*subscription)->dirty = true;
+            (*subscription)->session->dirty++;
+        }
+    }
+}
+
+void MapStore::watch(Subscription* subscription, const std::vector<std::string>& keys)
+{
+    for (size_t ii = 0; ii < subscription->watched.size(); ii++) {
+        std::map<std::string, std::set<Subscription*> >::iterator it
+            = m_watchers.find(subscription->watched[ii]);
+        if (it != m_watchers.end()) {
+            it->second.erase(subscription);
+            if (it->second.empty()) {
+                m_watchers.erase(it);
+            }
+        }
+    }
+    for (size_t ii = 0; ii < keys.size(); ii++) {
+        m_watchers[keys[ii]].insert(subscription);
+    }
+    subscription->watched = keys;
+}
+
+void MapStore::deleteSubscription(Subscription* subscription)
+{
+    watch(subscription, std::vector<std::string>());
+    if (subscription->dirty) {
+        subscription->session->dirty--;
+    }
+    subscription->session->subscriptions.erase(subscription->name);
+    delete subscription;
+}
+
+bool MapStore::publish(const std::string& sessionId, const std::vector<MapPublish>& publishes)
+{
+    pthread_mutex_lock(&m_mutex);
+    Session* session = findSession(sessionId);
+    if (session) {
+        std::string now = timestamp();
+        for (size_t ii = 0; ii < publishes.size(); ii++) {
+            apply(publishes[ii], session->publisherId, now);
+        }
+        pthread_cond_broadcast(&m_changed);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return session != 0;
+}
+
+bool MapStore::subscribe(const std::string& sessionId,
+                         const std::vector<MapSubscribe>& subscribes)
+{
+    pthread_mutex_lock(&m_mutex);
+    Session* session = findSession(sessionId);
+    for (size_t ii = 0; session && ii < subscribes.size(); ii++) {
+        const MapSubscribe& subscribe = subscribes[ii];
+        std::map<std::string, Subscription*>::iterator it
+            = session->subscriptions.find(subscribe.name);
+        if (!subscribe.update) {
+            if (it != session->subscriptions.end()) {
+                deleteSubscription(it->second);
+            }
+            continue;
+        }
+        Subscription* subscription;
+        if (it != session->subscriptions.end()) {
+            subscription = it->second;
+        } else {
+            subscription = new Subscription;
+            subscription->session = session;
+            subscription->name = subscribe.name;
+            subscription->fingerprint = 0;
+            subscription->dirty = false;
+            session->subscriptions[subscribe.name] = subscription;
+        }
+        subscription->search = subscribe.search;
+        subscription->reported = false;
+        if (!subscription->dirty) {
+            subscription->dirty = true;
+            session->dirty++;
+        }
+    }
+    if (session) {
+        pthread_cond_broadcast(&m_changed);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return session != 0;
+}
+
+void MapStore::traverse(const MapSearch& search, Traversal& traversal)
+{
+    std::string startKey = search.start.key();
+    traversal.reached.push_back(startKey);
+    Node* start = findNode(startKey);
+    if (!start) {
+        return;
+    }
+    traversal.nodes.push_back(start);
+    std::set<const Node*> seen;
+    seen.insert(start);
+    std::set<const Link*> followed;
+
+    // Breadth first, one depth at a time.
+    size_t begin = 0;
+    for (int depth = 0; depth < search.maxDepth && begin < traversal.nodes.size(); depth++) {
+        size_t end = traversal.nodes.size();
+        for (size_t ii = begin; ii < end; ii++) {
+            const Node* node = traversal.nodes[ii];
+            for (size_t jj = 0; jj < node->links.size(); jj++) {
+                const Link* link = node->links[jj];
+                if (followed.count(link)) {
+                    continue;
+                }
+                bool matched = search.matchLinks.matchesAll();
+                for (size_t kk = 0; !matched && kk < link->metadata.size(); kk++) {
+                    matched = search.matchLinks.matches(link->metadata[kk].element);
+                }
+                if (!matched) {
+                    continue;
+                }
+                followed.insert(link);
+                traversal.links.push_back(link);
+                const Node* other = link->nodes[0] == node ? link->nodes[1] : link->nodes[0];
+                if (seen.insert(other).second) {
+                    traversal.nodes.push_back(other);
+                    traversal.reached.push_back(other->key);
+                }
+            }
+        }
+        begin = end;
+    }
+}
+
+//
+// Filters the metadata of what traversal reached and, if handler is
+// given, passes the result to it. The first pass only sizes the result
+// and computes its fingerprint. Returns false if the result is larger
+// than search.maxSize, in which case handler is only told that.
+//
+bool MapStore::report(const char* name, const MapSearch& search, const Traversal& traversal,
+                      unsigned long long* fingerprint, MapResultHandler* handler)
+{
+    std::vector<const MapElement*> metadata;
+    for (int pass = 0; pass < (handler ? 2 : 1); pass++) {
+        bool emit = pass == 1;
+        unsigned long long hash = 14695981039346656037ULL;
+        size_t size = 0;
+        if (emit) {
+            handler->searchResultBegin(name);
+        }
+        if (traversal.nodes.empty()) {
+            // The start identifier is reported even without metadata.
+            size += 40 + search.start.value.size();
+            mix(hash, traversal.reached[0].data(), traversal.reached[0].size());
+            if (emit) {
+                handler->identifierResult(search.start, metadata);
+            }
+        }
+        for (size_t ii = 0; ii < traversal.nodes.size(); ii++) {
+            const Node* node = traversal.nodes[ii];
+            metadata.clear();
+            size += 40 + node->identifier.value.size();
+            mix(hash, node->key.data(), node->key.size());
+            for (size_t jj = 0; jj < node->metadata.size(); jj++) {
+                const Metadata& item = node->metadata[jj];
+                if (search.resultFilter.matches(item.element)) {
+                    metadata.push_back(&item.element);
+                    size += item.size;
+                    mix(hash, &item.serial, sizeof item.serial);
+                }
+            }
+            if (emit) {
+                handler->identifierResult(node->identifier, metadata);
+            }
+        }
+        for (size_t ii = 0; ii < traversal.links.size(); ii++) {
+            const Link* link = traversal.links[ii];
+            metadata.clear();
+            size += 100 + link->nodes[0]->identifier.value.size()
+                + link->nodes[1]->identifier.value.size();
+            mix(hash, link->nodes[0]->key.data(), link->nodes[0]->key.size());
+            mix(hash, link->nodes[1]->key.data(), link->nodes[1]->key.size());
+            for (size_t jj = 0; jj < link->metadata.size(); jj++) {
+                const Metadata& item = link->metadata[jj];
+                if (search.resultFilter.matches(item.element)) {
+                    metadata.push_back(&item.element);
+                    size += item.size;
+                    mix(hash, &item.serial, sizeof item.serial);
+                }
+            }
+            if (emit) {
+                handler->linkResult(link->nodes[0]->identifier, link->nodes[1]->identifier,
+                                    metadata);
+            }
+        }
+        if (emit) {
+            handler->searchResultEnd(name);
+            break;
+        }
+        if (search.maxSize >= 0 && size > (size_t)search.maxSize) {
+            if (handler) {
+                handler->searchResultTooBig(name);
+            }
+            return false;
+        }
+        if (fingerprint) {
+            *fingerprint = hash;
+        }
+    }
+    return true;
+}
+
+bool MapStore::search(const std::string& sessionId, const MapSearch& search,
+                      MapResultHandler& handler)
+{
+    pthread_mutex_lock(&m_mutex);
+    Session* session = findSession(sessionId);
+    if (session) {
+        Traversal traversal;
+        traverse(search, traversal);
+        report(0, search, traversal, 0, &handler);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return session != 0;
+}
+
+bool MapStore::poll(const std::string& sessionId, MapResultHandler& handler)
+{
+    pthread_mutex_lock(&m_mutex);
+    Session* session;
+    while ((session = findSession(sessionId)) != 0) {
+        bool reported = false;
+        std::map<std::string, Subscription*>::iterator it = session->subscriptions.begin();
+        while (session->dirty > 0 && it != session->subscriptions.end()) {
+            Subscription* subscription = (it++)->second;
+            if (!subscription->dirty) {
+                continue;
+            }
+            subscription->dirty = false;
+            session->dirty--;
+            Traversal traversal;
+            traverse(subscription->search, traversal);
+            watch(subscription, traversal.reached);
+            unsigned long long fingerprint;
+            if (!report(subscription->name.c_str(), subscription->search, traversal,
+                        &fingerprint, 0)) {
+                handler.searchResultTooBig(subscription->name.c_str());
+                deleteSubscription(subscription);
+                reported = true;
+            } else if (!subscription->reported || fingerprint != subscription->fingerprint) {
+                report(subscription->name.c_str(), subscription->search, traversal, 0,
+                       &handler);
+                subscription->fingerprint = fingerprint;
+                subscription->reported = true;
+                reported = true;
+            }
+        }
+        if (reported) {
+            break;
+        }
+        pthread_cond_wait(&m_changed, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return session != 0;
+}
+
+bool MapStore::purge(const std::string& sessionId, const std::string& publisherId)
+{
+    pthread_mutex_lock(&m_mutex);
+    Session* session = findSession(sessionId);
+    if (session) {
+        std::map<std::string, Node*>::iterator node;
+        for (node = m_nodes.begin(); node != m_nodes.end(); node++) {
+            if (removePublisher(node->second->metadata, publisherId)) {
+                changed(node->first);
+            }
+        }
+        std::vector<Link*> links;
+        std::map<std::pair<Node*, Node*>, Link*>::iterator link;
+        for (link = m_links.begin(); link != m_links.end(); link++) {
+            links.push_back(link->second);
+        }
+        // Pruning a link prunes its identifiers, but never another link.
+        for (size_t ii = 0; ii < links.size(); ii++) {
+            if (removePublisher(links[ii]->metadata, publisherId)) {
+                changed(links[ii]->nodes[0]->key);
+                changed(links[ii]->nodes[1]->key);
+                prune(links[ii]);
+            }
+        }
+        node = m_nodes.begin();
+        while (node != m_nodes.end()) {
+            prune((node++)->second);
+        }
+        pthread_cond_broadcast(&m_changed);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return session != 0;
+}
+
+size_t MapStore::identifierCount()
+{
+    pthread_mutex_lock(&m_mutex);
+    size_t count = m_nodes.size();
+    pthread_mutex_unlock(&m_mutex);
+    return count;
+}
+
+size_t MapStore::linkCount()
+{
+    pthread_mutex_lock(&m_mutex);
+    size_t count = m_links.size();
+    pthread_mutex_unlock(&m_mutex);
+    return count;
+}
@@ -0,0 +1,360 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_mapstore_h__
+#define ifmap_mapstore_h__
+
+#include <pthread.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*
+ * An identifier as the store keys it. subtype holds the identity
+ * type, IP address type, or device name kind of those identifiers,
+ * as whatever values the caller uses; other is the identity's other
+ * type definition. Fields that do not apply are left empty.
+ */
+struct MapIdentifier
+{
+    enum Type { ACCESS_REQUEST, DEVICE, IDENTITY, IP_ADDRESS, MAC_ADDRESS };
+
+    MapIdentifier() : type(ACCESS_REQUEST), subtype(0) {}
+
+    Type type;
+    int subtype;
+    std::string domain;
+    std::string value;
+    std::string other;
+
+    /*
+     * Returns a string that is equal for two identifiers exactly when
+     * they are the same identifier.
+     */
+    std::string key() const;
+};
+
+/*
+ * A metadata element, or one of its children. Names are kept as they
+ * arrived, with their prefixes, and ns is the namespace URI.
+ */
+struct MapElement
+{
+    std::string ns;
+    std::string name;
+    std::string text;
+    std::vector<std::pair<std::string, std::string> > attributes;
+    std::vector<MapElement> children;
+
+    /*
+     * Returns name without its prefix.
+     */
+    const char* localName() const;
+
+    /*
+     * Returns the value of the attribute or the text of the first
+     * child with localName, or 0.
+     */
+    const std::string* attribute(const char* localName) const;
+    const std::string* childText(const char* localName) const;
+
+    /*
+     * Sets attribute name, replacing any attribute of that name.
+     */
+    void setAttribute(const char* name, const std::string& value);
+
+    /*
+     * Rough size of the element as XML, for max-size.
+     */
+    size_t size() const;
+};
+
+/*
+ * A match-links, result-filter or delete filter. Only the simple
+ * forms clients send are understood: element names joined by "or",
+ * each optionally followed by [predicates] joined by "and", where a
+ * predicate compares a child element or @attribute to a quoted
+ * string, such as
+ *
+ *     meta:ip-mac or meta:event[name="p2p" and @publisher-id="p1"]
+ *
+ * Prefixes are ignored when comparing names.
+ */
+class MetadataFilter
+{
+public:
+    /*
+     * A filter that has not been parsed matches everything.
+     */
+    MetadataFilter() : m_all(true) {}
+
+    /*
+     * Parses filter, or makes this match everything if filter is 0.
+     * Returns false if filter is not understood.
+     */
+    bool parse(const char* filter);
+
+    bool matchesAll() const { return m_all; }
+    bool matches(const MapElement& element) const;
+
+private:
+    struct Predicate
+    {
+        bool attribute;
+        std::string name;
+        std::string value;
+    };
+
+    struct Term
+    {
+        std::string name;
+        std::vector<Predicate> predicates;
+    };
+
+    bool m_all;
+    std::vector<Term> m_terms;
+};
+
+struct MapSearch
+{
+    MapSearch() : maxDepth(0), maxSize(-1) {}
+
+    MapIdentifier start;
+
+    // Links are followed only if some metadata on them matches, and
+    // only matching metadata is returned.
+    MetadataFilter matchLinks;
+    MetadataFilter resultFilter;
+    int maxDepth;
+    long maxSize;
+};
+
+/*
+ * One change to a publish request. A delete without a filter removes
+ * all metadata from the identifier or link.
+ */
+struct MapPublish
+{
+    MapPublish() : update(true), isLink(false), hasFilter(false) {}
+
+    bool update;
+    bool isLink;
+    MapIdentifier identifiers[2];
+    std::vector<MapElement> metadata;
+    bool hasFilter;
+    MetadataFilter filter;
+};
+
+/*
+ * One change to a subscribe request. A delete only uses name.
+ */
+struct MapSubscribe
+{
+    MapSubscribe() : update(true) {}
+
+    bool update;
+    std::string name;
+    MapSearch search;
+};
+
+/*
+ * Receives the results of a search, or of the subscriptions a poll
+ * reports. The store is locked during the calls, and what is passed
+ * is only valid until they return. name is 0 for a search.
+ */
+class MapResultHandler
+{
+public:
+    virtual ~MapResultHandler() {}
+    virtual void searchResultBegin(const char* name) {}
+    virtual void identifierResult(const MapIdentifier& identifier,
+                                  const std::vector<const MapElement*>& metadata) {}
+    virtual void linkResult(const MapIdentifier& identifier0, const MapIdentifier& identifier1,
+                            const std::vector<const MapElement*>& metadata) {}
+    virtual void searchResultEnd(const char* name) {}
+
+    /*
+     * Called instead of the others when a result is larger than its
+     * max-size. A subscription that is too big is deleted.
+     */
+    virtual void searchResultTooBig(const char* name) {}
+};
+
+/*
+ * In-memory MAP holding sessions, the identifiers and links that
+ * have metadata, and subscriptions, for a mock server. All of it is
+ * guarded by one mutex, so it may be used from many threads; poll()
+ * waits on a condition until a subscription of its session changes.
+ *
+ * Identifiers are kept only while they have metadata or links, and
+ * links only while they have metadata. Each subscription watches the
+ * identifiers its last result reached, and a change to one of them or
+ * their links marks it for the next poll, which reports it only if
+ * its result differs from the one last reported.
+ *
+ * Metadata is stamped with publisher-id and timestamp attributes.
+ * meta:* elements that the schema makes single valued, and others
+ * with cardinality="singleValue", replace any element of the same
+ * name on an update; the rest accumulate.
+ *
+ * Methods taking a session ID return false if it is unknown.
+ */
+class MapStore
+{
+public:
+    MapStore();
+    ~MapStore();
+
+    /*
+     * Starts a session. The publisher ID is user, or "publisher",
+     * followed by a number unique to the session.
+     */
+    void newSession(const char* user, std::string& sessionId, std::string& publisherId);
+    bool attachSession(const std::string& sessionId, std::string& publisherId);
+
+    /*
+     * Applies every change in publishes, in order, as one.
+     */
+    bool publish(const std::string& sessionId, const std::vector<MapPublish>& publishes);
+
+    bool subscribe(const std::string& sessionId, const std::vector<MapSubscribe>& subscribes);
+
+    bool search(const std::string& sessionId, const MapSearch& search,
+                MapResultHandler& handler);
+
+    /*
+     * Waits until at least one subscription of the session has a new
+     * result, then reports every one that does.
+     */
+    bool poll(const std::string& sessionId, MapResultHandler& handler);
+
+    /*
+     * Removes all metadata published under publisherId.
+     */
+    bool purge(const std::string& sessionId, const std::string& publisherId);
+
+    size_t identifierCount();
+    size_t linkCount();
+
+private:
+    MapStore(const MapStore&);
+    MapStore& operator=(const MapStore&);
+
+    struct Metadata
+    {
+        MapElement element;
+        std::string publisherId;
+        unsigned long long serial;
+        size_t size;
+    };
+
+    struct Link;
+
+    struct Node
+    {
+        MapIdentifier identifier;
+        std::string key;
+        std::vector<Metadata> metadata;
+        std::vector<Link*> links;
+    };
+
+    struct Link
+    {
+        Node* nodes[2];
+        std::vector<Metadata> metadata;
+    };
+
+    struct Session;
+
+    struct Subscription
+    {
+        Session* session;
+        std::string name;
+        MapSearch search;
+        std::vector<std::string> watched;
+        unsigned long long fingerprint;
+        bool reported;
+        bool dirty;
+    };
+
+    struct Session
+    {
+        std::string id;
+        std::string publisherId;
+        std::map<std::string, Subscription*> subscriptions;
+        long dirty;
+    };
+
+    /*
+     * The identifiers and links a search reaches.
+     */
+    struct Traversal
+    {
+        std::vector<const Node*> nodes;
+        std::vector<const Link*> links;
+        std::vector<std::string> reached;
+    };
+
+    Session* findSession(const std::string& id);
+    Node* findNode(const std::string& key);
+    Node* node(const MapIdentifier& identifier);
+    Link* link(Node* node0, Node* node1);
+    Link* findLink(Node* node0, Node* node1);
+
+    void update(std::vector<Metadata>& list, const MapElement& element,
+                const std::string& publisherId, const std::string& timestamp);
+    bool remove(std::vector<Metadata>& list, const MapPublish& publish);
+    static bool removePublisher(std::vector<Metadata>& list, const std::string& publisherId);
+    void apply(const MapPublish& publish, const std::string& publisherId,
+               const std::string& timestamp);
+    void prune(Link* link);
+    void prune(Node* node);
+
+    void changed(const std::string& key);
+    void watch(Subscription* subscription, const std::vector<std::string>& keys);
+    void deleteSubscription(Subscription* subscription);
+
+    void traverse(const MapSearch& search, Traversal& traversal);
+    bool report(const char* name, const MapSearch& search, const Traversal& traversal,
+                unsigned long long* fingerprint, MapResultHandler* handler);
+
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_changed;
+    std::map<std::string, Session*> m_sessions;
+    std::map<std::string, Node*> m_nodes;
+    std::map<std::pair<Node*, Node*>, Link*> m_links;
+    std::map<std::string, std::set<Subscription*> > m_watchers;
+    unsigned long long m_serial;
+    long m_sessionCount;
+};
+
+#endif /*ifmap_mapstore_h__*/
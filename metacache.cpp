@@ -0,0 +1,99 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "metacache.h"
+
+MetadataCache::MetadataCache()
+    : m_soap(SOAP_XML_DOM), m_hits(0), m_misses(0)
+{
+}
+
+MetadataCache::~MetadataCache()
+{
+    soap_destroy(&m_soap);
+    soap_end(&m_soap);
+}
+
+ifmap__MetadataListType* MetadataCache::find(const std::string& key)
+{
+    std::map<std::string, ifmap__MetadataListType*>::iterator it = m_lists.find(key);
+    if (it == m_lists.end()) {
+        m_misses++;
+        return 0;
+    }
+    m_hits++;
+    return it->second;
+}
+
+ifmap__MetadataListType*
+MetadataCache::insert(const std::string& key, soap_dom_element* elems, int count)
+{
+    m_soap.dom = 0;
+    ifmap__MetadataListType* list = soap_new_ifmap__MetadataListType(&m_soap, -1);
+    list->__size = count;
+    list->__any = elems;
+    m_lists[key] = list;
+    return list;
+}
+
+ifmap__MetadataListType* MetadataCache::capabilities(const std::vector<const char*>& roles)
+{
+    std::string key = "meta:capability";
+    int ii;
+    for (ii = 0; ii < roles.size(); ii++) {
+        key += ' ';
+        key += roles[ii];
+    }
+    ifmap__MetadataListType* list = find(key);
+    if (list) {
+        return list;
+    }
+
+    // Each element is serialized on its own, then copied into the
+    // array the metadata list needs.
+    std::vector<soap_dom_element*> elems;
+    for (ii = 0; ii < roles.size(); ii++) {
+        m_soap.dom = 0;
+        _meta__capability capability;
+        capability.name = const_cast<char*>(roles[ii]);
+        capability.soap_out(&m_soap, "meta:capability", 0, 0);
+        elems.push_back(m_soap.dom);
+    }
+
+    soap_dom_element* result = 0;
+    if (!elems.empty()) {
+        result = soap_new_xsd__anyType(&m_soap, elems.size());
+        for (ii = 0; ii < elems.size(); ii++) {
+            result[ii] = *elems[ii];
+        }
+    }
+    return insert(key, result, elems.size());
+}
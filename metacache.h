@@ -0,0 +1,113 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_metacache_h__
+#define ifmap_metacache_h__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ifmapH.h"
+
+/*
+ * Cache of metadata lists whose DOM is built once and then shared by
+ * every request that publishes the same metadata.
+ *
+ * The DOM lives in the cache's own soap context, which is never reset
+ * while the cache exists, so cached lists may be referenced from
+ * requests in any other context. Requests only read the shared DOM,
+ * but the cache itself is not thread safe; keep one per thread.
+ */
+class MetadataCache
+{
+public:
+    MetadataCache();
+    ~MetadataCache();
+
+    /*
+     * Returns a single element list holding a default constructed Meta
+     * serialized as tag, such as _meta__authenticated_as as
+     * "meta:authenticated-as".
+     */
+    template <class Meta>
+    ifmap__MetadataListType* constant(const char* tag)
+    {
+        ifmap__MetadataListType* list = find(tag);
+        if (!list) {
+            Meta meta;
+            list = store(tag, meta, tag);
+        }
+        return list;
+    }
+
+    /*
+     * Returns a single element list holding meta serialized as tag,
+     * reusing the list last stored under key. The caller must make key
+     * distinguish every value of meta that ends up in the DOM.
+     */
+    template <class Meta>
+    ifmap__MetadataListType* get(const std::string& key, const Meta& meta, const char* tag)
+    {
+        ifmap__MetadataListType* list = find(key);
+        if (!list) {
+            list = store(key, meta, tag);
+        }
+        return list;
+    }
+
+    /*
+     * Returns a list with one meta:capability element per role.
+     */
+    ifmap__MetadataListType* capabilities(const std::vector<const char*>& roles);
+
+    long long hits() const { return m_hits; }
+    long long misses() const { return m_misses; }
+
+private:
+    ifmap__MetadataListType* find(const std::string& key);
+
+    template <class Meta>
+    ifmap__MetadataListType* store(const std::string& key, const Meta& meta, const char* tag)
+    {
+        m_soap.dom = 0;
+        meta.soap_out(&m_soap, tag, 0, 0);
+        return insert(key, m_soap.dom, 1);
+    }
+
+    ifmap__MetadataListType* insert(const std::string& key, soap_dom_element* elems, int count);
+
+    struct soap m_soap;
+    std::map<std::string, ifmap__MetadataListType*> m_lists;
+    long long m_hits;
+    long long m_misses;
+};
+
+#endif /*ifmap_metacache_h__*/
@@ -30,288 +30,744 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <unistd.h>
-#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
 #include "ifmap.nsmap"
-#include "ifmapStub.h"
-#include "ifmapServiceProxy.h"
-#include "connect.h"
+#include "client.h"
+#include "call.h"
+#include "display.h"
+#include "graph.h"
+#include "pollstream.h"
 
 using namespace std;
 
-static pid_t g_pollPid = -1;
-static char* g_user = 0;
-static char* g_password = 0;
+static bool g_stream = false;
+static MapGraph* g_graph = 0;
+static long g_batchSize = 1000;
 
-static void onExit(void)
-{
-    if (g_pollPid > 0) {
-        kill(SIGTERM, g_pollPid);
-    }
-}
+// Names of the subscriptions this session has, which are the IP
+// addresses subscribed to.
+static std::set<std::string> g_subscriptions;
 
-static void onSigChld(int)
-{
-    exit(0);
-}
+static const unsigned long s_maxRange = 1UL << 20;
 
-static void displayMetadata(struct soap_dom_element& elem)
+//
+// Shows poll results as displaySearchResult() does, one identifier or
+// link result at a time, followed by the prompt. With --graph the
+// results go into g_graph instead and only their size is shown.
+//
+class PollPrinter : public PollResultHandler
 {
-    switch (elem.type) {
-    case SOAP_TYPE__meta__capability:
-        {
-            _meta__capability* cap = (_meta__capability*)elem.node;
-            printf("Capability: %s\n", cap->name);
-        }
-        break;
-    case SOAP_TYPE__meta__event:
-        {
-            _meta__event* event = (_meta__event*)elem.node;
-            printf("Event: %s\n", event->name);
-            break;
+public:
+    PollPrinter() : m_identifiers(0), m_links(0) {}
+
+    virtual void searchResultBegin(const char* name)
+    {
+        if (g_graph) {
+            g_graph->searchResultBegin(name);
+            m_identifiers = 0;
+            m_links = 0;
+            return;
         }
+        printf("\n\nSearch result for %s\n", name);
     }
-}
 
-static void displaySearchResult(ifmap__SearchResultType& result)
-{
-    printf("\n\nSearch result for %s\n", result.name);
-    int ii;
-    for (ii = 0; ii < result.__sizeidentifierResult; ii++) {
-        // Look for IP address and identity identifiers
-        // Look for access-request identifier, and get capabilities
-        ifmap__IdentifierType* ident = result.identifierResult[ii]->identifier;
-        switch (ident->__union_IdentifierType) {
-        case SOAP_UNION__ifmap__union_IdentifierType_access_request:
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_identity:
-            printf("userName: %s\n", ident->union_IdentifierType.identity->name);
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_ip_address:
-            printf("IP Address: %s\n", ident->union_IdentifierType.ip_address->value);
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_mac_address:
-            printf("MAC Address: %s\n", ident->union_IdentifierType.mac_address->value);
-            break;
-        case SOAP_UNION__ifmap__union_IdentifierType_device:
-            if (ident->union_IdentifierType.device->__union_DeviceType == SOAP_UNION__ifmap__union_DeviceType_aik_name) {
-                printf("AIK Device: %s\n", ident->union_IdentifierType.device->union_DeviceType.aik_name);
-            } else if (ident->union_IdentifierType.device->__union_DeviceType == SOAP_UNION__ifmap__union_DeviceType_name) {
-                printf("Device: %s\n", ident->union_IdentifierType.device->union_DeviceType.aik_name);
-            }
-            break;
-        }
-        ifmap__MetadataListType* md = result.identifierResult[ii]->metadata;
-        if (!md) {
-            continue;
-        }
-        for (int jj = 0; jj < md->__size; jj++) {
-            displayMetadata(*(md->__any + jj));
+    virtual void identifierResult(const char* searchName, const XmlNode& result)
+    {
+        if (g_graph) {
+            g_graph->identifierResult(searchName, result);
+            m_identifiers++;
+            return;
         }
+        displayIdentifierResult(result);
     }
-    for (ii = 0; ii < result.__sizelinkResult; ii++) {
-        ifmap__MetadataListType* md = result.linkResult[ii]->metadata;
-        if (!md) {
-            continue;
+
+    virtual void linkResult(const char* searchName, const XmlNode& result)
+    {
+        if (g_graph) {
+            g_graph->linkResult(searchName, result);
+            m_links++;
+            return;
         }
-        for (int jj = 0; jj < md->__size; jj++) {
-            displayMetadata(*(md->__any + jj));
+        displayLinkResult(result);
+    }
+
+    virtual void searchResultEnd(const char* name)
+    {
+        if (g_graph) {
+            g_graph->searchResultEnd(name);
+            printf("\n\nSearch result for %s: %ld identifiers, %ld links;"
+                   " graph has %lu identifiers, %lu links",
+                   name, m_identifiers, m_links,
+                   (unsigned long)g_graph->nodeCount(), (unsigned long)g_graph->edgeCount());
         }
+        printf("\n\n-> ");
+        fflush(stdout);
     }
-    printf("\n\n-> ");
-    fflush(stdout);
+
+    virtual void errorResult(const char* errorCode, const char* errorString)
+    {
+        fprintf(stderr, "Poll error %s: %s\n", errorCode, errorString);
+    }
+
+private:
+    long m_identifiers;
+    long m_links;
+};
+
+//
+// The poll connection is a clone of the command connection attached
+// to the same session. At most one poll is outstanding on it at a
+// time, and its response is read as it arrives.
+//
+struct Poller
+{
+    Poller() : client(0), parser(printer), receiver(g_stream ? &parser : 0), fd(-1) {}
+
+    IfmapClient* client;
+    PollPrinter printer;
+    PollStreamParser parser;
+    ResponseReceiver receiver;
+    int fd;
+};
+
+//
+// The subscribe or unsubscribe command being carried out. Its requests
+// go out one at a time on the command connection, and commands read
+// meanwhile wait in g_waitingCommands until it is done.
+//
+struct SubscribeJob
+{
+    SubscribeJob() : active(false), update(false), next(0), sent(0), requests(0) {}
+
+    bool active;
+    bool update;
+    std::vector<std::string> names;
+    // The first name of the outstanding request, and how many it has
+    size_t next;
+    size_t sent;
+    long requests;
+};
+
+static SubscribeJob g_job;
+static std::deque<std::string> g_waitingCommands;
+
+static bool attachPoller(IfmapClient& client, Poller& poller)
+{
+    poller.client = client.clone();
+    if (!g_stream) {
+        poller.client->soap()->imode |= SOAP_DOM_NODE;
+        poller.client->soap()->omode |= SOAP_DOM_NODE;
+    }
+    if (poller.client->attach(client.sessionId()) != SOAP_OK) {
+        poller.client->printFault(stderr);
+        return false;
+    }
+    return true;
 }
 
-static void runPollProc(char* url, char* sessionId)
+static void watchPoller(int epollFd, Poller& poller)
 {
-    Service service;
-    service.soap->imode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE | SOAP_DOM_NODE;
-    service.soap->omode |= SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE | SOAP_DOM_NODE;
-    if (g_user && g_password) {
-        service.soap->userid = g_user;
-        service.soap->passwd = g_password;
-    }
-    service.endpoint = url;
-    if (soap_ssl_client_context(service.soap,
-                                SOAP_SSL_NO_AUTHENTICATION,
-                                0, 0, 0, 0, 0)) {
-        soap_print_fault(service.soap, stderr);
-        return;
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = &poller;
+    poller.fd = poller.client->soap()->socket;
+    // The socket may be new if the server closed the previous one
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, poller.fd, &event) == -1
+        && (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, poller.fd, &event) == -1)) {
+        perror("epoll_ctl");
+        exit(1);
     }
+}
 
-    struct __wsdl__AttachSessionResponse response;
-    bzero(&response, sizeof response);
+static void sendPoll(int epollFd, Poller& poller)
+{
+    ifmap__PollRequestType pollRequest;
+    if (ifmapSendPoll(poller.client->service(), &pollRequest) != SOAP_OK) {
+        poller.client->printFault(stderr);
+        exit(1);
+    }
+    poller.receiver.begin(poller.client->service());
+    watchPoller(epollFd, poller);
+}
 
-    SOAP_ENV__Header header;
-    bzero(&header, sizeof header);
-    header.ifmap__attach_session = const_cast<char*>(sessionId);
-    service.soap->header = &header;
+//
+// Reads what has arrived of the response to the outstanding poll.
+// With --stream its results are shown as they are parsed, otherwise
+// all at once. Returns true once the response is complete.
+//
+static bool recvPoll(Poller& poller)
+{
+    if (poller.receiver.read(poller.client->service()) != SOAP_OK) {
+        poller.client->printFault(stderr);
+        exit(1);
+    }
+    if (!poller.receiver.done()) {
+        return false;
+    }
+    if (g_stream) {
+        return true;
+    }
 
-    int code = service.__wsdl__AttachSession("", response);
-    if (code) {
-        soap_print_fault(service.soap, stderr);
-        return;
+    __wsdl__PollResponse pollResponse;
+    if (poller.receiver.parsePoll(poller.client->service(), pollResponse) != SOAP_OK) {
+        poller.client->printFault(stderr);
+        exit(1);
     }
-    
-    while (true) {
-        ifmap__PollRequestType pollRequest;
-        __wsdl__PollResponse pollResponse;
-        code = service.__wsdl__Poll(&pollRequest, pollResponse);
-        if (code) {
-            soap_print_fault(service.soap, stderr);
-            return;
-        }
-        if (pollResponse.ifmap__response) {
-            if (pollResponse.ifmap__response->__union_ResponseType !=
-                SOAP_UNION__ifmap__union_ResponseType_pollResult) {
-                fprintf(stderr, "Unexpected result type: %d",
-                        pollResponse.ifmap__response->__union_ResponseType);
-                continue;
-            }
+    if (pollResponse.ifmap__response) {
+        if (pollResponse.ifmap__response->__union_ResponseType !=
+            SOAP_UNION__ifmap__union_ResponseType_pollResult) {
+            fprintf(stderr, "Unexpected result type: %d",
+                    pollResponse.ifmap__response->__union_ResponseType);
+        } else {
             ifmap__PollResultType* pollResult = pollResponse.ifmap__response->union_ResponseType.pollResult;
             for (int ii = 0; ii < pollResult->__size_PollResultType; ii++) {
                 if (pollResult->__union_PollResultType[ii].__union_PollResultType
                     == SOAP_UNION__ifmap__union_PollResultType_searchResult) {
                     displaySearchResult(*pollResult->__union_PollResultType[ii].union_PollResultType.searchResult);
+                    printf("\n\n-> ");
+                    fflush(stdout);
                 }
             }
         }
     }
+    poller.client->reset();
+    return true;
 }
 
-static void subscribe(Service& service, char* ipStr)
+//
+// The parts of one choice of a SubscribeRequestType.
+//
+struct SubscribeItem
 {
     _ifmap__SubscribeRequestType_update update;
+    ifmap__DeleteSearchRequestType deleteSearch;
     ifmap__IdentifierType identifier;
-    identifier.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
-
     ifmap__IPAddressType ip;
-    ip.value = ipStr;
-    ip.type = _ifmap__IPAddressType_type__IPv4;
-
-    identifier.union_IdentifierType.ip_address = &ip;
+};
 
-    update.identifier = &identifier;
-    update.name = ipStr;
-    update.match_links = "meta:authenticated-as or meta:access-request-ip or"
-        " meta:access-request-device or meta:ip-mac or meta:access-request-mac";
+//
+// Sends the next request of g_job, packing up to g_batchSize choices
+// into its SubscribeRequestType.
+//
+static void sendNextSubscriptions(IfmapClient& client)
+{
+    const std::vector<std::string>& names = g_job.names;
+    size_t begin = g_job.next;
+    size_t count = std::min(names.size() - begin, (size_t)g_batchSize);
+    std::vector<SubscribeItem> items(count);
+    std::vector<__ifmap__union_SubscribeRequestType> choices(count);
+    size_t ii;
+    for (ii = 0; ii < count; ii++) {
+        SubscribeItem& item = items[ii];
+        char* name = const_cast<char*>(names[begin + ii].c_str());
+        if (g_job.update) {
+            item.ip.value = name;
+            item.ip.type = _ifmap__IPAddressType_type__IPv4;
+            item.identifier.__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
+            item.identifier.union_IdentifierType.ip_address = &item.ip;
+            item.update.identifier = &item.identifier;
+            item.update.name = name;
+            item.update.match_links = "meta:authenticated-as or meta:access-request-ip or"
+                " meta:access-request-device or meta:ip-mac or meta:access-request-mac";
+            choices[ii].__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_update;
+            choices[ii].union_SubscribeRequestType.update = &item.update;
+        } else {
+            item.deleteSearch.name = name;
+            choices[ii].__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_delete_;
+            choices[ii].union_SubscribeRequestType.delete_ = &item.deleteSearch;
+        }
+    }
 
     ifmap__SubscribeRequestType subscribeRequest;
-        subscribeRequest.__size_SubscribeRequestType = 1;
+    subscribeRequest.__size_SubscribeRequestType = count;
+    subscribeRequest.__union_SubscribeRequestType = &choices[0];
+    if (client.sendSubscribe(&subscribeRequest) != SOAP_OK) {
+        client.printFault(stderr);
+        exit(1);
+    }
+    g_job.sent = count;
+}
 
-    __ifmap__union_SubscribeRequestType req;
-    req.__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_update;
-    req.union_SubscribeRequestType.update = &update;
+//
+// Subscribes to, or unsubscribes from, the IP addresses in names,
+// each subscription being named by its address. Only the first request
+// is sent here; recvSubscriptions() sends the rest as responses come
+// back.
+//
+static void startSubscriptions(IfmapClient& client, const std::vector<std::string>& names,
+                               bool update)
+{
+    g_job.active = true;
+    g_job.update = update;
+    g_job.names = names;
+    g_job.next = 0;
+    g_job.requests = 0;
+    sendNextSubscriptions(client);
+}
 
-    subscribeRequest.__union_SubscribeRequestType = &req;
+//
+// Reads the response to g_job's outstanding request, once the command
+// connection is readable, and updates g_subscriptions. The response is
+// small, so it is read whole. Then sends the next request, or ends the
+// job.
+//
+static void recvSubscriptions(IfmapClient& client)
+{
+    if (client.recvSubscribe() != SOAP_OK) {
+        client.printFault(stderr);
+        exit(1);
+    }
+    client.reset();
+    g_job.requests++;
+
+    size_t end = g_job.next + g_job.sent;
+    for (size_t ii = g_job.next; ii < end; ii++) {
+        if (g_job.update) {
+            g_subscriptions.insert(g_job.names[ii]);
+        } else {
+            g_subscriptions.erase(g_job.names[ii]);
+            if (g_graph) {
+                g_graph->forget(g_job.names[ii]);
+            }
+        }
+    }
+    g_job.next = end;
+    if (g_job.next < g_job.names.size()) {
+        sendNextSubscriptions(client);
+        return;
+    }
+    printf("%s %lu addresses in %ld requests\n",
+           g_job.update ? "Subscribed to" : "Unsubscribed from",
+           (unsigned long)g_job.names.size(), g_job.requests);
+    g_job.active = false;
+    g_job.names.clear();
+}
 
-    __wsdl__SubscribeResponse subscribeResponse;
+//
+// Expands an IPv4 address, or a range such as 10.1.0.0/16, into its
+// addresses. Ranges larger than s_maxRange addresses are refused.
+//
+static bool expandAddresses(const char* target, std::vector<std::string>& addresses)
+{
+    std::string address = target;
+    int prefix = 32;
+    size_t slash = address.find('/');
+    if (slash != std::string::npos) {
+        char* end;
+        prefix = strtol(address.c_str() + slash + 1, &end, 10);
+        if (*end || end == address.c_str() + slash + 1 || prefix < 0 || prefix > 32) {
+            fprintf(stderr, "%s: bad prefix length\n", target);
+            return false;
+        }
+        address.erase(slash);
+    }
+    in_addr addr;
+    if (inet_pton(AF_INET, address.c_str(), &addr) != 1) {
+        fprintf(stderr, "%s: not an IPv4 address\n", target);
+        return false;
+    }
+    unsigned long count = 1UL << (32 - prefix);
+    if (count > s_maxRange) {
+        fprintf(stderr, "%s: more than %lu addresses\n", target, s_maxRange);
+        return false;
+    }
+    unsigned long first = ntohl(addr.s_addr) & ~(count - 1);
+    addresses.reserve(addresses.size() + count);
+    for (unsigned long ii = 0; ii < count; ii++) {
+        unsigned long ip = first + ii;
+        char buf[INET_ADDRSTRLEN];
+        snprintf(buf, sizeof buf, "%lu.%lu.%lu.%lu",
+                 (ip >> 24) & 0xff, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+        addresses.push_back(buf);
+    }
+    return true;
+}
 
-    int code = service.__wsdl__Subscribe(&subscribeRequest, subscribeResponse);
-    if (code) {
-        soap_print_fault(service.soap, stderr);
-        exit(1);
+//
+// Subscribes to an address or range, skipping addresses already
+// subscribed to without asking the server.
+//
+static void subscribe(IfmapClient& client, char* target)
+{
+    std::vector<std::string> addresses;
+    if (!expandAddresses(target, addresses)) {
+        return;
+    }
+    std::vector<std::string> names;
+    for (size_t ii = 0; ii < addresses.size(); ii++) {
+        if (!g_subscriptions.count(addresses[ii])) {
+            names.push_back(addresses[ii]);
+        }
+    }
+    if (names.size() < addresses.size()) {
+        printf("Already subscribed to %lu addresses\n",
+               (unsigned long)(addresses.size() - names.size()));
+    }
+    if (!names.empty()) {
+        startSubscriptions(client, names, true);
     }
 }
 
-static void unsubscribe(Service& service, char* ipStr)
+static void unsubscribe(IfmapClient& client, char* target)
 {
-    ifmap__DeleteSearchRequestType deleteSearchRequest;
-    deleteSearchRequest.name = ipStr;
+    std::vector<std::string> addresses;
+    if (!expandAddresses(target, addresses)) {
+        return;
+    }
+    std::vector<std::string> names;
+    for (size_t ii = 0; ii < addresses.size(); ii++) {
+        if (g_subscriptions.count(addresses[ii])) {
+            names.push_back(addresses[ii]);
+        }
+    }
+    if (names.empty()) {
+        printf("Not subscribed to %s\n", target);
+        return;
+    }
+    startSubscriptions(client, names, false);
+}
 
-    ifmap__SubscribeRequestType subscribeRequest;
-    subscribeRequest.__size_SubscribeRequestType = 1;
+static void unsubscribeAll(IfmapClient& client)
+{
+    std::vector<std::string> names(g_subscriptions.begin(), g_subscriptions.end());
+    if (names.empty()) {
+        printf("No subscriptions\n");
+        return;
+    }
+    startSubscriptions(client, names, false);
+}
+
+static void printNode(const MapGraph::Node& node)
+{
+    printf("%s %s", MapGraph::typeName(node.type), node.value.c_str());
+    if (!node.qualifier.empty()) {
+        printf(" (%s)", node.qualifier.c_str());
+    }
+    if (!node.domain.empty()) {
+        printf(" [%s]", node.domain.c_str());
+    }
+}
 
-    __ifmap__union_SubscribeRequestType req;
-    req.__union_SubscribeRequestType = SOAP_UNION__ifmap__union_SubscribeRequestType_delete_;
-    req.union_SubscribeRequestType.delete_ = &deleteSearchRequest;
+static void printMetadata(const std::vector<std::string>& metadata)
+{
+    for (size_t ii = 0; ii < metadata.size(); ii++) {
+        printf("%s%s", ii ? ", " : ": ", metadata[ii].c_str());
+    }
+    printf("\n");
+}
 
-    subscribeRequest.__union_SubscribeRequestType = &req;
-    
-    __wsdl__SubscribeResponse subscribeResponse;
+//
+// Lists the users on an IP address, from the graph.
+//
+static void showUsers(char* ip)
+{
+    std::vector<MapGraph::NodeId> identities;
+    g_graph->identitiesOnIp(ip, identities);
+    if (identities.empty()) {
+        printf("No users on %s\n", ip);
+    }
+    for (size_t ii = 0; ii < identities.size(); ii++) {
+        printNode(g_graph->node(identities[ii]));
+        printf("\n");
+    }
+}
+
+//
+// Shows an identifier's metadata and links, from the graph. args is
+// "type value [ qualifier ]", the qualifier defaulting to username for
+// identities and name for devices.
+//
+static void showLinks(char* args)
+{
+    char* value = strchr(args, ' ');
+    MapGraph::Type type;
+    if (!value || !MapGraph::parseType(args, type)) {
+        fprintf(stderr, "usage: links type value [ qualifier ]\n");
+        return;
+    }
+    *value++ = '\0';
+    const char* qualifier = "";
+    char* given = strchr(value, ' ');
+    if (given) {
+        *given++ = '\0';
+        qualifier = given;
+    } else if (type == MapGraph::IDENTITY) {
+        qualifier = "username";
+    } else if (type == MapGraph::DEVICE) {
+        qualifier = "name";
+    }
+
+    MapGraph::NodeId id = g_graph->find(type, value, qualifier);
+    if (id == MapGraph::NONE) {
+        printf("%s %s is not in any subscription\n", args, value);
+        return;
+    }
+    const MapGraph::Node& node = g_graph->node(id);
+    printNode(node);
+    printMetadata(node.metadata);
+    for (size_t ii = 0; ii < node.edges.size(); ii++) {
+        printf("  -> ");
+        printNode(g_graph->node(g_graph->other(node.edges[ii], id)));
+        printMetadata(g_graph->edge(node.edges[ii]).metadata);
+    }
+}
+
+static void runCommand(IfmapClient& client, char* cmd)
+{
+    if (g_graph && strcmp(cmd, "graph") == 0) {
+        printf("%lu identifiers, %lu links\n",
+               (unsigned long)g_graph->nodeCount(), (unsigned long)g_graph->edgeCount());
+        return;
+    }
+    if (strcmp(cmd, "unsubscribe-all") == 0) {
+        unsubscribeAll(client);
+        return;
+    }
+    char* ip = strchr(cmd, ' ');
+    if (!ip) {
+        fprintf(stderr, "Parse error!\n");
+        return;
+    }
+    *ip++ = '\0';
+    if (strcmp(cmd, "subscribe") == 0) {
+        subscribe(client, ip);
+    } else if (strcmp(cmd, "unsubscribe") == 0) {
+        unsubscribe(client, ip);
+    } else if (g_graph && strcmp(cmd, "users") == 0) {
+        showUsers(ip);
+    } else if (g_graph && strcmp(cmd, "links") == 0) {
+        showLinks(ip);
+    } else {
+        fprintf(stderr, "\"%s\" is not a valid command. Valid comands are \"subscribe\", \"unsubscribe\"%s \"unsubscribe-all\"%s.",
+                cmd, g_graph ? "," : " and",
+                g_graph ? ", \"users\", \"links\" and \"graph\"" : "");
+    }
+}
+
+static void prompt()
+{
+    printf("-> ");
+    fflush(stdout);
+}
+
+//
+// Carries out the current and waiting commands without returning to
+// the event loop, as when there is no more input.
+//
+static void finishCommands(IfmapClient& client)
+{
+    while (true) {
+        while (g_job.active) {
+            recvSubscriptions(client);
+        }
+        if (g_waitingCommands.empty()) {
+            return;
+        }
+        std::string line = g_waitingCommands.front();
+        g_waitingCommands.pop_front();
+        runCommand(client, &line[0]);
+    }
+}
 
-    int code = service.__wsdl__Subscribe(&subscribeRequest, subscribeResponse);
-    if (code) {
-        soap_print_fault(service.soap, stderr);
+static void watchCommands(int epollFd, IfmapClient& client)
+{
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = &g_job;
+    int fd = client.soap()->socket;
+    // As for the poll connection, the socket may be new
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == -1
+        && (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1)) {
+        perror("epoll_ctl");
         exit(1);
     }
 }
 
+//
+// Runs waiting commands until one sends subscribe requests, whose
+// responses the event loop then waits for.
+//
+static void runWaitingCommands(int epollFd, IfmapClient& client)
+{
+    while (!g_job.active && !g_waitingCommands.empty()) {
+        std::string line = g_waitingCommands.front();
+        g_waitingCommands.pop_front();
+        runCommand(client, &line[0]);
+        if (g_job.active) {
+            watchCommands(epollFd, client);
+        } else {
+            prompt();
+        }
+    }
+}
+
+//
+// Runs the commands in file, one per line, before reading any from
+// standard input.
+//
+static bool runCommandFile(IfmapClient& client, const char* file)
+{
+    FILE* in = fopen(file, "r");
+    if (!in) {
+        perror(file);
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof line, in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] && line[0] != '#') {
+            runCommand(client, line);
+            finishCommands(client);
+        }
+    }
+    fclose(in);
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: poll [ --stream [ --graph ] ] [ --batch n ] [ --file commands ]\n"
+                    "            url [ user password ]\n\n");
+    fprintf(stderr, "            --batch packs up to n (default 1000) subscriptions into\n"
+                    "            each subscribe request. --file runs the commands in\n"
+                    "            the file, one per line, before reading standard input.\n");
+    exit(1);
+}
+
 int main(int argc, char* argv[])
 {
+    const char* commandFile = 0;
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--stream") == 0) {
+            g_stream = true;
+        } else if (strcmp(argv[1], "--graph") == 0) {
+            g_graph = new MapGraph;
+        } else if (strcmp(argv[1], "--batch") == 0 && argc > 2) {
+            g_batchSize = atol(argv[2]);
+            argc--;
+            argv++;
+        } else if (strcmp(argv[1], "--file") == 0 && argc > 2) {
+            commandFile = argv[2];
+            argc--;
+            argv++;
+        } else {
+            usage();
+        }
+        argc--;
+        argv++;
+    }
+    // The graph is fed by the stream parser.
+    if ((g_graph && !g_stream) || g_batchSize < 1) {
+        usage();
+    }
     if (argc != 2 && argc != 4) {
-        fprintf(stderr, "usage: poll url [ user password ]\n");
-        return 1;
+        usage();
     }
 
     char* url = argv[1];
+    char* user = 0;
+    char* password = 0;
     if (argc == 4) {
-        g_user = argv[2];
-        g_password = argv[3];
+        user = argv[2];
+        password = argv[3];
     }
 
-    Service service;
-    service.endpoint = url;
-    if (g_user && g_password) {
-        service.soap->userid = g_user;
-        service.soap->passwd = g_password;
-    }
-    service.soap->imode |= SOAP_IO_KEEPALIVE;
-    service.soap->omode |= SOAP_IO_KEEPALIVE;
-    int code = ifmapConnect(service);
+    IfmapClient client(url, user, password);
+    int code = client.newSession();
     if (code != SOAP_OK) {
-        soap_print_fault(service.soap, stderr);
+        client.printFault(stderr);
         return 1;
     }
-    service.soap->header->ifmap__publisher_id = 0;
     
-    printf("got session id: %s\n", service.soap->header->ifmap__session_id);
+    printf("got session id: %s\n", client.sessionId());
 
-    g_pollPid = fork();
-    if (g_pollPid == -1) {
-        perror("fork");
-        exit(1);
+    Poller poller;
+    if (!attachPoller(client, poller)) {
+        return 1;
     }
-    if (g_pollPid == 0) {
-        runPollProc(url, service.soap->header->ifmap__session_id);
-        return 0;
-    } else {
-        signal(SIGCHLD, onSigChld);
-        atexit(onExit);
-        printf("Enter commands, 1 per line:\n");
-        printf("subscribe ip: adds IP address \"ip\" to identifiers being polled\n");
-        printf("unsubscribe ip: removes IP address \"ip\" from identifiers being polled\n");
-
-        while (true) {
-            printf("-> ");
-            fflush(stdout);
-
-            char buf[100];
-            if (!fgets(buf, sizeof buf, stdin)) {
-                break;
-            }
-            char* cmd = buf;
-            char* ip = strchr(buf, ' ');
-            if (!ip) {
-                fprintf(stderr, "Parse error!\n");
+
+    int epollFd = epoll_create(2);
+    if (epollFd == -1) {
+        perror("epoll_create");
+        return 1;
+    }
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = 0;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == -1) {
+        perror("epoll_ctl");
+        return 1;
+    }
+    if (commandFile && !runCommandFile(client, commandFile)) {
+        return 1;
+    }
+    sendPoll(epollFd, poller);
+
+    printf("Enter commands, 1 per line:\n");
+    printf("subscribe ip: adds IP address \"ip\" to identifiers being polled\n");
+    printf("unsubscribe ip: removes IP address \"ip\" from identifiers being polled\n");
+    printf("    ip may be a range such as 10.1.0.0/16 for either\n");
+    printf("unsubscribe-all: removes every IP address being polled\n");
+    if (g_graph) {
+        printf("users ip: lists the users on IP address \"ip\"\n");
+        printf("links type value [ qualifier ]: shows an identifier's metadata and links\n");
+        printf("graph: counts the identifiers and links held\n");
+    }
+    prompt();
+
+    std::string input;
+    while (true) {
+        epoll_event events[2];
+        int n = epoll_wait(epollFd, events, 2, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
                 continue;
             }
-            *ip++ = '\0';
-            char* nl = strchr(ip, '\n');
-            if (nl) {
-                *nl = '\0';
+            perror("epoll_wait");
+            return 1;
+        }
+        for (int ii = 0; ii < n; ii++) {
+            if (events[ii].data.ptr == &poller) {
+                if (recvPoll(poller)) {
+                    sendPoll(epollFd, poller);
+                } else {
+                    watchPoller(epollFd, poller);
+                }
+                continue;
             }
-            if (strcmp(cmd, "subscribe") == 0) {
-                subscribe(service, ip);
-            } else if (strcmp(cmd, "unsubscribe") == 0) {
-                unsubscribe(service, ip);
-            } else {
-                fprintf(stderr, "\"%s\" is not a valid command. Valid comands are \"subscribe\" and \"unsubscribe\".", cmd);
+            if (events[ii].data.ptr == &g_job) {
+                recvSubscriptions(client);
+                if (g_job.active) {
+                    watchCommands(epollFd, client);
+                } else {
+                    prompt();
+                    runWaitingCommands(epollFd, client);
+                }
                 continue;
             }
+            char buf[1024];
+            ssize_t count = read(STDIN_FILENO, buf, sizeof buf);
+            if (count <= 0) {
+                finishCommands(client);
+                return 0;
+            }
+            input.append(buf, count);
+            size_t nl;
+            while ((nl = input.find('\n')) != std::string::npos) {
+                g_waitingCommands.push_back(input.substr(0, nl));
+                input.erase(0, nl + 1);
+            }
+            runWaitingCommands(epollFd, client);
         }
     }
     return 0;
 }
-
-#include <dom.cpp>
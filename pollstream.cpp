@@ -0,0 +1,390 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pollstream.h"
+
+XmlNode::~XmlNode()
+{
+    size_t ii;
+    for (ii = 0; ii < children.size(); ii++) {
+        delete children[ii];
+    }
+}
+
+const char* XmlNode::attribute(const char* name) const
+{
+    size_t ii;
+    for (ii = 0; ii < attributes.size(); ii++) {
+        if (attributes[ii].first == name) {
+            return attributes[ii].second.c_str();
+        }
+    }
+    return 0;
+}
+
+const XmlNode* XmlNode::child(const char* name) const
+{
+    size_t ii;
+    for (ii = 0; ii < children.size(); ii++) {
+        if (children[ii]->name == name) {
+            return children[ii];
+        }
+    }
+    return 0;
+}
+
+static bool startsWith(const std::string& s, const char* prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+    size_t length = strlen(suffix);
+    return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+}
+
+static std::string localName(const std::string& name)
+{
+    size_t colon = name.find(':');
+    return colon == std::string::npos ? name : name.substr(colon + 1);
+}
+
+static void appendUtf8(unsigned long c, std::string& out)
+{
+    if (c < 0x80) {
+        out += (char)c;
+    } else if (c < 0x800) {
+        out += (char)(0xc0 | (c >> 6));
+        out += (char)(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        out += (char)(0xe0 | (c >> 12));
+        out += (char)(0x80 | ((c >> 6) & 0x3f));
+        out += (char)(0x80 | (c & 0x3f));
+    } else {
+        out += (char)(0xf0 | (c >> 18));
+        out += (char)(0x80 | ((c >> 12) & 0x3f));
+        out += (char)(0x80 | ((c >> 6) & 0x3f));
+        out += (char)(0x80 | (c & 0x3f));
+    }
+}
+
+//
+// Appends raw to out with entity and character references replaced.
+// Unknown references are copied unchanged.
+//
+static void decode(const char* raw, size_t length, std::string& out)
+{
+    size_t ii = 0;
+    while (ii < length) {
+        if (raw[ii] != '&') {
+            out += raw[ii++];
+            continue;
+        }
+        const char* end = (const char*)memchr(raw + ii, ';', length - ii);
+        if (!end) {
+            out.append(raw + ii, length - ii);
+            return;
+        }
+        std::string ref(raw + ii + 1, end - raw - ii - 1);
+        if (ref == "lt") {
+            out += '<';
+        } else if (ref == "gt") {
+            out += '>';
+        } else if (ref == "amp") {
+            out += '&';
+        } else if (ref == "quot") {
+            out += '"';
+        } else if (ref == "apos") {
+            out += '\'';
+        } else if (startsWith(ref, "#x")) {
+            appendUtf8(strtoul(ref.c_str() + 2, 0, 16), out);
+        } else if (startsWith(ref, "#")) {
+            appendUtf8(strtoul(ref.c_str() + 1, 0, 10), out);
+        } else {
+            out.append(raw + ii, end - raw - ii + 1);
+        }
+        ii = end - raw + 1;
+    }
+}
+
+PollStreamParser::PollStreamParser(PollResultHandler& handler)
+    : m_handler(handler), m_capture(0), m_largestResult(0)
+{
+    reset();
+}
+
+PollStreamParser::~PollStreamParser()
+{
+    delete m_capture;
+}
+
+void PollStreamParser::reset()
+{
+    m_state = TEXT;
+    m_token.clear();
+    m_quote = 0;
+    m_path.clear();
+    m_searchName.clear();
+    delete m_capture;
+    m_capture = 0;
+    m_captureStack.clear();
+    m_captureBytes = 0;
+    m_done = false;
+    m_error.clear();
+}
+
+void PollStreamParser::fail(const char* message)
+{
+    if (m_error.empty()) {
+        m_error = message;
+    }
+    m_done = true;
+}
+
+size_t PollStreamParser::feed(const char* data, size_t length)
+{
+    size_t ii;
+    for (ii = 0; ii < length && !m_done; ii++) {
+        char c = data[ii];
+        if (m_state == TEXT) {
+            if (c == '<') {
+                if (!m_token.empty()) {
+                    characters(m_token);
+                    m_token.clear();
+                }
+                m_state = MARKUP;
+            } else if (m_capture) {
+                // Text outside results is never used, so is not kept.
+                m_token += c;
+            }
+        } else {
+            m_token += c;
+            if (markupComplete(c)) {
+                m_token.erase(m_token.size() - 1);
+                markup();
+                m_token.clear();
+                m_state = TEXT;
+            }
+        }
+    }
+    return ii;
+}
+
+//
+// Called with each character of markup after the '<', already
+// appended to m_token. Returns true if c is the closing '>'.
+//
+bool PollStreamParser::markupComplete(char c)
+{
+    // Checked first, as this runs for every character of every tag.
+    if (m_token[0] == '!') {
+        if (startsWith(m_token, "!--")) {
+            return m_token.size() >= 6 && endsWith(m_token, "-->");
+        }
+        if (startsWith(m_token, "![CDATA[")) {
+            return endsWith(m_token, "]]>");
+        }
+    }
+    if (m_quote) {
+        if (c == m_quote) {
+            m_quote = 0;
+        }
+        return false;
+    }
+    if (c == '"' || c == '\'') {
+        m_quote = c;
+        return false;
+    }
+    return c == '>';
+}
+
+//
+// Handles the markup in m_token, without its enclosing '<' and '>'.
+//
+void PollStreamParser::markup()
+{
+    if (m_token.empty()) {
+        fail("empty tag");
+    } else if (startsWith(m_token, "![CDATA[")) {
+        if (m_capture && !m_captureStack.empty()) {
+            m_captureStack.back()->text.append(m_token, 8, m_token.size() - 10);
+            m_captureBytes += m_token.size();
+        }
+    } else if (m_token[0] == '?' || m_token[0] == '!') {
+        // Processing instruction, comment or DOCTYPE.
+    } else if (m_token[0] == '/') {
+        size_t end = m_token.find_first_of(" \t\r\n", 1);
+        endElement(localName(m_token.substr(1, end == std::string::npos ? end : end - 1)));
+    } else {
+        bool empty = m_token[m_token.size() - 1] == '/';
+        if (empty) {
+            m_token.erase(m_token.size() - 1);
+        }
+        startElement(empty);
+    }
+}
+
+void PollStreamParser::startElement(bool empty)
+{
+    const char* space = " \t\r\n";
+    size_t end = m_token.find_first_of(space);
+    XmlNode* node = new XmlNode;
+    node->name = localName(m_token.substr(0, end));
+
+    size_t pos = end;
+    while (pos != std::string::npos) {
+        pos = m_token.find_first_not_of(space, pos);
+        if (pos == std::string::npos) {
+            break;
+        }
+        size_t eq = m_token.find('=', pos);
+        size_t quote = eq == std::string::npos ? eq : m_token.find_first_of("\"'", eq);
+        size_t close = quote == std::string::npos ? quote : m_token.find(m_token[quote], quote + 1);
+        if (close == std::string::npos) {
+            delete node;
+            fail("malformed attribute");
+            return;
+        }
+        size_t nameEnd = m_token.find_last_not_of(space, eq - 1) + 1;
+        std::string name = m_token.substr(pos, nameEnd - pos);
+        if (name != "xmlns" && !startsWith(name, "xmlns:")) {
+            std::string value;
+            decode(m_token.data() + quote + 1, close - quote - 1, value);
+            node->attributes.push_back(std::make_pair(localName(name), value));
+        }
+        pos = close + 1;
+    }
+
+    if (m_capture) {
+        m_captureStack.back()->children.push_back(node);
+        m_captureBytes += m_token.size();
+        if (!empty) {
+            m_captureStack.push_back(node);
+            m_path.push_back(node->name);
+        }
+        return;
+    }
+
+    std::string parent = m_path.empty() ? "" : m_path.back();
+    if (node->name == "Fault" && parent == "Body") {
+        startCapture(node, empty);
+    } else if (node->name == "errorResult") {
+        startCapture(node, empty);
+    } else if ((node->name == "identifierResult" || node->name == "linkResult")
+               && parent == "searchResult") {
+        startCapture(node, empty);
+    } else {
+        if (node->name == "searchResult") {
+            const char* name = node->attribute("name");
+            m_searchName = name ? name : "";
+            m_handler.searchResultBegin(m_searchName.c_str());
+            if (empty) {
+                m_handler.searchResultEnd(m_searchName.c_str());
+            }
+        }
+        if (!empty) {
+            m_path.push_back(node->name);
+        }
+        delete node;
+    }
+}
+
+void PollStreamParser::startCapture(XmlNode* node, bool empty)
+{
+    m_capture = node;
+    m_captureBytes = m_token.size();
+    if (empty) {
+        closeCapture();
+    } else {
+        m_captureStack.push_back(node);
+        m_path.push_back(node->name);
+    }
+}
+
+void PollStreamParser::endElement(const std::string& name)
+{
+    if (m_path.empty() || m_path.back() != name) {
+        fail("mismatched end tag");
+        return;
+    }
+    m_path.pop_back();
+    if (m_capture) {
+        m_captureStack.pop_back();
+        if (m_captureStack.empty()) {
+            closeCapture();
+        }
+    } else if (name == "searchResult") {
+        m_handler.searchResultEnd(m_searchName.c_str());
+    }
+    if (m_path.empty()) {
+        m_done = true;
+    }
+}
+
+void PollStreamParser::characters(const std::string& text)
+{
+    if (m_capture && !m_captureStack.empty()) {
+        decode(text.data(), text.size(), m_captureStack.back()->text);
+        m_captureBytes += text.size();
+    }
+}
+
+void PollStreamParser::closeCapture()
+{
+    XmlNode* node = m_capture;
+    if (m_captureBytes > m_largestResult) {
+        m_largestResult = m_captureBytes;
+    }
+    if (node->name == "identifierResult") {
+        m_handler.identifierResult(m_searchName.c_str(), *node);
+    } else if (node->name == "linkResult") {
+        m_handler.linkResult(m_searchName.c_str(), *node);
+    } else if (node->name == "errorResult") {
+        const char* code = node->attribute("errorCode");
+        const XmlNode* errorString = node->child("errorString");
+        m_handler.errorResult(code ? code : "", errorString ? errorString->text.c_str() : "");
+    } else {
+        // SOAP 1.1 puts the reason in faultstring, SOAP 1.2 in Reason/Text.
+        const XmlNode* reason = node->child("faultstring");
+        if (!reason && node->child("Reason")) {
+            reason = node->child("Reason")->child("Text");
+        }
+        std::string message = "SOAP fault: ";
+        message += reason ? reason->text : "no reason given";
+        fail(message.c_str());
+    }
+    delete node;
+    m_capture = 0;
+}
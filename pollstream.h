@@ -0,0 +1,157 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_pollstream_h__
+#define ifmap_pollstream_h__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+ * Element of a poll result as parsed by PollStreamParser. Namespace
+ * prefixes are dropped from element and attribute names, and entity
+ * and character references are replaced in values and text.
+ */
+class XmlNode
+{
+public:
+    XmlNode() {}
+    ~XmlNode();
+
+    /*
+     * Returns the value of attribute name, or 0.
+     */
+    const char* attribute(const char* name) const;
+
+    /*
+     * Returns the first child element called name, or 0.
+     */
+    const XmlNode* child(const char* name) const;
+
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > attributes;
+    std::string text;
+    std::vector<XmlNode*> children;
+
+private:
+    XmlNode(const XmlNode&);
+    XmlNode& operator=(const XmlNode&);
+};
+
+/*
+ * Receives the parts of a poll response as soon as each is complete.
+ * Nodes passed to a callback are freed when it returns.
+ */
+class PollResultHandler
+{
+public:
+    virtual ~PollResultHandler() {}
+
+    virtual void searchResultBegin(const char* name) {}
+    virtual void identifierResult(const char* searchName, const XmlNode& result) {}
+    virtual void linkResult(const char* searchName, const XmlNode& result) {}
+    virtual void searchResultEnd(const char* name) {}
+    virtual void errorResult(const char* errorCode, const char* errorString) {}
+};
+
+/*
+ * Incremental parser for the SOAP envelope of a poll response. Only
+ * the identifierResult, linkResult or errorResult being parsed is
+ * kept in memory, so memory use is bounded by the largest single
+ * result rather than the whole response.
+ *
+ * This is not a validating parser. It relies on the server sending
+ * well formed XML, and skips DOCTYPE declarations without reading
+ * them.
+ */
+class PollStreamParser
+{
+public:
+    PollStreamParser(PollResultHandler& handler);
+    ~PollStreamParser();
+
+    /*
+     * Prepares for a new response.
+     */
+    void reset();
+
+    /*
+     * Parses the next length bytes of the response. Returns how many
+     * were used, which is less than length only once done() is true.
+     */
+    size_t feed(const char* data, size_t length);
+
+    /*
+     * True once the envelope has been closed or parsing failed.
+     */
+    bool done() const { return m_done; }
+
+    /*
+     * If the XML was malformed or the response was a SOAP fault,
+     * returns a description, otherwise 0.
+     */
+    const char* error() const { return m_error.empty() ? 0 : m_error.c_str(); }
+
+    /*
+     * Bytes of markup and text in the largest result parsed since the
+     * parser was created.
+     */
+    size_t largestResult() const { return m_largestResult; }
+
+private:
+    enum State { TEXT, MARKUP };
+
+    bool markupComplete(char c);
+
+    void fail(const char* message);
+    void markup();
+    void startElement(bool empty);
+    void endElement(const std::string& name);
+    void characters(const std::string& text);
+    void startCapture(XmlNode* node, bool empty);
+    void closeCapture();
+
+    PollResultHandler& m_handler;
+    State m_state;
+    std::string m_token;
+    char m_quote;
+    std::vector<std::string> m_path;
+    std::string m_searchName;
+    XmlNode* m_capture;
+    std::vector<XmlNode*> m_captureStack;
+    size_t m_captureBytes;
+    size_t m_largestResult;
+    bool m_done;
+    std::string m_error;
+};
+
+#endif /*ifmap_pollstream_h__*/
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "publishbatch.h"
+
+//
+// Whether an errorResult could have been caused by one item of the
+// request. Faults without an errorResult, such as an invalid session,
+// and errors like AccessDenied apply to every request alike, so
+// bisecting them would only repeat them.
+//
+static bool itemError(int errorCode)
+{
+    switch (errorCode) {
+    case _ifmap__ErrorResultType_errorCode__Failure:
+    case _ifmap__ErrorResultType_errorCode__InvalidIdentifier:
+    case _ifmap__ErrorResultType_errorCode__InvalidIdentifierType:
+    case _ifmap__ErrorResultType_errorCode__IdentifierTooLong:
+    case _ifmap__ErrorResultType_errorCode__InvalidMetadata:
+    case _ifmap__ErrorResultType_errorCode__MetadataTooLong:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static long publishRange(IfmapClient& client, __ifmap__union_PublishRequestType* publishes,
+                         long first, long count, RejectionHandler& handler)
+{
+    ifmap__PublishRequestType publishRequest;
+    publishRequest.__size_PublishRequestType = count;
+    publishRequest.__union_PublishRequestType = publishes + first;
+
+    int code = client.publish(&publishRequest);
+    if (code == SOAP_OK) {
+        client.reset();
+        return 0;
+    }
+    if (code != SOAP_FAULT || !itemError(client.errorCode())) {
+        return -1;
+    }
+    if (count == 1) {
+        handler.rejected(first, client);
+        client.reset();
+        return 1;
+    }
+    client.reset();
+    long half = count / 2;
+    long rejected = publishRange(client, publishes, first, half, handler);
+    if (rejected == -1) {
+        return -1;
+    }
+    long rest = publishRange(client, publishes, first + half, count - half, handler);
+    return rest == -1 ? -1 : rejected + rest;
+}
+
+long publishBatch(IfmapClient& client, __ifmap__union_PublishRequestType* publishes,
+                  long count, RejectionHandler& handler)
+{
+    return count ? publishRange(client, publishes, 0, count, handler) : 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_publishbatch_h__
+#define ifmap_publishbatch_h__
+
+#include "client.h"
+
+/*
+ * Told about each item of a batch that the server rejects.
+ */
+class RejectionHandler
+{
+public:
+    virtual ~RejectionHandler() {}
+
+    /*
+     * Called for publishes[index], with the server's fault in client.
+     */
+    virtual void rejected(long index, IfmapClient& client) = 0;
+};
+
+/*
+ * Publishes publishes[0] through publishes[count - 1] in one request.
+ *
+ * The server applies a publish request entirely or not at all, so
+ * when it rejects one the halves are published separately until the
+ * rejected items are found, and handler.rejected() is called for
+ * each of them.
+ *
+ * Returns the number of items rejected, or -1 if a request failed for
+ * any other reason, such as a lost connection, an invalid session or
+ * AccessDenied, with the error in client. Items published before such
+ * an error stay published.
+ *
+ * client is reset() after each request. Everything publishes refers
+ * to must live outside its soap context.
+ */
+extern long publishBatch(IfmapClient& client, __ifmap__union_PublishRequestType* publishes,
+                         long count, RejectionHandler& handler);
+
+#endif /*ifmap_publishbatch_h__*/
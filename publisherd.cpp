@@ -0,0 +1,104 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "publisherd.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+bool sendToPublisherd(const char* socketPath, const std::string& command, std::string& error)
+{
+    error = std::string("ifmap-publisherd at ") + socketPath + ": ";
+    sockaddr_un addr;
+    if (strlen(socketPath) >= sizeof addr.sun_path) {
+        error += "socket path too long";
+        return false;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (sockaddr*)&addr, sizeof addr) == -1) {
+        error += strerror(errno);
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+
+    std::string line = command + "\n";
+    size_t sent = 0;
+    while (sent < line.size()) {
+        ssize_t count = write(fd, line.data() + sent, line.size() - sent);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            error += strerror(errno);
+            close(fd);
+            return false;
+        }
+        sent += count;
+    }
+
+    std::string reply;
+    while (reply.find('\n') == std::string::npos) {
+        char buf[512];
+        ssize_t count = read(fd, buf, sizeof buf);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            error += count == 0 ? "connection closed" : strerror(errno);
+            close(fd);
+            return false;
+        }
+        reply.append(buf, count);
+    }
+    close(fd);
+
+    reply.erase(reply.find('\n'));
+    size_t status = reply.find(' ');
+    if (status != std::string::npos && reply.compare(status + 1, std::string::npos, "ok") == 0) {
+        error.clear();
+        return true;
+    }
+    const char* prefix = " error ";
+    if (status != std::string::npos && reply.compare(status, strlen(prefix), prefix) == 0) {
+        error += reply.substr(status + strlen(prefix));
+    } else {
+        error += "unexpected reply \"" + reply + "\"";
+    }
+    return false;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_publisherd_h__
+#define ifmap_publisherd_h__
+
+#include <string>
+
+/*
+ * Environment variable naming the socket of a running
+ * ifmap-publisherd. When it is set, ip-mac and event hand their
+ * publish to the daemon instead of connecting to the server.
+ */
+#define IFMAP_PUBLISHERD_SOCKET "IFMAP_PUBLISHERD_SOCKET"
+
+/*
+ * Commands are single lines, "ip-mac " followed by a line in ip-mac
+ * --stream format, or "event " followed by a line in event --stream
+ * format (see eventspec.h). The daemon answers each with
+ * "<n> ok" or "<n> error <description>", n counting the commands on
+ * the connection from 1, once the command has been published.
+ */
+
+/*
+ * Sends command to the ifmap-publisherd listening at socketPath and
+ * waits for it to be published. Returns false with the reason in
+ * error if it could not be.
+ */
+extern bool sendToPublisherd(const char* socketPath, const std::string& command,
+                             std::string& error);
+
+#endif /*ifmap_publisherd_h__*/
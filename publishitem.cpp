@@ -0,0 +1,98 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "publishitem.h"
+
+ifmap__PublishType*
+createIdentifierUpdate(struct soap* soap, ifmap__IdentifierType* identifier,
+                       ifmap__MetadataListType* metadata)
+{
+    ifmap__PublishType* update = soap_new_ifmap__PublishType(soap, -1);
+    update->__union_PublishType = SOAP_UNION__ifmap__union_PublishType_identifier;
+    update->union_PublishType.identifier = identifier;
+    update->metadata = metadata;
+    return update;
+}
+
+ifmap__LinkType*
+createLink(struct soap* soap, ifmap__IdentifierType* identifier0,
+           ifmap__IdentifierType* identifier1)
+{
+    ifmap__LinkType* link = soap_new_ifmap__LinkType(soap, -1);
+    link->__sizeidentifier = 2;
+    link->identifier = (ifmap__IdentifierType**)soap_malloc(soap, sizeof(ifmap__IdentifierType*) * 2);
+    link->identifier[0] = identifier0;
+    link->identifier[1] = identifier1;
+    return link;
+}
+
+ifmap__PublishType*
+createLinkUpdate(struct soap* soap, ifmap__IdentifierType* identifier0,
+                 ifmap__IdentifierType* identifier1,
+                 ifmap__MetadataListType* metadata)
+{
+    ifmap__LinkType* link = createLink(soap, identifier0, identifier1);
+    ifmap__PublishType* update = soap_new_ifmap__PublishType(soap, -1);
+    update->__union_PublishType = SOAP_UNION__ifmap__union_PublishType_link;
+    update->union_PublishType.link = link;
+    update->metadata = metadata;
+    return update;
+}
+
+ifmap__DeleteType*
+createLinkDelete(struct soap* soap, ifmap__IdentifierType* identifier0,
+                 ifmap__IdentifierType* identifier1, const char* filter)
+{
+    ifmap__LinkType* link = createLink(soap, identifier0, identifier1);
+    ifmap__DeleteType* delete_ = soap_new_ifmap__DeleteType(soap, -1);
+    delete_->__union_DeleteType = SOAP_UNION__ifmap__union_DeleteType_link;
+    delete_->union_DeleteType.link = link;
+    delete_->filter = soap_strdup(soap, filter);
+    return delete_;
+}
+
+void addUpdate(std::vector<__ifmap__union_PublishRequestType>& updates,
+               ifmap__PublishType* update)
+{
+    __ifmap__union_PublishRequestType choice;
+    choice.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_update;
+    choice.union_PublishRequestType.update = update;
+    updates.push_back(choice);
+}
+
+void addDelete(std::vector<__ifmap__union_PublishRequestType>& updates,
+               ifmap__DeleteType* delete_)
+{
+    __ifmap__union_PublishRequestType choice;
+    choice.__union_PublishRequestType = SOAP_UNION__ifmap__union_PublishRequestType_delete_;
+    choice.union_PublishRequestType.delete_ = delete_;
+    updates.push_back(choice);
+}
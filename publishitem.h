@@ -0,0 +1,73 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_publishitem_h__
+#define ifmap_publishitem_h__
+
+#include <vector>
+#include "ifmapH.h"
+
+/*
+ * Builders for the items of a publish request. Each allocates its
+ * result in soap, but the identifiers and metadata passed in are only
+ * referenced, so they may be shared or live elsewhere, such as in an
+ * IdentifierSlab or MetadataCache.
+ */
+
+extern ifmap__PublishType*
+createIdentifierUpdate(struct soap* soap, ifmap__IdentifierType* identifier,
+                       ifmap__MetadataListType* metadata);
+
+extern ifmap__LinkType*
+createLink(struct soap* soap, ifmap__IdentifierType* identifier0,
+           ifmap__IdentifierType* identifier1);
+
+extern ifmap__PublishType*
+createLinkUpdate(struct soap* soap, ifmap__IdentifierType* identifier0,
+                 ifmap__IdentifierType* identifier1,
+                 ifmap__MetadataListType* metadata);
+
+/*
+ * The filter is copied into soap.
+ */
+extern ifmap__DeleteType*
+createLinkDelete(struct soap* soap, ifmap__IdentifierType* identifier0,
+                 ifmap__IdentifierType* identifier1, const char* filter);
+
+/*
+ * Append update or delete_ to the items of a publish request.
+ */
+extern void addUpdate(std::vector<__ifmap__union_PublishRequestType>& updates,
+                      ifmap__PublishType* update);
+extern void addDelete(std::vector<__ifmap__union_PublishRequestType>& updates,
+                      ifmap__DeleteType* delete_);
+
+#endif /*ifmap_publishitem_h__*/
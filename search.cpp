@@ -0,0 +1,232 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include "ifmap.nsmap"
+#include "client.h"
+#include "tlscache.h"
+#include "histogram.h"
+#include "searchpool.h"
+
+static void usage()
+{
+    fprintf(stderr, "usage: search [ --tls-cache file ] [ --session-file file ]\n"
+                    "              ifmap-server-url [ -c connections ] [ -q queue-size ]\n"
+                    "              [ -m match-links ] [ -d max-depth ] [ -s max-size ]\n"
+                    "              [ -r result-filter ] [ -T cache-seconds ]\n"
+                    "              [ -u user ] [ -p password ]\n\n");
+    fprintf(stderr, "              Reads one start identifier per line from standard\n"
+                    "              input, as \"type value [ qualifier ]\" such as\n"
+                    "              \"ip-address 10.0.0.1\" or \"identity alice username\",\n"
+                    "              and searches from each over connections keep-alive\n"
+                    "              connections (default 4). Results are printed as they\n"
+                    "              complete, with their latency, and are cut at max-size\n"
+                    "              bytes. With -T, a result is reused for cache-seconds\n"
+                    "              for the same query instead of searching again.\n");
+    exit(1);
+}
+
+struct Submitter
+{
+    SearchPool* pool;
+    SearchQuery query;
+    long lines;
+};
+
+//
+// Submits a search for each line of standard input, then ends the
+// pool's input.
+//
+static void* submitSearches(void* arg)
+{
+    Submitter* submitter = (Submitter*)arg;
+    std::string input;
+    bool eof = false;
+    while (!eof) {
+        char buf[65536];
+        ssize_t count = read(STDIN_FILENO, buf, sizeof buf);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            break;
+        }
+        input.append(buf, count);
+        if (count == 0) {
+            eof = true;
+            if (!input.empty() && input[input.size() - 1] != '\n') {
+                input += '\n';
+            }
+        }
+        size_t begin = 0;
+        size_t nl;
+        while ((nl = input.find('\n', begin)) != std::string::npos) {
+            std::string line = input.substr(begin, nl - begin);
+            begin = nl + 1;
+            submitter->lines++;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            submitter->query.tag = submitter->lines;
+            submitter->query.start = line;
+            submitter->pool->submit(submitter->query);
+        }
+        input.erase(0, begin);
+    }
+    submitter->pool->finish();
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    TlsSessionCache* tlsCache = 0;
+    const char* sessionFile = 0;
+    while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--tls-cache") == 0) {
+            tlsCache = new TlsSessionCache(argv[2]);
+        } else if (strcmp(argv[1], "--session-file") == 0) {
+            sessionFile = argv[2];
+        } else {
+            usage();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 2) {
+        usage();
+    }
+    char* url = argv[1];
+    int connections = 4;
+    long queueSize = 1000;
+    int cacheSeconds = 0;
+    char* user = 0;
+    char* password = 0;
+    Submitter submitter;
+    submitter.lines = 0;
+    argv++;
+    argc--;
+    while (--argc) {
+        char* option = *++argv;
+        if (!--argc) {
+            usage();
+        }
+        char* argument = *++argv;
+        if (strcmp(option, "-c") == 0) {
+            connections = atoi(argument);
+        } else if (strcmp(option, "-q") == 0) {
+            queueSize = atol(argument);
+        } else if (strcmp(option, "-m") == 0) {
+            submitter.query.matchLinks = argument;
+        } else if (strcmp(option, "-d") == 0) {
+            submitter.query.maxDepth = argument;
+        } else if (strcmp(option, "-s") == 0) {
+            submitter.query.maxSize = argument;
+        } else if (strcmp(option, "-r") == 0) {
+            submitter.query.resultFilter = argument;
+        } else if (strcmp(option, "-T") == 0) {
+            cacheSeconds = atoi(argument);
+        } else if (strcmp(option, "-u") == 0) {
+            user = argument;
+        } else if (strcmp(option, "-p") == 0) {
+            password = argument;
+        } else {
+            usage();
+        }
+    }
+    if (connections < 1 || queueSize < 1 || cacheSeconds < 0) {
+        usage();
+    }
+
+    IfmapClient client(url, user, password);
+    if (tlsCache) {
+        tlsCache->use(client.soap());
+    }
+    int code = sessionFile ? client.openSession(sessionFile) : client.newSession();
+    if (tlsCache) {
+        tlsCache->report(stderr);
+    }
+    if (code != SOAP_OK) {
+        client.printFault(stderr);
+        return 1;
+    }
+
+    SearchPool pool(client, connections, queueSize, cacheSeconds);
+    if (pool.start() != SOAP_OK) {
+        return 1;
+    }
+    submitter.pool = &pool;
+    pthread_t submitThread;
+    if (pthread_create(&submitThread, 0, submitSearches, &submitter) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    long long start = monotonicMicros();
+    LatencyHistogram latency;
+    long searches = 0;
+    long failed = 0;
+    long truncated = 0;
+    SearchOutcome outcome;
+    while (pool.next(outcome)) {
+        searches++;
+        latency.record(outcome.micros);
+        printf("Search %ld, %s: %.1f ms%s%s\n", outcome.tag, outcome.start.c_str(),
+               outcome.micros / 1000.0, outcome.cached ? ", cached" : "",
+               outcome.truncated ? ", truncated at max-size" : "");
+        // A result too big for the server is reported as truncated.
+        if (outcome.code != SOAP_OK) {
+            printf("  error: %s\n", outcome.error.c_str());
+            failed += !outcome.truncated;
+        }
+        truncated += outcome.truncated;
+        for (size_t ii = 0; ii < outcome.lines.size(); ii++) {
+            printf("  %s\n", outcome.lines[ii].c_str());
+        }
+    }
+    pthread_join(submitThread, 0);
+
+    double secs = (monotonicMicros() - start) / 1000000.0;
+    printf("%ld searches in %.1f s, %.0f/s, %ld failed, %ld truncated, %lld cached\n",
+           searches, secs, secs > 0 ? searches / secs : 0.0, failed, truncated,
+           pool.cacheHits());
+    latency.print(stdout, "search");
+    if (tlsCache) {
+        tlsCache->save(client.soap());
+    }
+    return failed == 0 ? 0 : 1;
+}
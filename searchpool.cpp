@@ -0,0 +1,349 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "searchpool.h"
+#include "client.h"
+#include "display.h"
+#include "histogram.h"
+
+static const struct {
+    const char* name;
+    _ifmap__IdentityType_type type;
+} s_identityTypes[] = {
+    { "aik-name", _ifmap__IdentityType_type__aik_name },
+    { "distinguished-name", _ifmap__IdentityType_type__distinguished_name },
+    { "dns-name", _ifmap__IdentityType_type__dns_name },
+    { "email-address", _ifmap__IdentityType_type__email_address },
+    { "kerberos-principal", _ifmap__IdentityType_type__kerberos_principal },
+    { "trusted-platform-module", _ifmap__IdentityType_type__trusted_platform_module },
+    { "username", _ifmap__IdentityType_type__username },
+    { "sip-uri", _ifmap__IdentityType_type__sip_uri },
+    { "tel-uri", _ifmap__IdentityType_type__tel_uri },
+    { "other", _ifmap__IdentityType_type__other },
+};
+
+//
+// Builds the identifier named by "type value [ qualifier ]" in soap's
+// memory. Returns 0 if start is malformed.
+//
+static ifmap__IdentifierType* createIdentifier(struct soap* soap, const std::string& start)
+{
+    std::vector<std::string> words;
+    size_t pos = 0;
+    while ((pos = start.find_first_not_of(" \t", pos)) != std::string::npos) {
+        size_t end = start.find_first_of(" \t", pos);
+        words.push_back(start.substr(pos, end == std::string::npos ? end : end - pos));
+        pos = end;
+    }
+    if (words.size() < 2 || words.size() > 3) {
+        return 0;
+    }
+    const std::string& type = words[0];
+    char* value = soap_strdup(soap, words[1].c_str());
+    const char* qualifier = words.size() == 3 ? words[2].c_str() : 0;
+
+    ifmap__IdentifierType* identifier = soap_new_ifmap__IdentifierType(soap, -1);
+    if (type == "access-request" && !qualifier) {
+        ifmap__AccessRequestType* accessRequest = soap_new_ifmap__AccessRequestType(soap, -1);
+        accessRequest->name = value;
+        identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_access_request;
+        identifier->union_IdentifierType.access_request = accessRequest;
+    } else if (type == "device") {
+        ifmap__DeviceType* device = soap_new_ifmap__DeviceType(soap, -1);
+        if (!qualifier || strcmp(qualifier, "name") == 0) {
+            device->__union_DeviceType = SOAP_UNION__ifmap__union_DeviceType_name;
+            device->union_DeviceType.name = value;
+        } else if (strcmp(qualifier, "aik-name") == 0) {
+            device->__union_DeviceType = SOAP_UNION__ifmap__union_DeviceType_aik_name;
+            device->union_DeviceType.aik_name = value;
+        } else {
+            return 0;
+        }
+        identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_device;
+        identifier->union_IdentifierType.device = device;
+    } else if (type == "identity") {
+        ifmap__IdentityType* identity = soap_new_ifmap__IdentityType(soap, -1);
+        identity->name = value;
+        size_t ii;
+        size_t count = sizeof s_identityTypes / sizeof s_identityTypes[0];
+        for (ii = 0; ii < count; ii++) {
+            if (strcmp(qualifier ? qualifier : "username", s_identityTypes[ii].name) == 0) {
+                identity->type = s_identityTypes[ii].type;
+                break;
+            }
+        }
+        if (ii == count) {
+            return 0;
+        }
+        identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_identity;
+        identifier->union_IdentifierType.identity = identity;
+    } else if (type == "ip-address" && !qualifier) {
+        ifmap__IPAddressType* ip = soap_new_ifmap__IPAddressType(soap, -1);
+        ip->value = value;
+        ip->type = strchr(value, ':') ? _ifmap__IPAddressType_type__IPv6
+                                      : _ifmap__IPAddressType_type__IPv4;
+        identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_ip_address;
+        identifier->union_IdentifierType.ip_address = ip;
+    } else if (type == "mac-address" && !qualifier) {
+        ifmap__MACAddressType* mac = soap_new_ifmap__MACAddressType(soap, -1);
+        mac->value = value;
+        identifier->__union_IdentifierType = SOAP_UNION__ifmap__union_IdentifierType_mac_address;
+        identifier->union_IdentifierType.mac_address = mac;
+    } else {
+        return 0;
+    }
+    return identifier;
+}
+
+static char* optionalString(struct soap* soap, const std::string& value)
+{
+    return value.empty() ? 0 : soap_strdup(soap, value.c_str());
+}
+
+SearchPool::SearchPool(IfmapClient& client, int connections, size_t queueSize, int cacheSeconds)
+    : m_client(client), m_connections(connections), m_cacheMicros(cacheSeconds * 1000000LL),
+      m_queries(queueSize), m_outcomes(queueSize), m_running(0), m_cacheHits(0)
+{
+    pthread_mutex_init(&m_lock, 0);
+}
+
+SearchPool::~SearchPool()
+{
+    finish();
+    for (size_t ii = 0; ii < m_workers.size(); ii++) {
+        if (m_workers[ii].thread) {
+            pthread_join(m_workers[ii].thread, 0);
+        }
+        delete m_workers[ii].client;
+    }
+    pthread_mutex_destroy(&m_lock);
+}
+
+int SearchPool::start()
+{
+    // All connections are attached before any thread starts, so that
+    // the workers never see m_workers change.
+    m_workers.resize(m_connections);
+    int ii;
+    for (ii = 0; ii < m_connections; ii++) {
+        Worker& worker = m_workers[ii];
+        worker.pool = this;
+        worker.thread = 0;
+        worker.client = m_client.clone();
+        // Metadata is deserialized into its types for display.
+        worker.client->soap()->imode |= SOAP_DOM_NODE;
+        worker.client->soap()->omode |= SOAP_DOM_NODE;
+        int code = worker.client->attach(m_client.sessionId());
+        if (code != SOAP_OK) {
+            worker.client->printFault(stderr);
+            return code;
+        }
+    }
+    for (ii = 0; ii < m_connections; ii++) {
+        pthread_mutex_lock(&m_lock);
+        m_running++;
+        pthread_mutex_unlock(&m_lock);
+        if (pthread_create(&m_workers[ii].thread, 0, work, &m_workers[ii]) != 0) {
+            m_workers[ii].thread = 0;
+            stopped();
+            return SOAP_ERR;
+        }
+    }
+    return SOAP_OK;
+}
+
+bool SearchPool::submit(const SearchQuery& query)
+{
+    return m_queries.push(query);
+}
+
+void SearchPool::finish()
+{
+    m_queries.close();
+    pthread_mutex_lock(&m_lock);
+    if (m_running == 0) {
+        m_outcomes.close();
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool SearchPool::next(SearchOutcome& outcome)
+{
+    return m_outcomes.pop(outcome, 0) == BoundedQueue<SearchOutcome>::ITEM;
+}
+
+long long SearchPool::cacheHits()
+{
+    pthread_mutex_lock(&m_lock);
+    long long hits = m_cacheHits;
+    pthread_mutex_unlock(&m_lock);
+    return hits;
+}
+
+void* SearchPool::work(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    worker->pool->run(*worker->client);
+    return 0;
+}
+
+void SearchPool::run(IfmapClient& client)
+{
+    SearchQuery query;
+    while (m_queries.pop(query, 0) == BoundedQueue<SearchQuery>::ITEM) {
+        SearchOutcome outcome;
+        search(client, query, outcome);
+        m_outcomes.push(outcome);
+    }
+    stopped();
+}
+
+//
+// Called as each worker exits. The last one ends the outcomes.
+//
+void SearchPool::stopped()
+{
+    pthread_mutex_lock(&m_lock);
+    if (--m_running == 0) {
+        m_outcomes.close();
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void SearchPool::search(IfmapClient& client, const SearchQuery& query, SearchOutcome& outcome)
+{
+    long long start = monotonicMicros();
+    outcome.tag = query.tag;
+    outcome.start = query.start;
+
+    std::string key;
+    if (m_cacheMicros) {
+        key = query.start + '\0' + query.matchLinks + '\0' + query.maxDepth + '\0'
+            + query.maxSize + '\0' + query.resultFilter;
+        if (lookup(key, outcome)) {
+            outcome.micros = monotonicMicros() - start;
+            return;
+        }
+    }
+
+    struct soap* soap = client.soap();
+    ifmap__SearchRequestType request;
+    request.identifier = createIdentifier(soap, query.start);
+    if (!request.identifier) {
+        outcome.code = SOAP_ERR;
+        outcome.error = "expected \"type value [ qualifier ]\"";
+        client.reset();
+        outcome.micros = monotonicMicros() - start;
+        return;
+    }
+    request.match_links = optionalString(soap, query.matchLinks);
+    request.max_depth = optionalString(soap, query.maxDepth);
+    request.max_size = optionalString(soap, query.maxSize);
+    request.result_filter = optionalString(soap, query.resultFilter);
+
+    ifmap__SearchResultType* result = 0;
+    outcome.code = client.search(&request, result);
+    if (outcome.code == SOAP_OK) {
+        if (result) {
+            formatSearchResult(*result, outcome.lines);
+        }
+        // Results are cut at the last whole line within maxSize bytes.
+        long maxSize = atol(query.maxSize.c_str());
+        if (maxSize > 0) {
+            long bytes = 0;
+            size_t ii;
+            for (ii = 0; ii < outcome.lines.size(); ii++) {
+                bytes += outcome.lines[ii].size() + 1;
+                if (bytes > maxSize) {
+                    break;
+                }
+            }
+            if (ii < outcome.lines.size()) {
+                outcome.lines.resize(ii);
+                outcome.truncated = true;
+            }
+        }
+    } else {
+        outcome.error = client.faultString();
+        outcome.truncated = client.errorCode() == _ifmap__ErrorResultType_errorCode__SearchResultsTooBig;
+    }
+    client.reset();
+
+    if (m_cacheMicros && outcome.code == SOAP_OK) {
+        store(key, outcome);
+    }
+    outcome.micros = monotonicMicros() - start;
+}
+
+bool SearchPool::lookup(const std::string& key, SearchOutcome& outcome)
+{
+    pthread_mutex_lock(&m_lock);
+    bool found = false;
+    std::map<std::string, CacheEntry>::iterator it = m_cache.find(key);
+    if (it != m_cache.end()) {
+        if (it->second.expires > monotonicMicros()) {
+            outcome.lines = it->second.lines;
+            outcome.truncated = it->second.truncated;
+            outcome.cached = true;
+            m_cacheHits++;
+            found = true;
+        } else {
+            m_cache.erase(it);
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return found;
+}
+
+void SearchPool::store(const std::string& key, const SearchOutcome& outcome)
+{
+    long long now = monotonicMicros();
+    pthread_mutex_lock(&m_lock);
+    // Every entry lives for the same time, so the oldest stores expire
+    // first. A key stored again since, or already dropped by lookup(),
+    // no longer has the expiry time listed for it.
+    while (!m_expiries.empty() && m_expiries.front().first <= now) {
+        std::map<std::string, CacheEntry>::iterator it
+            = m_cache.find(m_expiries.front().second);
+        if (it != m_cache.end() && it->second.expires == m_expiries.front().first) {
+            m_cache.erase(it);
+        }
+        m_expiries.pop_front();
+    }
+    CacheEntry& entry = m_cache[key];
+    entry.expires = now + m_cacheMicros;
+    entry.lines = outcome.lines;
+    entry.truncated = outcome.truncated;
+    m_expiries.push_back(std::make_pair(entry.expires, key));
+    pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_searchpool_h__
+#define ifmap_searchpool_h__
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "boundedqueue.h"
+
+class IfmapClient;
+
+/*
+ * A search to run. start names the identifier searched from as
+ * "type value [ qualifier ]", where type is access-request, device,
+ * identity, ip-address or mac-address; the qualifier is the identity
+ * type (default username) or aik-name or name for a device (default
+ * name). The other fields are the SearchRequestType attributes and
+ * are left out of the request when empty.
+ */
+struct SearchQuery
+{
+    SearchQuery() : tag(0) {}
+
+    long tag;
+    std::string start;
+    std::string matchLinks;
+    std::string maxDepth;
+    std::string maxSize;
+    std::string resultFilter;
+};
+
+/*
+ * What a search returned, as the lines displaySearchResult() prints.
+ * truncated is set if the result reached maxSize bytes, either here
+ * or at the server, which answers SearchResultsTooBig.
+ */
+struct SearchOutcome
+{
+    SearchOutcome() : tag(0), code(0), truncated(false), cached(false), micros(0) {}
+
+    long tag;
+    std::string start;
+    int code;
+    std::string error;
+    std::vector<std::string> lines;
+    bool truncated;
+    bool cached;
+    long long micros;
+};
+
+/*
+ * Runs searches concurrently, one at a time on each of a number of
+ * keep-alive connections attached to the session of the client it is
+ * given.
+ *
+ * Successful results may be kept for cacheSeconds and returned again,
+ * without a request, for the same query; 0 disables the cache.
+ *
+ * submit() blocks while queueSize searches are waiting for a
+ * connection, and workers block while queueSize outcomes are waiting
+ * to be read, so submit from one thread and call next() from another.
+ * Outcomes arrive in the order the searches complete.
+ */
+class SearchPool
+{
+public:
+    SearchPool(IfmapClient& client, int connections, size_t queueSize, int cacheSeconds);
+    ~SearchPool();
+
+    /*
+     * Opens the connections and starts their threads. Returns SOAP_OK
+     * if successful, gSOAP error code of the failed attach otherwise.
+     */
+    int start();
+
+    /*
+     * Queues a search. Returns false after finish().
+     */
+    bool submit(const SearchQuery& query);
+
+    /*
+     * Ends submission; next() returns false once the searches already
+     * submitted have completed.
+     */
+    void finish();
+
+    /*
+     * Waits for the next completed search.
+     */
+    bool next(SearchOutcome& outcome);
+
+    long long cacheHits();
+
+private:
+    SearchPool(const SearchPool&);
+    SearchPool& operator=(const SearchPool&);
+
+    struct Worker
+    {
+        SearchPool* pool;
+        IfmapClient* client;
+        pthread_t thread;
+    };
+
+    struct CacheEntry
+    {
+        long long expires;
+        std::vector<std::string> lines;
+        bool truncated;
+    };
+
+    static void* work(void* arg);
+    void run(IfmapClient& client);
+    void stopped();
+    void search(IfmapClient& client, const SearchQuery& query, SearchOutcome& outcome);
+    bool lookup(const std::string& key, SearchOutcome& outcome);
+    void store(const std::string& key, const SearchOutcome& outcome);
+
+    IfmapClient& m_client;
+    int m_connections;
+    long long m_cacheMicros;
+    std::vector<Worker> m_workers;
+    BoundedQueue<SearchQuery> m_queries;
+    BoundedQueue<SearchOutcome> m_outcomes;
+
+    // Protects everything below.
+    pthread_mutex_t m_lock;
+    int m_running;
+    std::map<std::string, CacheEntry> m_cache;
+    // The expiry time and key of each store, oldest first.
+    std::deque<std::pair<long long, std::string> > m_expiries;
+    long long m_cacheHits;
+};
+
+#endif /*ifmap_searchpool_h__*/
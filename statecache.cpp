@@ -0,0 +1,106 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "statecache.h"
+
+StateCache::StateCache()
+    : m_complete(false), m_suppressed(0), m_inBatch(false)
+{
+}
+
+void StateCache::reset(bool complete)
+{
+    m_published.clear();
+    m_unknown.clear();
+    m_complete = complete;
+    // A batch being published goes out on the new session.
+    for (size_t ii = 0; ii < m_batch.size(); ii++) {
+        record(m_batch[ii].key, m_batch[ii].value, m_batch[ii].update);
+    }
+}
+
+bool StateCache::needed(const std::string& key, const std::string& value, bool update)
+{
+    std::map<std::string, std::set<std::string> >::const_iterator it = m_published.find(key);
+    bool unchanged;
+    if (update) {
+        unchanged = it != m_published.end() && it->second.count(value);
+    } else {
+        // Without a complete picture, the key may have been published
+        // before this process started. A forgotten key may still be
+        // on the server too.
+        unchanged = m_complete && it == m_published.end() && !m_unknown.count(key);
+    }
+    if (unchanged) {
+        m_suppressed++;
+    }
+    return !unchanged;
+}
+
+void StateCache::published(const std::string& key, const std::string& value, bool update)
+{
+    record(key, value, update);
+    if (m_inBatch) {
+        Operation operation;
+        operation.key = key;
+        operation.value = value;
+        operation.update = update;
+        m_batch.push_back(operation);
+    }
+}
+
+void StateCache::forget(const std::string& key)
+{
+    m_published.erase(key);
+    m_unknown.insert(key);
+}
+
+void StateCache::beginBatch()
+{
+    m_inBatch = true;
+    m_batch.clear();
+}
+
+void StateCache::endBatch()
+{
+    m_inBatch = false;
+    m_batch.clear();
+}
+
+void StateCache::record(const std::string& key, const std::string& value, bool update)
+{
+    if (update) {
+        m_published[key].insert(value);
+    } else {
+        m_published.erase(key);
+        m_unknown.erase(key);
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_statecache_h__
+#define ifmap_statecache_h__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*
+ * What this client has published in its current session, so that
+ * publishes that would not change the server's state can be dropped.
+ *
+ * A key names the identifiers and metadata type, such as an ip-mac
+ * link or the events of one name on an IP address. Each update adds
+ * a value under its key, as metadata instances accumulate on the
+ * server; a delete removes the key with all its values.
+ *
+ * Attach one to an IfmapClient with setStateCache(), which resets it
+ * whenever the session changes or the publisher's metadata is purged.
+ * Not thread safe.
+ */
+class StateCache
+{
+public:
+    StateCache();
+
+    /*
+     * Forgets everything published. complete says that nothing this
+     * client published is left on the server, as after starting a
+     * new session, so that deletes of unknown keys can be skipped.
+     */
+    void reset(bool complete);
+
+    /*
+     * Returns true if the update or delete would change the server's
+     * state and should be sent, otherwise counts it as suppressed.
+     * value is ignored for deletes.
+     */
+    bool needed(const std::string& key, const std::string& value, bool update);
+
+    /*
+     * Records an update or delete about to be sent, so that later
+     * operations in the same request are checked against it.
+     */
+    void published(const std::string& key, const std::string& value, bool update);
+
+    /*
+     * Forgets what is known of key after the server rejects an
+     * operation on it, so that its next update or delete is sent.
+     */
+    void forget(const std::string& key);
+
+    /*
+     * Operations recorded from beginBatch() until endBatch() make up
+     * one batch. If the session is replaced while the batch is being
+     * published, reset() records them again, as they are then sent on
+     * the new session.
+     */
+    void beginBatch();
+    void endBatch();
+
+    long long suppressed() const { return m_suppressed; }
+
+private:
+    struct Operation
+    {
+        std::string key;
+        std::string value;
+        bool update;
+    };
+
+    void record(const std::string& key, const std::string& value, bool update);
+
+    std::map<std::string, std::set<std::string> > m_published;
+    std::set<std::string> m_unknown;
+    bool m_complete;
+    long long m_suppressed;
+    bool m_inBatch;
+    std::vector<Operation> m_batch;
+};
+
+#endif /*ifmap_statecache_h__*/
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tlscache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include "ifmapH.h"
+#include "histogram.h"
+
+TlsSessionCache::TlsSessionCache(const char* path)
+    : m_path(path), m_connect(0), m_offered(false), m_connected(false),
+      m_resumed(false), m_connectMicros(0)
+{
+}
+
+void TlsSessionCache::use(struct soap* soap)
+{
+    m_connect = soap->fopen;
+    soap->fopen = timedConnect;
+    soap->user = this;
+
+    FILE* file = fopen(m_path.c_str(), "r");
+    if (!file) {
+        return;
+    }
+    char host[sizeof soap->session_host];
+    int port;
+    char format[20];
+    snprintf(format, sizeof format, "%%%ds %%d\n", (int)sizeof host - 1);
+    if (fscanf(file, format, host, &port) == 2) {
+        SSL_SESSION* session = PEM_read_SSL_SESSION(file, 0, 0, 0);
+        if (session) {
+            // gSOAP sets this session on the SSL object of its next
+            // connection to host and port, then frees it.
+            if (soap->session) {
+                SSL_SESSION_free(soap->session);
+            }
+            soap->session = session;
+            strcpy(soap->session_host, host);
+            soap->session_port = port;
+            m_offered = true;
+        }
+    }
+    fclose(file);
+}
+
+int TlsSessionCache::timedConnect(struct soap* soap, const char* endpoint, const char* host, int port)
+{
+    TlsSessionCache* cache = (TlsSessionCache*)soap->user;
+    long long start = monotonicMicros();
+    int socket = cache->m_connect(soap, endpoint, host, port);
+    cache->m_connectMicros = monotonicMicros() - start;
+    cache->m_connected = soap->ssl != 0;
+    cache->m_resumed = soap->ssl && SSL_session_reused(soap->ssl);
+    return socket;
+}
+
+bool TlsSessionCache::save(struct soap* soap)
+{
+    // A connection the server has closed leaves its session behind in
+    // soap->session.
+    SSL_SESSION* session = 0;
+    const char* host = soap->host;
+    int port = soap->port;
+    if (soap->ssl) {
+        session = SSL_get1_session(soap->ssl);
+    } else if (soap->session) {
+        session = soap->session;
+        host = soap->session_host;
+        port = soap->session_port;
+    }
+    if (!session) {
+        return true;
+    }
+
+    // Write a private temporary file and rename it over the cache, so
+    // that readers never see a partial session.
+    std::string tempPath = m_path + ".XXXXXX";
+    int fd = mkstemp(&tempPath[0]);
+    FILE* file = fd == -1 ? 0 : fdopen(fd, "w");
+    bool ok = file
+        && fprintf(file, "%s %d\n", host, port) > 0
+        && PEM_write_SSL_SESSION(file, session);
+    if (file && fclose(file) != 0) {
+        ok = false;
+    } else if (!file && fd != -1) {
+        close(fd);
+    }
+    if (session != soap->session) {
+        SSL_SESSION_free(session);
+    }
+    if (ok && rename(tempPath.c_str(), m_path.c_str()) == 0) {
+        return true;
+    }
+    perror(m_path.c_str());
+    if (fd != -1) {
+        unlink(tempPath.c_str());
+    }
+    return false;
+}
+
+void TlsSessionCache::report(FILE* out) const
+{
+    if (!m_connected) {
+        return;
+    }
+    const char* result = m_resumed ? "resumed cached session"
+        : m_offered ? "full handshake, cached session rejected"
+        : "full handshake, no cached session";
+    fprintf(out, "TLS: %s, connect and handshake took %.1f ms\n",
+            result, m_connectMicros / 1000.0);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ifmap_tlscache_h__
+#define ifmap_tlscache_h__
+
+#include <stdio.h>
+#include <string>
+
+struct soap;
+
+/*
+ * Keeps the TLS session of a connection in a file, so that the next
+ * process connecting to the same server resumes it with an
+ * abbreviated handshake instead of a full one.
+ *
+ * The file holds the server's host and port followed by the session
+ * in PEM format. gSOAP only offers the session to a server at the
+ * same host and port. The file is replaced atomically, so any number
+ * of processes may share it.
+ */
+class TlsSessionCache
+{
+public:
+    TlsSessionCache(const char* path);
+
+    /*
+     * Offers the cached session, if any, on soap's next connection
+     * and times that connection's handshake. Call before connecting.
+     */
+    void use(struct soap* soap);
+
+    /*
+     * Writes the session of soap's connection to the file. Call once
+     * a request has succeeded, so that a session ticket sent after
+     * the handshake has been received.
+     *
+     * Returns false and prints an error if the session could not be
+     * saved.
+     */
+    bool save(struct soap* soap);
+
+    /*
+     * Prints whether the connection resumed the cached session and
+     * how long connecting and the handshake took.
+     */
+    void report(FILE* out) const;
+
+private:
+    static int timedConnect(struct soap* soap, const char* endpoint, const char* host, int port);
+
+    std::string m_path;
+    int (*m_connect)(struct soap*, const char*, const char*, int);
+    bool m_offered;
+    bool m_connected;
+    bool m_resumed;
+    long long m_connectMicros;
+};
+
+#endif /*ifmap_tlscache_h__*/
@@ -0,0 +1,618 @@
+/*
+ * Copyright 2008 Juniper Networks, Inc. All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * o Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the  
+ *   distribution.
+ * o Neither the name of Juniper Networks nor the names of its
+ *   contributors may be used to endorse or promote products 
+ *   derived from this software without specific prior written 
+ *   permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// A TCP proxy that makes the path to an IF-MAP server behave like a
+// WAN link, for benchmarking clients on one machine. Data is delayed
+// and rate limited in each direction, and connections can be reset or
+// have their reads stalled at random. Bytes are passed through
+// untouched, so TLS works end to end.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+#include "histogram.h"
+
+static const size_t s_readSize = 16384;
+
+// Reading from a side stops while this much is waiting to be
+// delivered to the other, much as a TCP window would.
+static const size_t s_maxQueued = 1024 * 1024;
+
+static const unsigned long long s_listenId = ~0ULL;
+
+static long long g_delay = 0;
+static long long g_jitter = 0;
+static double g_bytesPerSecond = 0;
+static double g_resetBytes = 0;
+static double g_stallChance = 0;
+static long long g_stall = 0;
+static bool g_verbose = false;
+
+static struct addrinfo* g_server = 0;
+static int g_epollFd = -1;
+
+static long g_connectionsOpened = 0;
+static long g_connectionsReset = 0;
+
+static void usage()
+{
+    fprintf(stderr, "usage: wan-proxy port server-host:port [ -d delay-ms ] [ -j jitter-ms ]\n"
+                    "                 [ -w kbit/s ] [ -x reset-kbytes ]\n"
+                    "                 [ -s stall-percent ] [ -S stall-ms ] [ -b bind-address ] [ -v ]\n\n");
+    fprintf(stderr, "       Accepts connections on port and forwards each to the\n"
+                    "       server. Data in each direction arrives delay-ms (default\n"
+                    "       0) later, plus or minus up to jitter-ms but never out of\n"
+                    "       order, and at most kbit/s when -w is given. A new\n"
+                    "       connection waits one round trip before its first bytes\n"
+                    "       go out, as a TCP handshake would. -x resets connections\n"
+                    "       after a random amount of data, reset-kbytes on average.\n"
+                    "       Each read has a stall-percent chance of stopping\n"
+                    "       reads from that side for stall-ms (default 1000).\n"
+                    "       -v reports every connection opened or closed. Totals\n"
+                    "       are printed on exit.\n");
+    exit(1);
+}
+
+//
+// A read waiting to be delivered.
+//
+struct Chunk
+{
+    long long due;
+    std::string data;
+};
+
+//
+// Data flowing one way through a connection.
+//
+struct Direction
+{
+    int from;
+    int to;
+    std::deque<Chunk> chunks;
+    size_t written;
+    size_t queued;
+    long long lastDue;
+    long long linkFree;
+    long long stalledUntil;
+    bool eof;
+    bool shutDown;
+};
+
+//
+// A client connection and the one made to the server for it. Side 0
+// is the client and side 1 the server; direction n carries data read
+// from side n.
+//
+struct Connection
+{
+    long id;
+    int fds[2];
+    Direction directions[2];
+    unsigned events[2];
+    bool connected;
+    long long bytes;
+    long long resetAfter;
+    long long timerAt;
+};
+
+static std::map<long, Connection*> g_connections;
+
+typedef std::pair<long long, long> Timer;
+static std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > g_timers;
+
+static void fail(const char* what)
+{
+    perror(what);
+    exit(1);
+}
+
+static struct addrinfo* resolve(const char* host, const char* port, bool passive)
+{
+    struct addrinfo hints;
+    bzero(&hints, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    struct addrinfo* result = 0;
+    int error = getaddrinfo(host, port, &hints, &result);
+    if (error) {
+        fprintf(stderr, "%s:%s: %s\n", host ? host : "*", port, gai_strerror(error));
+        exit(1);
+    }
+    return result;
+}
+
+static int listenOn(const char* host, const char* port)
+{
+    struct addrinfo* address = resolve(host, port, true);
+    int fd = socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        fail("socket");
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if (bind(fd, address->ai_addr, address->ai_addrlen) == -1) {
+        fail("bind");
+    }
+    if (listen(fd, 128) == -1) {
+        fail("listen");
+    }
+    freeaddrinfo(address);
+    return fd;
+}
+
+//
+// A random delay of up to g_jitter either way.
+//
+static long long jitter()
+{
+    return g_jitter ? (long long)((drand48() * 2 - 1) * g_jitter) : 0;
+}
+
+static void watch(Connection* connection, int side, unsigned events)
+{
+    if (connection->fds[side] == -1 || connection->events[side] == events) {
+        return;
+    }
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = ((unsigned long long)connection->id << 1) | side;
+    if (epoll_ctl(g_epollFd, EPOLL_CTL_MOD, connection->fds[side], &event) == -1) {
+        fail("epoll_ctl");
+    }
+    connection->events[side] = events;
+}
+
+//
+// Closes both sides. A reset closes them with RST instead of FIN, as
+// a middlebox dropping the connection would.
+//
+static void closeConnection(Connection* connection, bool reset)
+{
+    for (int side = 0; side < 2; side++) {
+        int fd = connection->fds[side];
+        if (fd == -1) {
+            continue;
+        }
+        if (reset) {
+            struct linger linger;
+            linger.l_onoff = 1;
+            linger.l_linger = 0;
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof linger);
+        }
+        close(fd);
+    }
+    if (reset) {
+        g_connectionsReset++;
+    }
+    if (g_verbose) {
+        printf("connection %ld %s after %lld bytes\n", connection->id,
+               reset ? "reset" : "closed", connection->bytes);
+        fflush(stdout);
+    }
+    g_connections.erase(connection->id);
+    delete connection;
+}
+
+static void pump(Connection* connection, long long now);
+
+static void openConnection(int clientFd)
+{
+    int serverFd = socket(g_server->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (serverFd == -1) {
+        perror("socket");
+        close(clientFd);
+        return;
+    }
+    bool connected = connect(serverFd, g_server->ai_addr, g_server->ai_addrlen) == 0;
+    if (!connected && errno != EINPROGRESS) {
+        perror("connect");
+        close(serverFd);
+        close(clientFd);
+        return;
+    }
+    // Delays are the proxy's to add; don't let Nagle add more.
+    int on = 1;
+    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    setsockopt(serverFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+    Connection* connection = new Connection;
+    connection->id = ++g_connectionsOpened;
+    connection->fds[0] = clientFd;
+    connection->fds[1] = serverFd;
+    long long now = monotonicMicros();
+    for (int side = 0; side < 2; side++) {
+        Direction& direction = connection->directions[side];
+        direction.from = connection->fds[side];
+        direction.to = connection->fds[1 - side];
+        direction.written = 0;
+        direction.queued = 0;
+        direction.lastDue = now;
+        direction.linkFree = now;
+        direction.stalledUntil = 0;
+        direction.eof = false;
+        direction.shutDown = false;
+        connection->events[side] = 0;
+    }
+    // The client's connect returned at once, but on a WAN its first
+    // bytes would leave only after the handshake's round trip.
+    connection->directions[0].lastDue = now + 3 * g_delay;
+    connection->connected = connected;
+    connection->bytes = 0;
+    connection->resetAfter = 0;
+    if (g_resetBytes > 0) {
+        connection->resetAfter = (long long)(-log(1 - drand48()) * g_resetBytes) + 1;
+    }
+    connection->timerAt = 0;
+    g_connections[connection->id] = connection;
+
+    for (int side = 0; side < 2; side++) {
+        epoll_event event;
+        event.events = 0;
+        event.data.u64 = ((unsigned long long)connection->id << 1) | side;
+        if (epoll_ctl(g_epollFd, EPOLL_CTL_ADD, connection->fds[side], &event) == -1) {
+            fail("epoll_ctl");
+        }
+    }
+    if (g_verbose) {
+        printf("connection %ld opened\n", connection->id);
+        fflush(stdout);
+    }
+    pump(connection, now);
+}
+
+static void acceptConnections(int listenFd)
+{
+    while (true) {
+        int fd = accept4(listenFd, 0, 0, SOCK_NONBLOCK);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+            }
+            if (errno != EINTR && errno != ECONNABORTED) {
+                return;
+            }
+            continue;
+        }
+        openConnection(fd);
+    }
+}
+
+//
+// Reads what has arrived on a side and queues it for delivery.
+// Returns false if the side has failed.
+//
+static bool readFrom(Connection* connection, int side, long long now)
+{
+    Direction& direction = connection->directions[side];
+    char buf[s_readSize];
+    ssize_t count = read(direction.from, buf, sizeof buf);
+    if (count == 0) {
+        direction.eof = true;
+        return true;
+    }
+    if (count < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+
+    // The bytes leave once the link has sent what was ahead of them,
+    // then take the delay to arrive, but never before earlier bytes.
+    long long sent = now;
+    if (g_bytesPerSecond > 0) {
+        sent = (direction.linkFree > now ? direction.linkFree : now)
+            + (long long)(count * 1000000.0 / g_bytesPerSecond);
+        direction.linkFree = sent;
+    }
+    long long due = sent + g_delay + jitter();
+    if (due < direction.lastDue) {
+        due = direction.lastDue;
+    }
+    direction.lastDue = due;
+
+    direction.chunks.push_back(Chunk());
+    direction.chunks.back().due = due;
+    direction.chunks.back().data.assign(buf, count);
+    direction.queued += count;
+    connection->bytes += count;
+    if (g_stallChance > 0 && drand48() < g_stallChance) {
+        direction.stalledUntil = now + g_stall;
+    }
+    return true;
+}
+
+//
+// Writes the chunks in a direction that are due. Returns false if the
+// receiving side has failed.
+//
+static bool deliver(Direction& direction, long long now)
+{
+    while (!direction.chunks.empty() && direction.chunks.front().due <= now) {
+        Chunk& chunk = direction.chunks.front();
+        ssize_t count = write(direction.to, chunk.data.data() + direction.written,
+                              chunk.data.size() - direction.written);
+        if (count < 0) {
+            return errno == EAGAIN || errno == EINTR;
+        }
+        direction.written += count;
+        if (direction.written == chunk.data.size()) {
+            direction.queued -= chunk.data.size();
+            direction.written = 0;
+            direction.chunks.pop_front();
+        }
+    }
+    if (direction.eof && direction.chunks.empty() && !direction.shutDown) {
+        shutdown(direction.to, SHUT_WR);
+        direction.shutDown = true;
+    }
+    return true;
+}
+
+//
+// Delivers what is due, then closes the connection if it is done or
+// due for a reset, or else updates what epoll watches for and when the
+// connection next needs a timer.
+//
+static void pump(Connection* connection, long long now)
+{
+    if (connection->resetAfter && connection->bytes >= connection->resetAfter) {
+        closeConnection(connection, true);
+        return;
+    }
+    for (int side = 0; side < 2; side++) {
+        if ((side == 1 || connection->connected)
+            && !deliver(connection->directions[side], now)) {
+            closeConnection(connection, true);
+            return;
+        }
+    }
+    if (connection->directions[0].shutDown && connection->directions[1].shutDown) {
+        closeConnection(connection, false);
+        return;
+    }
+
+    long long wakeAt = 0;
+    for (int side = 0; side < 2; side++) {
+        const Direction& direction = connection->directions[side];
+        const Direction& toThisSide = connection->directions[1 - side];
+        unsigned events = 0;
+        bool canRead = side == 0 || connection->connected;
+        if (canRead && !direction.eof && direction.queued < s_maxQueued) {
+            if (direction.stalledUntil > now) {
+                if (!wakeAt || direction.stalledUntil < wakeAt) {
+                    wakeAt = direction.stalledUntil;
+                }
+            } else {
+                events |= EPOLLIN;
+            }
+        }
+        if (!toThisSide.chunks.empty()) {
+            long long due = toThisSide.chunks.front().due;
+            if (side == 1 && !connection->connected) {
+                // Wait for the connect to finish.
+            } else if (due <= now) {
+                // deliver() stopped because the socket was full.
+                events |= EPOLLOUT;
+            } else if (!wakeAt || due < wakeAt) {
+                wakeAt = due;
+            }
+        }
+        if (side == 1 && !connection->connected) {
+            events |= EPOLLOUT;
+        }
+        watch(connection, side, events);
+    }
+    if (wakeAt && (!connection->timerAt || wakeAt < connection->timerAt)) {
+        connection->timerAt = wakeAt;
+        g_timers.push(Timer(wakeAt, connection->id));
+    }
+}
+
+static void handleEvents(Connection* connection, int side, unsigned events, long long now)
+{
+    if (side == 1 && !connection->connected) {
+        int error = 0;
+        socklen_t length = sizeof error;
+        getsockopt(connection->fds[1], SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error) {
+            if (g_verbose) {
+                fprintf(stderr, "connection %ld: %s\n", connection->id, strerror(error));
+            }
+            closeConnection(connection, true);
+            return;
+        }
+        connection->connected = true;
+    }
+    if (events & EPOLLERR) {
+        closeConnection(connection, true);
+        return;
+    }
+    if ((events & (EPOLLIN | EPOLLHUP)) && !connection->directions[side].eof
+        && !readFrom(connection, side, now)) {
+        closeConnection(connection, true);
+        return;
+    }
+    if ((events & EPOLLHUP) && connection->directions[side].eof) {
+        // Nothing more can be sent to this side either. Stop
+        // watching it, so that the hangup is not reported again,
+        // and drop what was on its way to it.
+        Direction& toThisSide = connection->directions[1 - side];
+        toThisSide.chunks.clear();
+        toThisSide.queued = 0;
+        toThisSide.eof = true;
+        toThisSide.shutDown = true;
+        epoll_ctl(g_epollFd, EPOLL_CTL_DEL, connection->fds[side], 0);
+        connection->events[side] = 0;
+        close(connection->fds[side]);
+        connection->fds[side] = -1;
+    }
+    pump(connection, now);
+}
+
+static Connection* findConnection(long id)
+{
+    std::map<long, Connection*>::iterator it = g_connections.find(id);
+    return it == g_connections.end() ? 0 : it->second;
+}
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void onStop(int)
+{
+    g_stop = 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+    }
+    char* port = argv[1];
+    char* server = argv[2];
+    char* host = 0;
+    argv += 2;
+    argc -= 2;
+    while (--argc) {
+        char* option = *++argv;
+        if (strcmp(option, "-v") == 0) {
+            g_verbose = true;
+            continue;
+        }
+        if (!--argc) {
+            usage();
+        }
+        char* argument = *++argv;
+        if (strcmp(option, "-d") == 0) {
+            g_delay = (long long)(atof(argument) * 1000);
+        } else if (strcmp(option, "-j") == 0) {
+            g_jitter = (long long)(atof(argument) * 1000);
+        } else if (strcmp(option, "-w") == 0) {
+            g_bytesPerSecond = atof(argument) * 1000 / 8;
+        } else if (strcmp(option, "-x") == 0) {
+            g_resetBytes = atof(argument) * 1024;
+        } else if (strcmp(option, "-s") == 0) {
+            g_stallChance = atof(argument) / 100;
+        } else if (strcmp(option, "-S") == 0) {
+            g_stall = (long long)(atof(argument) * 1000);
+        } else if (strcmp(option, "-b") == 0) {
+            host = argument;
+        } else {
+            usage();
+        }
+    }
+    char* colon = strrchr(server, ':');
+    if (!colon || g_delay < 0 || g_jitter < 0 || g_bytesPerSecond < 0 || g_resetBytes < 0
+        || g_stallChance < 0 || g_stall < 0) {
+        usage();
+    }
+    if (g_stallChance > 0 && !g_stall) {
+        g_stall = 1000000;
+    }
+    *colon = 0;
+    g_server = resolve(server, colon + 1, false);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onStop);
+    signal(SIGTERM, onStop);
+    srand48(time(0) ^ getpid());
+
+    int listenFd = listenOn(host, port);
+    g_epollFd = epoll_create(1024);
+    if (g_epollFd == -1) {
+        fail("epoll_create");
+    }
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = s_listenId;
+    if (epoll_ctl(g_epollFd, EPOLL_CTL_ADD, listenFd, &event) == -1) {
+        fail("epoll_ctl");
+    }
+    printf("forwarding port %s to %s:%s\n", port, server, colon + 1);
+    fflush(stdout);
+
+    while (!g_stop) {
+        long long now = monotonicMicros();
+        while (!g_timers.empty() && g_timers.top().first <= now) {
+            Timer timer = g_timers.top();
+            g_timers.pop();
+            Connection* connection = findConnection(timer.second);
+            // Only the connection's latest timer counts.
+            if (connection && connection->timerAt == timer.first) {
+                connection->timerAt = 0;
+                pump(connection, now);
+            }
+        }
+        int timeout = -1;
+        if (!g_timers.empty()) {
+            timeout = (int)((g_timers.top().first - now + 999) / 1000);
+        }
+
+        epoll_event events[64];
+        int count = epoll_wait(g_epollFd, events, 64, timeout);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("epoll_wait");
+        }
+        now = monotonicMicros();
+        for (int ii = 0; ii < count; ii++) {
+            if (events[ii].data.u64 == s_listenId) {
+                acceptConnections(listenFd);
+                continue;
+            }
+            // Earlier events in this batch may have closed it.
+            Connection* connection = findConnection((long)(events[ii].data.u64 >> 1));
+            if (connection) {
+                handleEvents(connection, (int)(events[ii].data.u64 & 1), events[ii].events, now);
+            }
+        }
+    }
+    printf("%ld connections opened, %ld reset\n", g_connectionsOpened, g_connectionsReset);
+    return 0;
+}